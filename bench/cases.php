@@ -0,0 +1,173 @@
+<?php
+
+/**
+ * Benchmark cases of bench/run.php
+ * 
+ * name => array('setup' => function returning the state, 'run' => function($state, $n) doing $n operations)
+ */
+
+$ipHeader = pack('CCnnnCCnNN', 0x45, 0, 60, 1, 0x4000, 64, PROT_TCP, 0, ip2long('10.0.0.1'), ip2long('10.0.0.2'));
+$tcpRaw = pack('nnNNCCnnn', 1000, 80, 1, 0, 0x50, 0x18, 1024, 0, 0) . str_repeat('x', 20);
+$udpRaw = pack('nnnn', 1000, 53, 28, 0) . str_repeat('x', 20);
+
+$tcpPacket = $ipHeader . $tcpRaw;
+$udpPacket = substr($ipHeader, 0, IIPv4::PROTOCOL) . chr(PROT_UDP) . substr($ipHeader, IIPv4::CHECKSUM) . $udpRaw;
+
+$newMemory = function() {
+	$m = new Memory(64);
+	
+	return $m;
+};
+
+//appends start over every block, so calibrating to 1e8 operations doesn't grow one Memory to 1e8 bytes
+$appendBlock = 1024;
+
+$buildTCP = function() {
+	$ip = new IPv4ProtocolPacket();
+	$ip->setIdSequence(1);
+	$ip->setProtocol(PROT_TCP);
+	$ip->setSrcIP('10.0.0.1');
+	$ip->setDstIP('10.0.0.2');
+	
+	$tcp = new TCPProtocolPacket();
+	$tcp->setSrcPort(1000);
+	$tcp->setDstPort(80);
+	$tcp->setIdSequence(1);
+	$tcp->setFlags(ITCP::FLAG_ACK);
+	$tcp->setWindowSize(1024);
+	$tcp->setData(str_repeat('x', 20));
+	
+	$ip->setData($tcp);
+	
+	return $ip;
+};
+
+return array(
+	//Memory, per width
+	'memory.append.byte' => array('setup' => $newMemory, 'run' => function($m, $n) use ($appendBlock) {
+		for ($done = 0; $done < $n; $done += $appendBlock) {
+			$m->resetMemory();
+			for ($i = min($appendBlock, $n - $done); $i > 0; $i--) $m->addByte(0x7F);
+		}
+	}),
+	'memory.append.short' => array('setup' => $newMemory, 'run' => function($m, $n) use ($appendBlock) {
+		for ($done = 0; $done < $n; $done += $appendBlock) {
+			$m->resetMemory();
+			for ($i = min($appendBlock, $n - $done); $i > 0; $i--) $m->addShort(0x7F7F);
+		}
+	}),
+	'memory.append.integer' => array('setup' => $newMemory, 'run' => function($m, $n) use ($appendBlock) {
+		for ($done = 0; $done < $n; $done += $appendBlock) {
+			$m->resetMemory();
+			for ($i = min($appendBlock, $n - $done); $i > 0; $i--) $m->addInteger(0x7F7F7F7F);
+		}
+	}),
+	'memory.read.byte' => array('setup' => $newMemory, 'run' => function($m, $n) {
+		for ($i = 0; $i < $n; $i++) $m->getByte($i & 0x3F);
+	}),
+	'memory.read.short' => array('setup' => $newMemory, 'run' => function($m, $n) {
+		for ($i = 0; $i < $n; $i++) $m->getShort($i & 0x3E);
+	}),
+	'memory.read.integer' => array('setup' => $newMemory, 'run' => function($m, $n) {
+		for ($i = 0; $i < $n; $i++) $m->getInteger($i & 0x3C);
+	}),
+	'memory.write.byte' => array('setup' => $newMemory, 'run' => function($m, $n) {
+		for ($i = 0; $i < $n; $i++) $m->setByte($i & 0x3F, $i);
+	}),
+	'memory.write.short' => array('setup' => $newMemory, 'run' => function($m, $n) {
+		for ($i = 0; $i < $n; $i++) $m->setShort($i & 0x3E, $i);
+	}),
+	'memory.write.integer' => array('setup' => $newMemory, 'run' => function($m, $n) {
+		for ($i = 0; $i < $n; $i++) $m->setInteger($i & 0x3C, $i);
+	}),
+	
+	//Endian
+	'endian.short' => array('setup' => null, 'run' => function($s, $n) {
+		for ($i = 0; $i < $n; $i++) Endian::convertEndianShort($i);
+	}),
+	'endian.integer' => array('setup' => null, 'run' => function($s, $n) {
+		for ($i = 0; $i < $n; $i++) Endian::convertEndianInteger($i);
+	}),
+	
+	//parse: construct from raw data and read the header fields
+	'ipv4.parse' => array('setup' => function() use ($tcpPacket) { return $tcpPacket; }, 'run' => function($raw, $n) {
+		for ($i = 0; $i < $n; $i++) {
+			$p = new IPv4ProtocolPacket($raw);
+			$p->getLength(); $p->getIdSequence(); $p->getOffset(); $p->getTTL();
+			$p->getProtocol(); $p->getChecksum(); $p->getSrcIP(); $p->getDstIP();
+		}
+	}),
+	'tcp.parse' => array('setup' => function() use ($tcpRaw) { return $tcpRaw; }, 'run' => function($raw, $n) {
+		for ($i = 0; $i < $n; $i++) {
+			$p = new TCPProtocolPacket($raw);
+			$p->getSrcPort(); $p->getDstPort(); $p->getIdSequence(); $p->getAckIdSequence();
+			$p->getFlags(); $p->getWindowSize(); $p->getChecksum(); $p->getData();
+		}
+	}),
+	'udp.parse' => array('setup' => function() use ($udpRaw) { return $udpRaw; }, 'run' => function($raw, $n) {
+		for ($i = 0; $i < $n; $i++) {
+			$p = new UDPProtocolPacket($raw);
+			$p->getSrcPort(); $p->getDstPort(); $p->getLength(); $p->getChecksum(); $p->getData();
+		}
+	}),
+	
+	//build: construct empty and set the header fields
+	'ipv4.build' => array('setup' => null, 'run' => function($s, $n) {
+		for ($i = 0; $i < $n; $i++) {
+			$p = new IPv4ProtocolPacket();
+			$p->setIdSequence($i); $p->setOffset(0); $p->setTTL(64); $p->setProtocol(PROT_UDP);
+			$p->setSrcIP('10.0.0.1'); $p->setDstIP('10.0.0.2');
+		}
+	}),
+	'tcp.build' => array('setup' => null, 'run' => function($s, $n) {
+		for ($i = 0; $i < $n; $i++) {
+			$p = new TCPProtocolPacket();
+			$p->setSrcPort(1000); $p->setDstPort(80); $p->setIdSequence($i); $p->setAckIdSequence(0);
+			$p->setFlags(ITCP::FLAG_SYN); $p->setWindowSize(1024); $p->setData('');
+		}
+	}),
+	'udp.build' => array('setup' => null, 'run' => function($s, $n) {
+		for ($i = 0; $i < $n; $i++) {
+			$p = new UDPProtocolPacket();
+			$p->setSrcPort(1000); $p->setDstPort(53); $p->setData('hello');
+		}
+	}),
+	
+	//the three checksum paths
+	'checksum.ipv4' => array('setup' => function() use ($tcpPacket) { return new IPv4ProtocolPacket($tcpPacket); }, 'run' => function($p, $n) {
+		for ($i = 0; $i < $n; $i++) $p->calculateChecksum();
+	}),
+	'checksum.tcp' => array('setup' => function() use ($tcpPacket, $tcpRaw) {
+		$ip = new IPv4ProtocolPacket($tcpPacket);
+		
+		return array(new TCPProtocolPacket($tcpRaw), new Memory(), $ip);
+	}, 'run' => function($s, $n) {
+		list($tcp, $memory, $ip) = $s;
+		$memory->addString($ip->getRawPacket());
+		
+		for ($i = 0; $i < $n; $i++) $tcp->calculateChecksum($memory);
+	}),
+	'checksum.udp' => array('setup' => function() use ($udpPacket, $udpRaw) {
+		$ip = new IPv4ProtocolPacket($udpPacket);
+		
+		return array(new UDPProtocolPacket($udpRaw), new Memory(), $ip);
+	}, 'run' => function($s, $n) {
+		list($udp, $memory, $ip) = $s;
+		$memory->addString($ip->getRawPacket());
+		
+		for ($i = 0; $i < $n; $i++) $udp->calculateChecksum($memory);
+	}),
+	
+	'ipv4.completePacket' => array('setup' => null, 'run' => function($s, $n) use ($buildTCP) {
+		for ($i = 0; $i < $n; $i++) {
+			$p = $buildTCP();
+			$p->completePacket();
+		}
+	}),
+	'ipv4.getDataObject' => array('setup' => function() use ($tcpPacket) { return $tcpPacket; }, 'run' => function($raw, $n) {
+		for ($i = 0; $i < $n; $i++) {
+			$p = new IPv4ProtocolPacket($raw);
+			$p->getDataObject();
+		}
+	}),
+);
@@ -0,0 +1,154 @@
+<?php
+
+/**
+ * Memory footprint of decoded packets
+ * 
+ * Measures the memory_get_usage() delta of holding N decoded IPv4ProtocolPacket
+ * objects with their TCP or UDP object, per payload size and backend, each in its
+ * own php process. The raw packets are created before the measurement starts, so
+ * the footprint is what decoding adds on top of the captured data.
+ * 
+ * php footprint.php [--count=10000] [--sizes=0,64,512,1460] [--backends=php,native]
+ *                   [--extension=path/prnlnative.so] [--budget=bytes] [--budget-per-byte=n]
+ *                   [--json=results.json]
+ * 
+ * With a budget every case must stay under budget + budget-per-byte * packet size
+ * bytes per packet, otherwise the exit code is 1. A case that fails (the children
+ * run without memory_limit) always makes the exit code 1.
+ */
+
+chdir(dirname(__FILE__)); //change working dir to the script dir
+
+//child: --child <backend> <protocol> <payload size> <count>
+if (isset($_SERVER['argv'][1]) && $_SERVER['argv'][1] == '--child') {
+	list(, , $backend, $protocol, $size, $count) = $_SERVER['argv'];
+	
+	define('__PRNL_NO_EXTERNAL_MODULES', $backend == 'php');
+	
+	require_once('../lib/lib.prnl.php');
+	
+	$headerSize = $protocol == PROT_TCP ? ITCP::HEADER_SIZE : IUDP::HEADER_SIZE;
+	$length = IIPv4::HEADER_SIZE + $headerSize + $size;
+	
+	//distinct strings, so nothing is shared between the packets
+	$raws = array();
+	for ($i = 0; $i < $count; $i++) {
+		$header = pack('CCnnnCCnNN', 0x45, 0, $length, $i & 0xFFFF, 0x4000, 64, $protocol, 0, ip2long('10.0.0.1'), ip2long('10.0.0.2'));
+		
+		if ($protocol == PROT_TCP)
+			$content = pack('nnNNCCnnn', 1000, 80, $i, 0, 0x50, 0x18, 1024, 0, 0);
+		else
+			$content = pack('nnnn', 1000, 53, $headerSize + $size, 0);
+		
+		$raws[] = $header . $content . str_repeat(chr($i & 0xFF), $size);
+	}
+	
+	if (function_exists('gc_collect_cycles'))
+		gc_collect_cycles();
+	
+	$before = memory_get_usage();
+	
+	$packets = array();
+	foreach ($raws as $raw) {
+		$packet = new IPv4ProtocolPacket($raw);
+		$packet->getDataObject();
+		$packets[] = $packet;
+	}
+	
+	if (function_exists('gc_collect_cycles'))
+		gc_collect_cycles();
+	
+	echo json_encode(array(
+		'bytes' => memory_get_usage() - $before,
+		'peak' => memory_get_peak_usage(),
+	)) . PHP_EOL;
+	
+	exit(0);
+}
+
+define('__PRNL_NO_EXTERNAL_MODULES', true);
+require_once('../lib/lib.prnl.php');
+
+$options = getopt('', array('count:', 'sizes:', 'backends:', 'extension:', 'budget:', 'budget-per-byte:', 'json:'));
+
+$count = isset($options['count']) ? max(1, (int)$options['count']) : 10000;
+$sizes = array_map('intval', explode(',', isset($options['sizes']) ? $options['sizes'] : '0,64,512,1460'));
+$backends = explode(',', isset($options['backends']) ? $options['backends'] : 'php,native');
+$budget = isset($options['budget']) ? (float)$options['budget'] : null;
+$budgetPerByte = isset($options['budget-per-byte']) ? (float)$options['budget-per-byte'] : 0;
+$php = defined('PHP_BINARY') && PHP_BINARY != '' ? PHP_BINARY : 'php';
+
+//the native packet classes are only registered with prnlnative.classes=1, without memory_limit
+//a case over it is measured against the budget instead of dying
+$flags = array('php' => '-d memory_limit=-1 -d prnlnative.classes=0', 'native' => '-d memory_limit=-1 -d prnlnative.classes=1');
+
+if (isset($options['extension'])) {
+	if (!is_file($options['extension']))
+		die('Extension ' . $options['extension'] . ' not found!' . PHP_EOL);
+	
+	$flags['native'] .= ' -d extension=' . escapeshellarg(realpath($options['extension']));
+}
+else if (in_array('native', $backends) && !extension_loaded('prnlnative')) {
+	echo 'prnl-native is not loaded, skipping the native backend' . PHP_EOL;
+	$backends = array_diff($backends, array('native'));
+}
+
+$protocols = array(PROT_TCP => 'tcp', PROT_UDP => 'udp');
+$results = array();
+$overBudget = array();
+
+printf("%-8s %-5s %8s %10s %14s %12s %12s\n", 'backend', 'prot', 'payload', 'wire', 'bytes/packet', 'per wire B', 'budget');
+
+foreach ($backends as $backend) {
+	foreach ($protocols as $protocol => $name) {
+		foreach ($sizes as $size) {
+			$cmd = $php . ' ' . $flags[$backend] . ' ' . escapeshellarg(__FILE__) . ' --child ' . $backend . ' ' . $protocol . ' ' . $size . ' ' . $count;
+			$output = trim(shell_exec($cmd . ' 2>&1'));
+			$result = json_decode($output, true);
+			
+			if (!is_array($result)) {
+				printf("%-8s %-5s %8u %10s\n", $backend, $name, $size, 'failed');
+				$overBudget[] = sprintf('%s %s payload %u: failed, %s', $backend, $name, $size, $output == '' ? 'no output' : strtok($output, "\n"));
+				continue;
+			}
+			
+			$wire = IIPv4::HEADER_SIZE + ($protocol == PROT_TCP ? ITCP::HEADER_SIZE : IUDP::HEADER_SIZE) + $size;
+			$perPacket = $result['bytes'] / $count;
+			$limit = $budget === null ? null : $budget + $budgetPerByte * $wire;
+			
+			$results[] = array(
+				'backend' => $backend,
+				'protocol' => $name,
+				'payload' => $size,
+				'wire' => $wire,
+				'bytes_per_packet' => $perPacket,
+				'peak' => $result['peak'],
+				'budget' => $limit,
+			);
+			
+			printf("%-8s %-5s %8u %10u %14.0f %12.1f %12s\n", $backend, $name, $size, $wire, $perPacket, $perPacket / $wire,
+				$limit === null ? '-' : sprintf('%.0f', $limit));
+			
+			if ($limit !== null && $perPacket > $limit)
+				$overBudget[] = sprintf('%s %s payload %u: %.0f bytes per packet, budget %.0f', $backend, $name, $size, $perPacket, $limit);
+		}
+	}
+}
+
+if (isset($options['json']))
+	file_put_contents($options['json'], json_encode(array(
+		'version' => PRNL_VERSION,
+		'php' => PHP_VERSION,
+		'time' => date('c'),
+		'count' => $count,
+		'results' => $results,
+	)));
+
+if (count($overBudget) > 0) {
+	printf("\n%u case(s) failed or over budget:\n", count($overBudget));
+	
+	foreach ($overBudget as $line)
+		printf("  %s\n", $line);
+	
+	exit(1);
+}
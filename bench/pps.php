@@ -0,0 +1,280 @@
+<?php
+
+/**
+ * End-to-end packets per second of RawIPNetwork on one box
+ * 
+ * A receiver (RawIPNetwork::readPacket) and a sender (sendPacket, or sendPackets
+ * for batches) run as separate processes, over loopback or over a veth pair
+ * into a network namespace (--veth, needs root). Every combination of packet
+ * size, batch size and backend is measured and reported as pps, bps, cpu time
+ * per packet on both sides and loss.
+ * 
+ * php pps.php [--veth] [--sizes=64,512,1500] [--batches=1,32] [--backends=php,native]
+ *             [--extension=path/prnlnative.so] [--duration=2] [--json=results.json]
+ * 
+ * The native backend needs --extension, or the extension loaded by php.ini.
+ */
+
+chdir(dirname(__FILE__)); //change working dir to the script dir
+
+define('BENCH_PORT', 9);
+define('BENCH_MAGIC', 'PRNLBNCH');
+define('BENCH_DONE', 'PRNLDONE');
+define('BENCH_NETNS', 'prnl-bench');
+
+//cpu time of this process in seconds
+function cpuTime() {
+	$usage = getrusage();
+	
+	return $usage['ru_utime.tv_sec'] + $usage['ru_utime.tv_usec'] / 1e6 + $usage['ru_stime.tv_sec'] + $usage['ru_stime.tv_usec'] / 1e6;
+}
+
+function benchPacket($src, $dst, $size, $payload) {
+	$udp = new UDPProtocolPacket();
+	$udp->setSrcPort(BENCH_PORT);
+	$udp->setDstPort(BENCH_PORT);
+	$udp->setData(str_pad($payload, max(strlen($payload), $size - IIPv4::HEADER_SIZE - IUDP::HEADER_SIZE), "\0"));
+	
+	$ip = new IPv4ProtocolPacket();
+	$ip->setProtocol(PROT_UDP);
+	$ip->setTTL(64);
+	$ip->setSrcIP($src);
+	$ip->setDstIP($dst);
+	$ip->setData($udp);
+	
+	return $ip;
+}
+
+//child processes: --receiver <backend> <timeout> or --sender <backend> <src> <dst> <size> <batch> <duration>
+if (isset($_SERVER['argv'][1]) && ($_SERVER['argv'][1] == '--receiver' || $_SERVER['argv'][1] == '--sender')) {
+	define('__PRNL_NO_EXTERNAL_MODULES', $_SERVER['argv'][2] == 'php');
+	
+	require_once('../lib/lib.prnl.php');
+	
+	$network = new RawIPNetwork();
+	$network->createIPSocket(PROT_IPv4, PROT_UDP);
+	
+	if ($_SERVER['argv'][1] == '--receiver') {
+		$timeout = (float)$_SERVER['argv'][3];
+		
+		try {
+			$network->setReceiveBuffer(32 * 1024 * 1024, true);
+		}
+		catch (Exception $e) {
+		}
+		
+		$network->setReceiveTimeout(0.1);
+		
+		echo 'ready' . PHP_EOL;
+		
+		$received = 0;
+		$bytes = 0;
+		$first = $last = null;
+		$sent = null;
+		$deadline = microtime(true) + $timeout;
+		$cpu = cpuTime();
+		
+		while ($sent === null && microtime(true) < $deadline) {
+			$packet = $network->readPacket();
+			
+			if (!$packet)
+				continue;
+			
+			$raw = $packet->getRawPacket();
+			$payload = IIPv4::HEADER_SIZE + IUDP::HEADER_SIZE;
+			
+			//only our own packets count, the raw socket sees all udp traffic
+			if ((ord($raw[IIPv4::HEADER_SIZE + 2]) << 8 | ord($raw[IIPv4::HEADER_SIZE + 3])) != BENCH_PORT)
+				continue;
+			
+			$marker = substr($raw, $payload, 8);
+			
+			if ($marker == BENCH_MAGIC) {
+				$last = microtime(true);
+				
+				if ($first === null)
+					$first = $last;
+				
+				$received++;
+				$bytes += strlen($raw);
+			}
+			else if ($marker == BENCH_DONE) {
+				$sent = (int)substr($raw, $payload + 8, 20);
+			}
+		}
+		
+		echo json_encode(array(
+			'received' => $received,
+			'bytes' => $bytes,
+			'time' => $first === null ? 0 : $last - $first,
+			'cpu' => cpuTime() - $cpu,
+			'done' => $sent !== null,
+		)) . PHP_EOL;
+	}
+	else {
+		list(, , , $src, $dst, $size, $batch, $duration) = $_SERVER['argv'];
+		
+		$network->setSendBuffer(32 * 1024 * 1024);
+		
+		$packet = benchPacket($src, $dst, (int)$size, BENCH_MAGIC);
+		$packets = array_fill(0, (int)$batch, $packet);
+		
+		$sent = 0;
+		$failed = 0;
+		$start = microtime(true);
+		$cpu = cpuTime();
+		
+		while (microtime(true) - $start < $duration) {
+			try {
+				if ($batch == 1) {
+					$network->sendPacket($packet);
+					$sent++;
+				}
+				else {
+					$sent += $network->sendPackets($packets);
+				}
+			}
+			catch (Exception $e) {
+				//a full send buffer, count it and carry on
+				$failed++;
+			}
+		}
+		
+		$time = microtime(true) - $start;
+		$cpu = cpuTime() - $cpu;
+		
+		//let the receiver drain, then tell it how many were sent
+		usleep(200000);
+		
+		for ($i = 0; $i < 3; $i++) {
+			$network->sendPacket(benchPacket($src, $dst, 0, BENCH_DONE . $sent));
+		}
+		
+		echo json_encode(array(
+			'sent' => $sent,
+			'failed' => $failed,
+			'time' => $time,
+			'cpu' => $cpu,
+		)) . PHP_EOL;
+	}
+	
+	exit(0);
+}
+
+define('__PRNL_NO_EXTERNAL_MODULES', true);
+require_once('../lib/lib.prnl.php');
+
+$options = getopt('', array('veth', 'sizes:', 'batches:', 'backends:', 'extension:', 'duration:', 'json:'));
+
+$sizes = array_map('intval', explode(',', isset($options['sizes']) ? $options['sizes'] : '64,512,1500'));
+$batches = array_map('intval', explode(',', isset($options['batches']) ? $options['batches'] : '1,32'));
+$backends = explode(',', isset($options['backends']) ? $options['backends'] : 'php,native');
+$duration = isset($options['duration']) ? (float)$options['duration'] : 2;
+$php = defined('PHP_BINARY') && PHP_BINARY != '' ? PHP_BINARY : 'php';
+
+//the native packet classes are only registered with prnlnative.classes=1
+$flags = array('php' => '-d prnlnative.classes=0', 'native' => '-d prnlnative.classes=1');
+
+if (isset($options['extension'])) {
+	if (!is_file($options['extension']))
+		die('Extension ' . $options['extension'] . ' not found!' . PHP_EOL);
+	
+	$flags['native'] .= ' -d extension=' . escapeshellarg(realpath($options['extension']));
+}
+else if (in_array('native', $backends) && !extension_loaded('prnlnative')) {
+	echo 'prnl-native is not loaded, skipping the native backend' . PHP_EOL;
+	$backends = array_diff($backends, array('native'));
+}
+
+if (isset($options['veth'])) {
+	//sender in this namespace on 10.201.0.1, receiver in BENCH_NETNS on 10.201.0.2
+	$setup = array(
+		'ip netns add ' . BENCH_NETNS,
+		'ip link add prnlb0 type veth peer name prnlb1',
+		'ip link set prnlb1 netns ' . BENCH_NETNS,
+		'ip addr add 10.201.0.1/30 dev prnlb0',
+		'ip link set prnlb0 up',
+		'ip netns exec ' . BENCH_NETNS . ' ip addr add 10.201.0.2/30 dev prnlb1',
+		'ip netns exec ' . BENCH_NETNS . ' ip link set prnlb1 up',
+		'ip netns exec ' . BENCH_NETNS . ' ip link set lo up',
+	);
+	
+	register_shutdown_function(function() {
+		exec('ip link del prnlb0 2>/dev/null');
+		exec('ip netns del ' . BENCH_NETNS . ' 2>/dev/null');
+	});
+	
+	foreach ($setup as $command) {
+		exec($command . ' 2>&1', $output, $status);
+		
+		if ($status != 0)
+			die('Failed to set up the veth pair: ' . $command . PHP_EOL . implode(PHP_EOL, $output) . PHP_EOL);
+	}
+	
+	$src = '10.201.0.1';
+	$dst = '10.201.0.2';
+	$receiverPrefix = 'ip netns exec ' . BENCH_NETNS . ' ';
+}
+else {
+	$src = $dst = '127.0.0.1';
+	$receiverPrefix = '';
+}
+
+$results = array();
+
+printf("%-8s %6s %6s %12s %12s %12s %12s %8s\n", 'backend', 'size', 'batch', 'pps', 'Mbps', 'tx ns/pkt', 'rx ns/pkt', 'loss');
+
+foreach ($backends as $backend) {
+	foreach ($sizes as $size) {
+		foreach ($batches as $batch) {
+			$base = $php . ' ' . $flags[$backend] . ' ' . escapeshellarg(__FILE__);
+			
+			$receiver = proc_open($receiverPrefix . $base . ' --receiver ' . $backend . ' ' . ($duration + 10),
+				array(1 => array('pipe', 'w')), $pipes);
+			
+			if (trim(fgets($pipes[1])) != 'ready')
+				die('The receiver failed to start!' . PHP_EOL);
+			
+			$tx = json_decode(trim(shell_exec($base . ' --sender ' . $backend . ' ' . $src . ' ' . $dst . ' ' . $size . ' ' . $batch . ' ' . $duration)), true);
+			$rx = json_decode(trim(fgets($pipes[1])), true);
+			
+			fclose($pipes[1]);
+			proc_close($receiver);
+			
+			if (!is_array($tx) || !is_array($rx)) {
+				printf("%-8s %6u %6u %12s\n", $backend, $size, $batch, 'failed');
+				continue;
+			}
+			
+			$result = array(
+				'backend' => $backend,
+				'size' => $size,
+				'batch' => $batch,
+				'sent' => $tx['sent'],
+				'received' => $rx['received'],
+				'send_failures' => $tx['failed'],
+				'pps' => $rx['time'] > 0 ? $rx['received'] / $rx['time'] : 0,
+				'bps' => $rx['time'] > 0 ? $rx['bytes'] * 8 / $rx['time'] : 0,
+				'tx_pps' => $tx['sent'] / $tx['time'],
+				'tx_cpu_ns' => $tx['sent'] > 0 ? $tx['cpu'] * 1e9 / $tx['sent'] : 0,
+				'rx_cpu_ns' => $rx['received'] > 0 ? $rx['cpu'] * 1e9 / $rx['received'] : 0,
+				'loss' => $tx['sent'] > 0 ? max(0, $tx['sent'] - $rx['received']) / $tx['sent'] : 0,
+			);
+			
+			$results[] = $result;
+			
+			printf("%-8s %6u %6u %12.0f %12.1f %12.0f %12.0f %7.2f%%\n", $backend, $size, $batch, $result['pps'], $result['bps'] / 1e6,
+				$result['tx_cpu_ns'], $result['rx_cpu_ns'], $result['loss'] * 100);
+		}
+	}
+}
+
+if (isset($options['json']))
+	file_put_contents($options['json'], json_encode(array(
+		'version' => PRNL_VERSION,
+		'php' => PHP_VERSION,
+		'time' => date('c'),
+		'link' => isset($options['veth']) ? 'veth' : 'loopback',
+		'duration' => $duration,
+		'results' => $results,
+	)));
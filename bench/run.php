@@ -0,0 +1,163 @@
+<?php
+
+/**
+ * Microbenchmark runner for the hot primitives in bench/cases.php
+ * 
+ * Every case runs in a separate php process, once with the pure PHP classes and once
+ * with the native extension (when given), so both backends are measured side by side
+ * and the peak memory of a case isn't polluted by the other cases.
+ * 
+ * php run.php [--filter=memory.] [--extension=path/prnlnative.so] [--json=results.json]
+ *             [--baseline=baseline.json] [--threshold=10] [--save-baseline=baseline.json]
+ * 
+ * Exits with 1 when a case fails or is more than threshold percent slower than the baseline.
+ */
+
+chdir(dirname(__FILE__)); //change working dir to the script dir
+
+//child: run a single case and report it as one json line
+if (isset($_SERVER['argv'][1]) && $_SERVER['argv'][1] == '--child') {
+	define('__PRNL_NO_EXTERNAL_MODULES', $_SERVER['argv'][3] == 'php');
+	
+	require_once('../lib/lib.prnl.php');
+	
+	$cases = require('cases.php');
+	$case = $cases[$_SERVER['argv'][2]];
+	$minTime = (float)$_SERVER['argv'][4];
+	
+	$now = function_exists('hrtime')
+		? function() { return hrtime(true) / 1e9; }
+		: function() { return microtime(true); };
+	
+	//calibrate: double the iterations until a run takes at least the minimum time
+	$n = 100;
+	
+	while (true) {
+		$state = $case['setup'] ? call_user_func($case['setup']) : null;
+		$start = $now();
+		call_user_func($case['run'], $state, $n);
+		$time = $now() - $start;
+		
+		if ($time >= $minTime || $n >= 100000000)
+			break;
+		
+		$n = $time > 0 ? max($n * 2, (int)($n * $minTime / $time * 1.1)) : $n * 10;
+		unset($state);
+	}
+	
+	echo json_encode(array(
+		'iterations' => $n,
+		'ops_per_sec' => $n / $time,
+		'ns_per_op' => $time * 1e9 / $n,
+		'peak_memory' => memory_get_peak_usage(),
+	)) . PHP_EOL;
+	
+	exit(0);
+}
+
+$options = getopt('', array('filter:', 'extension:', 'json:', 'baseline:', 'threshold:', 'save-baseline:', 'time:'));
+
+$filter = isset($options['filter']) ? $options['filter'] : '';
+$threshold = isset($options['threshold']) ? (float)$options['threshold'] : 10;
+$minTime = isset($options['time']) ? (float)$options['time'] : 0.5;
+$php = defined('PHP_BINARY') && PHP_BINARY != '' ? PHP_BINARY : 'php';
+
+$modes = array('php' => '-n');
+
+if (isset($options['extension'])) {
+	if (!is_file($options['extension']))
+		die('Extension ' . $options['extension'] . ' not found!' . PHP_EOL);
+	
+	//-n skips php.ini, a shared sockets build (prnlnative depends on it) has to be loaded by hand
+	$sockets = ini_get('extension_dir') . DIRECTORY_SEPARATOR . 'sockets.' . PHP_SHLIB_SUFFIX;
+	
+	$modes['native'] = '-n' . (is_file($sockets) ? ' -d extension=' . escapeshellarg($sockets) : '')
+		. ' -d extension=' . escapeshellarg(realpath($options['extension'])) . ' -d prnlnative.classes=1';
+}
+
+$baseline = array();
+
+if (isset($options['baseline'])) {
+	$baseline = json_decode(file_get_contents($options['baseline']), true);
+	
+	if (!is_array($baseline))
+		die('Baseline ' . $options['baseline'] . ' is not valid json!' . PHP_EOL);
+	
+	$baseline = $baseline['results'];
+}
+
+//only the case names are needed here, the cases run in the children
+define('__PRNL_NO_EXTERNAL_MODULES', true);
+require_once('../lib/lib.prnl.php');
+$names = array_keys(require('cases.php'));
+
+$results = array();
+$regressions = array();
+$failures = array();
+
+printf("%-24s", 'case');
+foreach ($modes as $mode => $flags)
+	printf(" %14s %10s %10s", $mode . ' ops/s', 'ns/op', 'peak KB');
+printf("\n");
+
+foreach ($names as $name) {
+	if ($filter != '' && strpos($name, $filter) === false)
+		continue;
+	
+	printf("%-24s", $name);
+	
+	foreach ($modes as $mode => $flags) {
+		$cmd = $php . ' ' . $flags . ' ' . escapeshellarg(__FILE__) . ' --child ' . escapeshellarg($name) . ' ' . $mode . ' ' . $minTime;
+		$output = trim(shell_exec($cmd . ' 2>&1'));
+		$result = json_decode($output, true);
+		
+		if (!is_array($result)) {
+			printf(" %36s", 'failed');
+			$failures[] = sprintf('%s (%s): %s', $name, $mode, $output == '' ? 'no output' : strtok($output, "\n"));
+			continue;
+		}
+		
+		$results[$name][$mode] = $result;
+		printf(" %14.0f %10.1f %10.1f", $result['ops_per_sec'], $result['ns_per_op'], $result['peak_memory'] / 1024);
+		
+		if (isset($baseline[$name][$mode])) {
+			$change = ($result['ns_per_op'] / $baseline[$name][$mode]['ns_per_op'] - 1) * 100;
+			
+			if ($change > $threshold)
+				$regressions[] = sprintf('%s (%s): %.1f ns/op -> %.1f ns/op (+%.1f%%)', $name, $mode,
+					$baseline[$name][$mode]['ns_per_op'], $result['ns_per_op'], $change);
+		}
+	}
+	
+	printf("\n");
+}
+
+$report = array(
+	'version' => PRNL_VERSION,
+	'php' => PHP_VERSION,
+	'time' => date('c'),
+	'results' => $results,
+);
+
+if (isset($options['json']))
+	file_put_contents($options['json'], json_encode($report));
+
+if (isset($options['save-baseline']))
+	file_put_contents($options['save-baseline'], json_encode($report));
+
+if (count($failures) > 0) {
+	printf("\n%u case(s) failed:\n", count($failures));
+	
+	foreach ($failures as $failure)
+		printf("  %s\n", $failure);
+}
+
+if (count($regressions) > 0) {
+	printf("\n%u regression(s) over %.1f%%:\n", count($regressions), $threshold);
+	
+	foreach ($regressions as $regression)
+		printf("  %s\n", $regression);
+}
+
+if (count($failures) > 0 || count($regressions) > 0)
+	exit(1);
@@ -0,0 +1,24 @@
+<?php
+
+chdir(dirname(__FILE__)); //change working dir to the script dir
+
+require_once('../lib/lib.prnl.php');
+
+if ($_SERVER["argc"] < 2)
+	die('php '.$_SERVER['argv'][0].' <workers> [interface]'.PHP_EOL);
+
+$workers = (int)$_SERVER['argv'][1];
+$interface = isset($_SERVER['argv'][2]) ? $_SERVER['argv'][2] : null;
+
+function handlePacket(IPv4ProtocolPacket $packet, $workerId) {
+	printf("[%u] %s -> %s P:%u L:%u\n", $workerId, $packet->getSrcIP(), $packet->getDstIP(), $packet->getProtocol(), $packet->getLength());
+}
+
+$supervisor = new CaptureSupervisor($workers, RawNetwork::FANOUT_HASH, $interface);	// Flows stay on one worker
+$counters = $supervisor->run('handlePacket');										// Capture until ctrl+c
+
+foreach ($counters['workers'] as $workerId => $worker) {
+	printf("worker %u: %u packets, %u bytes, %u errors\n", $workerId, $worker['packets'], $worker['bytes'], $worker['errors']);
+}
+
+printf("total: %u packets, %u bytes, %u errors\n", $counters['packets'], $counters['bytes'], $counters['errors']);
@@ -0,0 +1,8 @@
+PHP_ARG_ENABLE(prnl-native, whether to enable PRNL Native support,
+[ --disable-prnl-native   Disable PRNL Native support])
+
+if test "$PHP_PRNL_NATIVE" != "no"; then
+  AC_DEFINE(HAVE_PRNLNATIVE, 1, [whether to enable PRNL Native support])
+  PHP_NEW_EXTENSION(prnlnative, prnl_native.c prnl_send.c prnl_packet.c prnl_ring.c prnl_stats.c prnl_recv.c prnl_flow.c prnl_timer.c prnl_segment.c prnl_decode.c prnl_classes.c prnl_profile.c, $ext_shared)
+  PHP_ADD_EXTENSION_DEP(prnlnative, sockets)
+fi
@@ -0,0 +1,125 @@
+/*
+ * PRNL Native Extension
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PHP_PRNL_NATIVE_H
+#define PHP_PRNL_NATIVE_H
+
+#include <stdint.h>
+
+#include "ext/sockets/php_sockets.h"
+
+#define PHP_PRNL_NATIVE_VERSION "0.1-dev"
+#define PHP_PRNL_NATIVE_EXTNAME "prnlnative"
+
+//max number of messages handed to the kernel in one sendmmsg/recvmmsg call
+#define PRNL_BATCH_SIZE 256
+
+//src (4), dst (4), src port (2), dst port (2), protocol (1), same as FlowTable::makeKey
+#define PRNL_FLOW_KEY_SIZE 13
+
+//reasons a flow leaves the flow table, same as FlowTable::EXPIRE_*
+#define PRNL_FLOW_IDLE    1
+#define PRNL_FLOW_ACTIVE  2
+#define PRNL_FLOW_EVICTED 3
+
+//columns of prnl_decode_batch, bit i of the fields selects column i, same as BatchDecoder::*
+#define PRNL_DECODE_COLUMNS 8
+
+extern zend_module_entry prnlnative_module_entry;
+#define phpext_prnlnative_ptr &prnlnative_module_entry
+
+//prnl_native.c
+php_socket *prnl_fetch_socket(zval *zsocket TSRMLS_DC);
+
+PHP_FUNCTION(prnl_clock_gettime);
+
+//prnl_send.c
+PHP_FUNCTION(prnl_socket_set_txtime);
+PHP_FUNCTION(prnl_sendmmsg);
+
+//prnl_packet.c
+PHP_FUNCTION(prnl_packet_socket);
+PHP_FUNCTION(prnl_packet_fanout);
+
+//prnl_ring.c
+int prnl_ring_minit(int module_number TSRMLS_DC);
+
+PHP_FUNCTION(prnl_ring_open);
+PHP_FUNCTION(prnl_ring_push);
+PHP_FUNCTION(prnl_ring_push_batch);
+PHP_FUNCTION(prnl_ring_pop);
+PHP_FUNCTION(prnl_ring_stats);
+PHP_FUNCTION(prnl_ring_close);
+
+//prnl_stats.c
+PHP_FUNCTION(prnl_socket_stats);
+
+//prnl_recv.c
+int prnl_recv_mshutdown(int module_number TSRMLS_DC);
+
+PHP_FUNCTION(prnl_recvmsg);
+PHP_FUNCTION(prnl_recvmmsg);
+
+//prnl_flow.c
+int prnl_flow_minit(int module_number TSRMLS_DC);
+
+PHP_FUNCTION(prnl_flow_table_create);
+PHP_FUNCTION(prnl_flow_update);
+PHP_FUNCTION(prnl_flow_get);
+PHP_FUNCTION(prnl_flow_remove);
+PHP_FUNCTION(prnl_flow_expire);
+PHP_FUNCTION(prnl_flow_export);
+PHP_FUNCTION(prnl_flow_table_info);
+
+//prnl_timer.c
+int prnl_timer_minit(int module_number TSRMLS_DC);
+
+PHP_FUNCTION(prnl_timer_wheel_create);
+PHP_FUNCTION(prnl_timer_add);
+PHP_FUNCTION(prnl_timer_cancel);
+PHP_FUNCTION(prnl_timer_reschedule);
+PHP_FUNCTION(prnl_timer_advance);
+PHP_FUNCTION(prnl_timer_info);
+
+//prnl_segment.c
+uint32_t prnl_csum_partial(const unsigned char *data, size_t length, uint32_t sum);
+uint16_t prnl_csum_finish(uint32_t sum);
+int prnl_gso_segment_ex(zval *result, const unsigned char *packet, size_t packet_len, long mss TSRMLS_DC);
+int prnl_ip_fragment_ex(zval *result, const unsigned char *packet, size_t packet_len, long mtu TSRMLS_DC);
+
+PHP_FUNCTION(prnl_gso_segment);
+PHP_FUNCTION(prnl_ip_fragment);
+PHP_FUNCTION(prnl_checksum);
+
+//prnl_decode.c
+PHP_FUNCTION(prnl_decode_batch);
+
+//prnl_classes.c
+int prnl_classes_minit(int module_number TSRMLS_DC);
+
+//prnl_profile.c
+int prnl_profile_minit(int module_number TSRMLS_DC);
+int prnl_profile_mshutdown(int module_number TSRMLS_DC);
+int prnl_profile_rinit(TSRMLS_D);
+
+PHP_FUNCTION(prnl_profile_dump);
+
+#endif
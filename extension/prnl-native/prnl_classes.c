@@ -0,0 +1,1198 @@
+/*
+ * PRNL Native Extension - packet classes
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "php.h"
+#include "zend_interfaces.h"
+#include "zend_exceptions.h"
+#include "php_prnl_native.h"
+
+#define PRNL_IPV4_HEADER 20
+#define PRNL_TCP_HEADER  20
+#define PRNL_UDP_HEADER  8
+
+/*
+ * Native RawPacket, IPv4ProtocolPacket, TCPProtocolPacket and
+ * UDPProtocolPacket with the same methods as the PHP classes, over a plain
+ * byte buffer instead of a Memory object. Protocol classes written in PHP
+ * that extend RawPacket directly keep working on $this->_buffer: for them
+ * the RawPacket methods use the Memory object.
+ */
+typedef struct _prnl_packet_object {
+	zend_object std;
+	unsigned char *buffer;
+	size_t length;
+	size_t size;
+	zval *info;       // receive info
+	zval *data;       // content packet of a IPv4 packet
+	zval *header;     // content packet in header only mode
+	zend_bool memory; // PHP subclass working on $this->_buffer
+} prnl_packet_object;
+
+static zend_class_entry *prnl_ce_completeable;
+static zend_class_entry *prnl_ce_raw_packet;
+static zend_class_entry *prnl_ce_ipv4;
+static zend_class_entry *prnl_ce_tcp;
+static zend_class_entry *prnl_ce_udp;
+
+static zend_object_handlers prnl_packet_handlers;
+
+#define PRNL_THIS() ((prnl_packet_object *) zend_object_store_get_object(getThis() TSRMLS_CC))
+
+/* {{{ buffer */
+static void prnl_packet_resize(prnl_packet_object *obj, size_t length)
+{
+	size_t size;
+
+	if (length > obj->size) {
+		for (size = obj->size ? obj->size : 64; size < length; size *= 2);
+
+		obj->buffer = erealloc(obj->buffer, size);
+		obj->size = size;
+	}
+
+	if (length > obj->length) {
+		memset(obj->buffer + obj->length, 0, length - obj->length);
+	}
+
+	obj->length = length;
+}
+
+//replace everything from offset on with data, like Memory::setMemorySize + addString
+static void prnl_packet_set(prnl_packet_object *obj, size_t offset, const char *data, size_t length)
+{
+	prnl_packet_resize(obj, offset);
+	prnl_packet_resize(obj, offset + length);
+
+	if (length > 0) {
+		memcpy(obj->buffer + offset, data, length);
+	}
+}
+
+static long prnl_packet_get(prnl_packet_object *obj, size_t offset, int bytes)
+{
+	long value = 0;
+	int i;
+
+	for (i = 0; i < bytes; i++) {
+		value <<= 8;
+
+		if (offset + i < obj->length) {
+			value |= obj->buffer[offset + i];
+		}
+	}
+
+	return value;
+}
+
+static void prnl_packet_put(prnl_packet_object *obj, size_t offset, int bytes, long value)
+{
+	int i;
+
+	if (offset + bytes > obj->length) {
+		prnl_packet_resize(obj, offset + bytes);
+	}
+
+	for (i = bytes - 1; i >= 0; i--) {
+		obj->buffer[offset + i] = value & 0xFF;
+		value >>= 8;
+	}
+}
+
+static void prnl_packet_return(prnl_packet_object *obj, size_t offset, zval *return_value)
+{
+	if (offset >= obj->length) {
+		RETURN_EMPTY_STRING();
+	}
+
+	RETURN_STRINGL((char *) obj->buffer + offset, obj->length - offset, 1);
+}
+/* }}} */
+
+/* {{{ object handlers */
+static void prnl_packet_free(void *object TSRMLS_DC)
+{
+	prnl_packet_object *obj = (prnl_packet_object *) object;
+
+	zend_object_std_dtor(&obj->std TSRMLS_CC);
+
+	if (obj->buffer) {
+		efree(obj->buffer);
+	}
+	if (obj->info) {
+		zval_ptr_dtor(&obj->info);
+	}
+	if (obj->data) {
+		zval_ptr_dtor(&obj->data);
+	}
+	if (obj->header) {
+		zval_ptr_dtor(&obj->header);
+	}
+
+	efree(obj);
+}
+
+static zend_object_value prnl_packet_new_ex(zend_class_entry *ce, prnl_packet_object **ptr TSRMLS_DC)
+{
+	zend_object_value retval;
+	prnl_packet_object *obj;
+	zend_class_entry *base;
+	zval *tmp;
+
+	obj = ecalloc(1, sizeof(prnl_packet_object));
+	zend_object_std_init(&obj->std, ce TSRMLS_CC);
+	zend_hash_copy(obj->std.properties, &ce->default_properties, (copy_ctor_func_t) zval_add_ref, (void *) &tmp, sizeof(zval *));
+
+	for (base = ce; base->type != ZEND_INTERNAL_CLASS; base = base->parent);
+	obj->memory = (ce != base && base == prnl_ce_raw_packet);
+
+	retval.handle = zend_objects_store_put(obj, (zend_objects_store_dtor_t) zend_objects_destroy_object, prnl_packet_free, NULL TSRMLS_CC);
+	retval.handlers = &prnl_packet_handlers;
+
+	if (ptr) {
+		*ptr = obj;
+	}
+
+	return retval;
+}
+
+static zend_object_value prnl_packet_new(zend_class_entry *ce TSRMLS_DC)
+{
+	return prnl_packet_new_ex(ce, NULL TSRMLS_CC);
+}
+
+static zend_object_value prnl_packet_clone(zval *this_ptr TSRMLS_DC)
+{
+	prnl_packet_object *old = (prnl_packet_object *) zend_object_store_get_object(this_ptr TSRMLS_CC);
+	prnl_packet_object *new;
+	zend_object_value retval;
+
+	retval = prnl_packet_new_ex(old->std.ce, &new TSRMLS_CC);
+	zend_objects_clone_members(&new->std, retval, &old->std, Z_OBJ_HANDLE_P(this_ptr) TSRMLS_CC);
+
+	prnl_packet_set(new, 0, (char *) old->buffer, old->length);
+
+	//shallow, like cloning the PHP classes
+	if (old->info) {
+		new->info = old->info;
+		Z_ADDREF_P(new->info);
+	}
+	if (old->data) {
+		new->data = old->data;
+		Z_ADDREF_P(new->data);
+	}
+	if (old->header) {
+		new->header = old->header;
+		Z_ADDREF_P(new->header);
+	}
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ helpers */
+static zend_bool prnl_is_native(zval *zpacket TSRMLS_DC)
+{
+	return Z_TYPE_P(zpacket) == IS_OBJECT && Z_OBJ_HT_P(zpacket) == &prnl_packet_handlers
+		&& !((prnl_packet_object *) zend_object_store_get_object(zpacket TSRMLS_CC))->memory;
+}
+
+/*
+ * Raw bytes of any RawPacket, *copy is set (and has to be destroyed) when
+ * getRawPacket() had to be called
+ */
+static void prnl_packet_bytes(zval *zpacket, zval **copy, char **data, int *length TSRMLS_DC)
+{
+	prnl_packet_object *obj;
+
+	*copy = NULL;
+
+	if (prnl_is_native(zpacket TSRMLS_CC)) {
+		obj = (prnl_packet_object *) zend_object_store_get_object(zpacket TSRMLS_CC);
+		*data = obj->length ? (char *) obj->buffer : "";
+		*length = obj->length;
+		return;
+	}
+
+	zend_call_method_with_0_params(&zpacket, NULL, NULL, "getrawpacket", copy);
+
+	if (*copy && Z_TYPE_PP(copy) == IS_STRING) {
+		*data = Z_STRVAL_PP(copy);
+		*length = Z_STRLEN_PP(copy);
+	}
+	else {
+		*data = "";
+		*length = 0;
+	}
+}
+
+//call a method of the Memory object in $this->_buffer
+static void prnl_memory_call(zval *this_ptr, const char *method, int method_len, zval *arg, zval *return_value TSRMLS_DC)
+{
+	zval *zmemory, *retval = NULL;
+
+	zmemory = zend_read_property(prnl_ce_raw_packet, this_ptr, "_buffer", sizeof("_buffer") - 1, 1 TSRMLS_CC);
+
+	if (Z_TYPE_P(zmemory) != IS_OBJECT) {
+		zend_throw_exception(zend_exception_get_default(TSRMLS_C), "Packet buffer not initialized!", 0 TSRMLS_CC);
+		return;
+	}
+
+	zend_call_method(&zmemory, NULL, NULL, (char *) method, method_len, &retval, arg ? 1 : 0, arg, NULL TSRMLS_CC);
+
+	if (retval) {
+		if (return_value) {
+			RETVAL_ZVAL(retval, 1, 1);
+		}
+		else {
+			zval_ptr_dtor(&retval);
+		}
+	}
+}
+
+//LiveCounters::count(LiveCounters::<counter>) when the counters are enabled
+static void prnl_live_count(const char *counter, int counter_len TSRMLS_DC)
+{
+	zend_class_entry **pce;
+	zval *enabled, **value;
+
+	if (zend_lookup_class("LiveCounters", sizeof("LiveCounters") - 1, &pce TSRMLS_CC) == FAILURE) {
+		return;
+	}
+
+	enabled = zend_read_static_property(*pce, "enabled", sizeof("enabled") - 1, 1 TSRMLS_CC);
+	if (!enabled || !zend_is_true(enabled)) {
+		return;
+	}
+
+	if (zend_hash_find(&(*pce)->constants_table, (char *) counter, counter_len + 1, (void **) &value) == SUCCESS) {
+		zend_call_method_with_1_params(NULL, *pce, NULL, "count", NULL, *value);
+	}
+}
+
+static void prnl_packet_init(prnl_packet_object *obj, size_t header, const char *data, int length TSRMLS_DC)
+{
+	prnl_packet_resize(obj, 0);
+	prnl_packet_resize(obj, header);
+
+	if (length > 0) {
+		if ((size_t) length < header) {
+			prnl_live_count("DECODE_ERRORS", sizeof("DECODE_ERRORS") - 1 TSRMLS_CC);
+		}
+
+		prnl_packet_set(obj, 0, data, length);
+	}
+}
+
+static void prnl_tcp_init(prnl_packet_object *obj, const char *data, int length TSRMLS_DC)
+{
+	prnl_packet_init(obj, PRNL_TCP_HEADER, data, length TSRMLS_CC);
+
+	//like the PHP class, the segment offset is always set
+	prnl_packet_put(obj, 12, 1, 0x05 << 4);
+}
+
+static zval *prnl_create_packet(zend_class_entry *ce, size_t header, const char *data, int length TSRMLS_DC)
+{
+	zval *zpacket;
+	prnl_packet_object *obj;
+
+	MAKE_STD_ZVAL(zpacket);
+	object_init_ex(zpacket, ce);
+	obj = (prnl_packet_object *) zend_object_store_get_object(zpacket TSRMLS_CC);
+
+	if (ce == prnl_ce_tcp) {
+		prnl_tcp_init(obj, data, length TSRMLS_CC);
+	}
+	else if (ce == prnl_ce_raw_packet) {
+		prnl_packet_set(obj, 0, data, length);
+	}
+	else {
+		prnl_packet_init(obj, header, data, length TSRMLS_CC);
+	}
+
+	return zpacket;
+}
+
+/*
+ * Checksum of a TCP or UDP packet, ip is the IPv4 header for the pseudo header.
+ * TCP sums the whole packet, UDP the number of bytes in its length field.
+ */
+static void prnl_transport_checksum(prnl_packet_object *obj, int protocol, const unsigned char *ip, size_t ip_length TSRMLS_DC)
+{
+	uint32_t sum;
+	size_t length;
+	unsigned char pseudo[8];
+
+	memset(pseudo, 0, sizeof(pseudo));
+	if (ip_length > 12) {
+		memcpy(pseudo, ip + 12, ip_length >= 20 ? 8 : ip_length - 12);
+	}
+
+	length = protocol == IPPROTO_TCP ? obj->length : (size_t) prnl_packet_get(obj, 4, 2);
+
+	sum = prnl_csum_partial(pseudo, 8, protocol + length);
+	sum = prnl_csum_partial(obj->buffer, length < obj->length ? length : obj->length, sum);
+
+	prnl_packet_put(obj, protocol == IPPROTO_TCP ? 16 : 6, 2, prnl_csum_finish(sum));
+
+	prnl_live_count("CHECKSUMS", sizeof("CHECKSUMS") - 1 TSRMLS_CC);
+}
+
+static void prnl_transport_complete(prnl_packet_object *obj, int protocol, const unsigned char *ip, size_t ip_length TSRMLS_DC)
+{
+	if (protocol == IPPROTO_UDP && prnl_packet_get(obj, 4, 2) == 0) {
+		prnl_packet_put(obj, 4, 2, obj->length);
+	}
+
+	if (prnl_packet_get(obj, protocol == IPPROTO_TCP ? 16 : 6, 2) == 0) {
+		prnl_transport_checksum(obj, protocol, ip, ip_length TSRMLS_CC);
+	}
+}
+
+//the IP packet passed to calculateChecksum/completePacket: Memory, IPv4ProtocolPacket or string
+static void prnl_transport_parent(zval *zparent, zval **copy, char **data, int *length TSRMLS_DC)
+{
+	*copy = NULL;
+
+	if (Z_TYPE_P(zparent) == IS_STRING) {
+		*data = Z_STRVAL_P(zparent);
+		*length = Z_STRLEN_P(zparent);
+	}
+	else if (Z_TYPE_P(zparent) == IS_OBJECT && instanceof_function(Z_OBJCE_P(zparent), prnl_ce_raw_packet TSRMLS_CC)) {
+		prnl_packet_bytes(zparent, copy, data, length TSRMLS_CC);
+	}
+	else if (Z_TYPE_P(zparent) == IS_OBJECT) {
+		zend_call_method_with_0_params(&zparent, NULL, NULL, "getmemory", copy);
+
+		if (*copy && Z_TYPE_PP(copy) == IS_STRING) {
+			*data = Z_STRVAL_PP(copy);
+			*length = Z_STRLEN_PP(copy);
+			return;
+		}
+
+		*data = "";
+		*length = 0;
+	}
+	else {
+		*data = "";
+		*length = 0;
+	}
+}
+/* }}} */
+
+/* {{{ RawPacket */
+PHP_METHOD(RawPacket, __construct)
+{
+	long size = 0;
+	prnl_packet_object *obj = PRNL_THIS();
+	zend_class_entry **pce;
+	zval *zmemory, *zsize;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|l", &size) == FAILURE) {
+		return;
+	}
+
+	if (!obj->memory) {
+		prnl_packet_resize(obj, 0);
+		prnl_packet_resize(obj, size > 0 ? size : 0);
+		return;
+	}
+
+	if (zend_lookup_class("Memory", sizeof("Memory") - 1, &pce TSRMLS_CC) == FAILURE) {
+		zend_throw_exception(zend_exception_get_default(TSRMLS_C), "Memory class not loaded!", 0 TSRMLS_CC);
+		return;
+	}
+
+	MAKE_STD_ZVAL(zmemory);
+	object_init_ex(zmemory, *pce);
+
+	MAKE_STD_ZVAL(zsize);
+	ZVAL_LONG(zsize, size);
+	zend_call_method_with_1_params(&zmemory, *pce, &(*pce)->constructor, "__construct", NULL, zsize);
+	zval_ptr_dtor(&zsize);
+
+	zend_update_property(prnl_ce_raw_packet, getThis(), "_buffer", sizeof("_buffer") - 1, zmemory TSRMLS_CC);
+	zval_ptr_dtor(&zmemory);
+}
+
+PHP_METHOD(RawPacket, getRawPacket)
+{
+	prnl_packet_object *obj = PRNL_THIS();
+
+	if (obj->memory) {
+		prnl_memory_call(getThis(), "getmemory", sizeof("getmemory") - 1, NULL, return_value TSRMLS_CC);
+		return;
+	}
+
+	prnl_packet_return(obj, 0, return_value);
+}
+
+PHP_METHOD(RawPacket, setRawPacket)
+{
+	zval *zdata;
+	prnl_packet_object *obj = PRNL_THIS();
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &zdata) == FAILURE) {
+		return;
+	}
+
+	convert_to_string(zdata);
+
+	if (obj->memory) {
+		prnl_memory_call(getThis(), "resetmemory", sizeof("resetmemory") - 1, NULL, NULL TSRMLS_CC);
+		prnl_memory_call(getThis(), "addstring", sizeof("addstring") - 1, zdata, NULL TSRMLS_CC);
+		return;
+	}
+
+	prnl_packet_set(obj, 0, Z_STRVAL_P(zdata), Z_STRLEN_P(zdata));
+}
+
+PHP_METHOD(RawPacket, getPacketLength)
+{
+	prnl_packet_object *obj = PRNL_THIS();
+
+	if (obj->memory) {
+		prnl_memory_call(getThis(), "getmemorylength", sizeof("getmemorylength") - 1, NULL, return_value TSRMLS_CC);
+		return;
+	}
+
+	RETURN_LONG((long) obj->length);
+}
+
+PHP_METHOD(RawPacket, getReceiveInfo)
+{
+	char *name = NULL;
+	int name_len = 0;
+	zval **value;
+	prnl_packet_object *obj = PRNL_THIS();
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|s!", &name, &name_len) == FAILURE) {
+		return;
+	}
+
+	if (name == NULL) {
+		if (obj->info) {
+			RETURN_ZVAL(obj->info, 1, 0);
+		}
+
+		array_init(return_value);
+		return;
+	}
+
+	if (obj->info && zend_symtable_find(Z_ARRVAL_P(obj->info), name, name_len + 1, (void **) &value) == SUCCESS) {
+		RETURN_ZVAL(*value, 1, 0);
+	}
+
+	RETURN_NULL();
+}
+
+PHP_METHOD(RawPacket, setReceiveInfo)
+{
+	zval *zinfo;
+	prnl_packet_object *obj = PRNL_THIS();
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &zinfo) == FAILURE) {
+		return;
+	}
+
+	if (obj->info) {
+		zval_ptr_dtor(&obj->info);
+	}
+
+	MAKE_STD_ZVAL(obj->info);
+	*obj->info = *zinfo;
+	zval_copy_ctor(obj->info);
+	INIT_PZVAL(obj->info);
+}
+
+PHP_METHOD(RawPacket, dumpPacket)
+{
+	prnl_packet_object *obj = PRNL_THIS();
+	size_t i;
+
+	if (obj->memory) {
+		prnl_memory_call(getThis(), "dumpmemory", sizeof("dumpmemory") - 1, NULL, NULL TSRMLS_CC);
+		return;
+	}
+
+	for (i = 0; i < obj->length; i++) {
+		php_printf("%02X ", obj->buffer[i]);
+
+		if (((i + 1) % 50) == 0) {
+			php_printf("\n");
+		}
+	}
+
+	if (((i + 1) % 50) != 0) {
+		php_printf("\n");
+	}
+}
+/* }}} */
+
+/* {{{ IPv4ProtocolPacket */
+#define PRNL_FIELD_GETTER(cls, name, offset, bytes) \
+	PHP_METHOD(cls, name) \
+	{ \
+		RETURN_LONG(prnl_packet_get(PRNL_THIS(), offset, bytes)); \
+	}
+
+#define PRNL_FIELD_SETTER(cls, name, offset, bytes) \
+	PHP_METHOD(cls, name) \
+	{ \
+		long value; \
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &value) == FAILURE) { \
+			return; \
+		} \
+		prnl_packet_put(PRNL_THIS(), offset, bytes, value); \
+	}
+
+PHP_METHOD(IPv4ProtocolPacket, __construct)
+{
+	char *data = "";
+	int length = 0;
+	prnl_packet_object *obj = PRNL_THIS();
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|s", &data, &length) == FAILURE) {
+		return;
+	}
+
+	prnl_packet_init(obj, PRNL_IPV4_HEADER, data, length TSRMLS_CC);
+
+	if (length == 0) {
+		prnl_packet_put(obj, 0, 1, 69); //version & length
+		prnl_packet_put(obj, 1, 1, 0);  //tos
+		prnl_packet_put(obj, 8, 1, 64); //ttl
+	}
+}
+
+PRNL_FIELD_GETTER(IPv4ProtocolPacket, getLength, 2, 2)
+PRNL_FIELD_GETTER(IPv4ProtocolPacket, getIdSequence, 4, 2)
+PRNL_FIELD_GETTER(IPv4ProtocolPacket, getOffset, 6, 2)
+PRNL_FIELD_GETTER(IPv4ProtocolPacket, getTTL, 8, 1)
+PRNL_FIELD_GETTER(IPv4ProtocolPacket, getProtocol, 9, 1)
+PRNL_FIELD_GETTER(IPv4ProtocolPacket, getChecksum, 10, 2)
+
+PRNL_FIELD_SETTER(IPv4ProtocolPacket, setLength, 2, 2)
+PRNL_FIELD_SETTER(IPv4ProtocolPacket, setIdSequence, 4, 2)
+PRNL_FIELD_SETTER(IPv4ProtocolPacket, setOffset, 6, 2)
+PRNL_FIELD_SETTER(IPv4ProtocolPacket, setTTL, 8, 1)
+PRNL_FIELD_SETTER(IPv4ProtocolPacket, setProtocol, 9, 1)
+PRNL_FIELD_SETTER(IPv4ProtocolPacket, setChecksum, 10, 2)
+
+static void prnl_return_ip(prnl_packet_object *obj, size_t offset, zval *return_value)
+{
+	char ip[16];
+	uint32_t addr = (uint32_t) prnl_packet_get(obj, offset, 4);
+
+	snprintf(ip, sizeof(ip), "%u.%u.%u.%u", addr >> 24, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF);
+
+	RETURN_STRING(ip, 1);
+}
+
+static void prnl_set_ip(INTERNAL_FUNCTION_PARAMETERS, size_t offset, const char *error)
+{
+	zval *zip;
+	long lval;
+	double dval;
+	struct in_addr addr;
+	int type;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &zip) == FAILURE) {
+		return;
+	}
+
+	if (Z_TYPE_P(zip) == IS_LONG) {
+		lval = Z_LVAL_P(zip);
+	}
+	else if (Z_TYPE_P(zip) == IS_DOUBLE) {
+		lval = (long) Z_DVAL_P(zip);
+	}
+	else {
+		convert_to_string(zip);
+
+		if ((type = is_numeric_string(Z_STRVAL_P(zip), Z_STRLEN_P(zip), &lval, &dval, 0)) != 0) {
+			if (type == IS_DOUBLE) {
+				lval = (long) dval;
+			}
+		}
+		else if (inet_pton(AF_INET, Z_STRVAL_P(zip), &addr) == 1) {
+			lval = (long) ntohl(addr.s_addr);
+		}
+		else {
+			zend_throw_exception(zend_exception_get_default(TSRMLS_C), (char *) error, 0 TSRMLS_CC);
+			return;
+		}
+	}
+
+	prnl_packet_put(PRNL_THIS(), offset, 4, lval);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, getSrcIP)
+{
+	prnl_return_ip(PRNL_THIS(), 12, return_value);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, getDstIP)
+{
+	prnl_return_ip(PRNL_THIS(), 16, return_value);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, setSrcIP)
+{
+	prnl_set_ip(INTERNAL_FUNCTION_PARAM_PASSTHRU, 12, "Invalid src IP!");
+}
+
+PHP_METHOD(IPv4ProtocolPacket, setDstIP)
+{
+	prnl_set_ip(INTERNAL_FUNCTION_PARAM_PASSTHRU, 16, "Invalid dst IP!");
+}
+
+PHP_METHOD(IPv4ProtocolPacket, getRawData)
+{
+	prnl_packet_return(PRNL_THIS(), PRNL_IPV4_HEADER, return_value);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, getFragmentOffset)
+{
+	RETURN_LONG((prnl_packet_get(PRNL_THIS(), 6, 2) & 0x1FFF) * 8);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, hasMoreFragments)
+{
+	RETURN_BOOL((prnl_packet_get(PRNL_THIS(), 6, 2) & 0x2000) != 0);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, isFragment)
+{
+	RETURN_BOOL((prnl_packet_get(PRNL_THIS(), 6, 2) & 0x3FFF) != 0);
+}
+
+/*
+ * Dissect the content of a IPv4 packet with the class ProtocolRegistry has
+ * for its protocol, the native TCP and UDP classes are created directly
+ */
+static zval *prnl_ipv4_content(prnl_packet_object *obj, zend_bool header_only TSRMLS_DC)
+{
+	const char *data = obj->length > PRNL_IPV4_HEADER ? (char *) obj->buffer + PRNL_IPV4_HEADER : "";
+	int length = obj->length > PRNL_IPV4_HEADER ? obj->length - PRNL_IPV4_HEADER : 0;
+	long protocol = prnl_packet_get(obj, 9, 1);
+	zend_class_entry **pregistry, **pce;
+	zval *dissectors, **entry, **zclass, **zsize, *zprotocol, *zpacket, *zdata;
+
+	//only the first fragment starts with the content protocol header
+	if (prnl_packet_get(obj, 6, 2) & 0x1FFF) {
+		return prnl_create_packet(prnl_ce_raw_packet, 0, data, header_only ? 0 : length TSRMLS_CC);
+	}
+
+	if (zend_lookup_class("ProtocolRegistry", sizeof("ProtocolRegistry") - 1, &pregistry TSRMLS_CC) == FAILURE
+		|| (dissectors = zend_read_static_property(*pregistry, "dissectors", sizeof("dissectors") - 1, 1 TSRMLS_CC)) == NULL
+		|| Z_TYPE_P(dissectors) != IS_ARRAY
+		|| zend_hash_index_find(Z_ARRVAL_P(dissectors), protocol, (void **) &entry) == FAILURE
+		|| Z_TYPE_PP(entry) != IS_ARRAY
+		|| zend_hash_index_find(Z_ARRVAL_PP(entry), 0, (void **) &zclass) == FAILURE
+		|| zend_hash_index_find(Z_ARRVAL_PP(entry), 1, (void **) &zsize) == FAILURE
+		|| Z_TYPE_PP(zclass) != IS_STRING) {
+		return prnl_create_packet(prnl_ce_raw_packet, 0, data, header_only ? 0 : length TSRMLS_CC);
+	}
+
+	if (zend_lookup_class(Z_STRVAL_PP(zclass), Z_STRLEN_PP(zclass), &pce TSRMLS_CC) == FAILURE) {
+		//the class is loaded on first use
+		MAKE_STD_ZVAL(zprotocol);
+		ZVAL_LONG(zprotocol, protocol);
+		zend_call_method_with_1_params(NULL, *pregistry, NULL, "get", NULL, zprotocol);
+		zval_ptr_dtor(&zprotocol);
+
+		if (EG(exception) || zend_lookup_class(Z_STRVAL_PP(zclass), Z_STRLEN_PP(zclass), &pce TSRMLS_CC) == FAILURE) {
+			return prnl_create_packet(prnl_ce_raw_packet, 0, data, header_only ? 0 : length TSRMLS_CC);
+		}
+	}
+
+	if (header_only && Z_TYPE_PP(zsize) == IS_LONG && length > Z_LVAL_PP(zsize)) {
+		length = Z_LVAL_PP(zsize);
+	}
+
+	if (*pce == prnl_ce_tcp) {
+		return prnl_create_packet(prnl_ce_tcp, PRNL_TCP_HEADER, data, length TSRMLS_CC);
+	}
+	if (*pce == prnl_ce_udp) {
+		return prnl_create_packet(prnl_ce_udp, PRNL_UDP_HEADER, data, length TSRMLS_CC);
+	}
+
+	MAKE_STD_ZVAL(zpacket);
+	object_init_ex(zpacket, *pce);
+
+	if ((*pce)->constructor) {
+		MAKE_STD_ZVAL(zdata);
+		ZVAL_STRINGL(zdata, data, length, 1);
+		zend_call_method_with_1_params(&zpacket, *pce, &(*pce)->constructor, "__construct", NULL, zdata);
+		zval_ptr_dtor(&zdata);
+	}
+
+	return zpacket;
+}
+
+PHP_METHOD(IPv4ProtocolPacket, getDataObject)
+{
+	zend_bool header_only = 0;
+	prnl_packet_object *obj = PRNL_THIS();
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|b", &header_only) == FAILURE) {
+		return;
+	}
+
+	if (obj->data) {
+		RETURN_ZVAL(obj->data, 1, 0);
+	}
+
+	if (header_only) {
+		if (!obj->header) {
+			obj->header = prnl_ipv4_content(obj, 1 TSRMLS_CC);
+		}
+
+		RETURN_ZVAL(obj->header, 1, 0);
+	}
+
+	obj->data = prnl_ipv4_content(obj, 0 TSRMLS_CC);
+
+	RETURN_ZVAL(obj->data, 1, 0);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, setData)
+{
+	zval *zdata, *copy;
+	char *data;
+	int length;
+	prnl_packet_object *obj = PRNL_THIS();
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &zdata, prnl_ce_raw_packet) == FAILURE) {
+		return;
+	}
+
+	if (obj->data) {
+		zval_ptr_dtor(&obj->data);
+	}
+	if (obj->header) {
+		zval_ptr_dtor(&obj->header);
+		obj->header = NULL;
+	}
+
+	obj->data = zdata;
+	Z_ADDREF_P(zdata);
+
+	prnl_packet_bytes(zdata, &copy, &data, &length TSRMLS_CC);
+	prnl_packet_set(obj, PRNL_IPV4_HEADER, data, length);
+
+	if (copy) {
+		zval_ptr_dtor(&copy);
+	}
+}
+
+PHP_METHOD(IPv4ProtocolPacket, resetChecksum)
+{
+	prnl_packet_put(PRNL_THIS(), 10, 2, 0);
+}
+
+static void prnl_ipv4_checksum(prnl_packet_object *obj TSRMLS_DC)
+{
+	prnl_packet_resize(obj, obj->length > PRNL_IPV4_HEADER ? obj->length : PRNL_IPV4_HEADER);
+	prnl_packet_put(obj, 10, 2, prnl_csum_finish(prnl_csum_partial(obj->buffer, PRNL_IPV4_HEADER, 0)));
+
+	prnl_live_count("CHECKSUMS", sizeof("CHECKSUMS") - 1 TSRMLS_CC);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, calculateChecksum)
+{
+	prnl_ipv4_checksum(PRNL_THIS() TSRMLS_CC);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, completePacket)
+{
+	prnl_packet_object *obj = PRNL_THIS(), *data;
+	zend_class_entry **pce;
+	zval *zmemory, *zbuffer, *copy;
+	char *bytes;
+	int length;
+
+	if (prnl_packet_get(obj, 2, 2) == 0) {
+		prnl_packet_put(obj, 2, 2, obj->length);
+	}
+
+	if (prnl_packet_get(obj, 10, 2) == 0) {
+		prnl_ipv4_checksum(obj TSRMLS_CC);
+	}
+
+	if (!obj->data) {
+		return;
+	}
+
+	//hook the sub package, the native ones directly
+	if (Z_OBJCE_P(obj->data) == prnl_ce_tcp || Z_OBJCE_P(obj->data) == prnl_ce_udp) {
+		data = (prnl_packet_object *) zend_object_store_get_object(obj->data TSRMLS_CC);
+		prnl_transport_complete(data, Z_OBJCE_P(obj->data) == prnl_ce_tcp ? IPPROTO_TCP : IPPROTO_UDP, obj->buffer, obj->length TSRMLS_CC);
+	}
+	else if (instanceof_function(Z_OBJCE_P(obj->data), prnl_ce_completeable TSRMLS_CC)
+		&& zend_lookup_class("Memory", sizeof("Memory") - 1, &pce TSRMLS_CC) == SUCCESS) {
+		MAKE_STD_ZVAL(zmemory);
+		object_init_ex(zmemory, *pce);
+		zend_call_method_with_0_params(&zmemory, *pce, &(*pce)->constructor, "__construct", NULL);
+
+		MAKE_STD_ZVAL(zbuffer);
+		ZVAL_STRINGL(zbuffer, (char *) obj->buffer, obj->length, 1);
+		zend_call_method_with_1_params(&zmemory, *pce, NULL, "addstring", NULL, zbuffer);
+		zval_ptr_dtor(&zbuffer);
+
+		zend_call_method_with_1_params(&obj->data, NULL, NULL, "completepacket", NULL, zmemory);
+		zval_ptr_dtor(&zmemory);
+	}
+
+	prnl_packet_bytes(obj->data, &copy, &bytes, &length TSRMLS_CC);
+	prnl_packet_set(obj, PRNL_IPV4_HEADER, bytes, length);
+
+	if (copy) {
+		zval_ptr_dtor(&copy);
+	}
+}
+
+//the packet with the current content packet, like the PHP segment()/fragment()
+static void prnl_ipv4_split(INTERNAL_FUNCTION_PARAMETERS, int fragment)
+{
+	prnl_packet_object *obj = PRNL_THIS();
+	long size;
+	zval *copy = NULL;
+	char *bytes, *packet;
+	int length;
+	size_t ip_length;
+	int result;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &size) == FAILURE) {
+		return;
+	}
+
+	if (fragment || !obj->data) {
+		result = fragment
+			? prnl_ip_fragment_ex(return_value, obj->buffer, obj->length, size TSRMLS_CC)
+			: prnl_gso_segment_ex(return_value, obj->buffer, obj->length, size TSRMLS_CC);
+	}
+	else {
+		ip_length = (prnl_packet_get(obj, 0, 1) & 0x0F) * 4;
+		if (ip_length > obj->length) {
+			ip_length = obj->length;
+		}
+
+		prnl_packet_bytes(obj->data, &copy, &bytes, &length TSRMLS_CC);
+
+		packet = emalloc(ip_length + length + 1);
+		memcpy(packet, obj->buffer, ip_length);
+		memcpy(packet + ip_length, bytes, length);
+
+		result = prnl_gso_segment_ex(return_value, (unsigned char *) packet, ip_length + length, size TSRMLS_CC);
+
+		efree(packet);
+		if (copy) {
+			zval_ptr_dtor(&copy);
+		}
+	}
+
+	if (result == FAILURE) {
+		zend_throw_exception(zend_exception_get_default(TSRMLS_C), fragment ? "Packet can't be fragmented!" : "Packet can't be segmented!", 0 TSRMLS_CC);
+	}
+}
+
+PHP_METHOD(IPv4ProtocolPacket, segment)
+{
+	prnl_ipv4_split(INTERNAL_FUNCTION_PARAM_PASSTHRU, 0);
+}
+
+PHP_METHOD(IPv4ProtocolPacket, fragment)
+{
+	prnl_ipv4_split(INTERNAL_FUNCTION_PARAM_PASSTHRU, 1);
+}
+/* }}} */
+
+/* {{{ TCPProtocolPacket and UDPProtocolPacket */
+PHP_METHOD(TCPProtocolPacket, __construct)
+{
+	char *data = "";
+	int length = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|s", &data, &length) == FAILURE) {
+		return;
+	}
+
+	prnl_tcp_init(PRNL_THIS(), data, length TSRMLS_CC);
+}
+
+PRNL_FIELD_GETTER(TCPProtocolPacket, getSrcPort, 0, 2)
+PRNL_FIELD_GETTER(TCPProtocolPacket, getDstPort, 2, 2)
+PRNL_FIELD_GETTER(TCPProtocolPacket, getIdSequence, 4, 4)
+PRNL_FIELD_GETTER(TCPProtocolPacket, getAckIdSequence, 8, 4)
+PRNL_FIELD_GETTER(TCPProtocolPacket, getSegmentOffset, 12, 1)
+PRNL_FIELD_GETTER(TCPProtocolPacket, getFlags, 13, 1)
+PRNL_FIELD_GETTER(TCPProtocolPacket, getWindowSize, 14, 2)
+PRNL_FIELD_GETTER(TCPProtocolPacket, getChecksum, 16, 2)
+PRNL_FIELD_GETTER(TCPProtocolPacket, getUrgentPointer, 18, 2)
+
+PRNL_FIELD_SETTER(TCPProtocolPacket, setSrcPort, 0, 2)
+PRNL_FIELD_SETTER(TCPProtocolPacket, setDstPort, 2, 2)
+PRNL_FIELD_SETTER(TCPProtocolPacket, setIdSequence, 4, 4)
+PRNL_FIELD_SETTER(TCPProtocolPacket, setAckIdSequence, 8, 4)
+PRNL_FIELD_SETTER(TCPProtocolPacket, setFlags, 13, 1)
+PRNL_FIELD_SETTER(TCPProtocolPacket, setWindowSize, 14, 2)
+PRNL_FIELD_SETTER(TCPProtocolPacket, setChecksum, 16, 2)
+PRNL_FIELD_SETTER(TCPProtocolPacket, setUrgentPointer, 18, 2)
+
+PHP_METHOD(TCPProtocolPacket, setSegmentOffset)
+{
+	long offset;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &offset) == FAILURE) {
+		return;
+	}
+
+	prnl_packet_put(PRNL_THIS(), 12, 1, offset << 4);
+}
+
+PHP_METHOD(UDPProtocolPacket, __construct)
+{
+	char *data = "";
+	int length = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|s", &data, &length) == FAILURE) {
+		return;
+	}
+
+	prnl_packet_init(PRNL_THIS(), PRNL_UDP_HEADER, data, length TSRMLS_CC);
+}
+
+PRNL_FIELD_GETTER(UDPProtocolPacket, getSrcPort, 0, 2)
+PRNL_FIELD_GETTER(UDPProtocolPacket, getDstPort, 2, 2)
+PRNL_FIELD_GETTER(UDPProtocolPacket, getLength, 4, 2)
+PRNL_FIELD_GETTER(UDPProtocolPacket, getChecksum, 6, 2)
+
+PRNL_FIELD_SETTER(UDPProtocolPacket, setSrcPort, 0, 2)
+PRNL_FIELD_SETTER(UDPProtocolPacket, setDstPort, 2, 2)
+PRNL_FIELD_SETTER(UDPProtocolPacket, setLength, 4, 2)
+PRNL_FIELD_SETTER(UDPProtocolPacket, setChecksum, 6, 2)
+
+//methods shared by TCP and UDP, the header size and checksum offset depend on the class
+#define PRNL_IS_TCP() (Z_OBJCE_P(getThis()) == prnl_ce_tcp || instanceof_function(Z_OBJCE_P(getThis()), prnl_ce_tcp TSRMLS_CC))
+
+PHP_METHOD(TransportPacket, getData)
+{
+	prnl_packet_return(PRNL_THIS(), PRNL_IS_TCP() ? PRNL_TCP_HEADER : PRNL_UDP_HEADER, return_value);
+}
+
+PHP_METHOD(TransportPacket, setData)
+{
+	char *data;
+	int length;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &data, &length) == FAILURE) {
+		return;
+	}
+
+	prnl_packet_set(PRNL_THIS(), PRNL_IS_TCP() ? PRNL_TCP_HEADER : PRNL_UDP_HEADER, data, length);
+}
+
+PHP_METHOD(TransportPacket, resetChecksum)
+{
+	prnl_packet_put(PRNL_THIS(), PRNL_IS_TCP() ? 16 : 6, 2, 0);
+}
+
+PHP_METHOD(TransportPacket, calculateChecksum)
+{
+	zval *zparent, *copy;
+	char *data;
+	int length;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &zparent) == FAILURE) {
+		return;
+	}
+
+	prnl_transport_parent(zparent, &copy, &data, &length TSRMLS_CC);
+	prnl_transport_checksum(PRNL_THIS(), PRNL_IS_TCP() ? IPPROTO_TCP : IPPROTO_UDP, (unsigned char *) data, length TSRMLS_CC);
+
+	if (copy) {
+		zval_ptr_dtor(&copy);
+	}
+}
+
+PHP_METHOD(TransportPacket, completePacket)
+{
+	zval *zparent, *copy;
+	char *data;
+	int length;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &zparent) == FAILURE) {
+		return;
+	}
+
+	prnl_transport_parent(zparent, &copy, &data, &length TSRMLS_CC);
+	prnl_transport_complete(PRNL_THIS(), PRNL_IS_TCP() ? IPPROTO_TCP : IPPROTO_UDP, (unsigned char *) data, length TSRMLS_CC);
+
+	if (copy) {
+		zval_ptr_dtor(&copy);
+	}
+}
+/* }}} */
+
+/* {{{ class registration */
+ZEND_BEGIN_ARG_INFO_EX(arginfo_prnl_complete, 0, 0, 1)
+	ZEND_ARG_OBJ_INFO(0, parentPacketBuffer, Memory, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_prnl_set_data, 0, 0, 1)
+	ZEND_ARG_OBJ_INFO(0, data, RawPacket, 0)
+ZEND_END_ARG_INFO()
+
+static zend_function_entry prnl_completeable_methods[] = {
+	PHP_ABSTRACT_ME(ICompleteableProtocolPacket, completePacket, arginfo_prnl_complete)
+	{NULL, NULL, NULL}
+};
+
+static zend_function_entry prnl_raw_packet_methods[] = {
+	PHP_ME(RawPacket, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(RawPacket, getRawPacket, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(RawPacket, setRawPacket, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(RawPacket, getPacketLength, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(RawPacket, getReceiveInfo, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(RawPacket, setReceiveInfo, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(RawPacket, dumpPacket, NULL, ZEND_ACC_PUBLIC)
+	PHP_MALIAS(RawPacket, __toString, getRawPacket, NULL, ZEND_ACC_PUBLIC)
+	{NULL, NULL, NULL}
+};
+
+static zend_function_entry prnl_ipv4_methods[] = {
+	PHP_ME(IPv4ProtocolPacket, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(IPv4ProtocolPacket, getLength, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getIdSequence, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getOffset, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getTTL, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getProtocol, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getSrcIP, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getDstIP, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getRawData, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getFragmentOffset, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, hasMoreFragments, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, isFragment, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, getDataObject, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, setLength, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, setIdSequence, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, setOffset, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, setTTL, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, setProtocol, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, setChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, setSrcIP, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, setDstIP, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, setData, arginfo_prnl_set_data, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, resetChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, calculateChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, segment, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, fragment, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(IPv4ProtocolPacket, completePacket, NULL, ZEND_ACC_PUBLIC)
+	{NULL, NULL, NULL}
+};
+
+static zend_function_entry prnl_tcp_methods[] = {
+	PHP_ME(TCPProtocolPacket, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(TCPProtocolPacket, getSrcPort, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, getDstPort, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, getIdSequence, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, getAckIdSequence, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, getSegmentOffset, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, getFlags, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, getWindowSize, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, getChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, getUrgentPointer, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, setSrcPort, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, setDstPort, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, setIdSequence, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, setAckIdSequence, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, setSegmentOffset, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, setFlags, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, setWindowSize, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, setChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TCPProtocolPacket, setUrgentPointer, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, getData, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, setData, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, resetChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, calculateChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, completePacket, arginfo_prnl_complete, ZEND_ACC_PUBLIC)
+	{NULL, NULL, NULL}
+};
+
+static zend_function_entry prnl_udp_methods[] = {
+	PHP_ME(UDPProtocolPacket, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(UDPProtocolPacket, getSrcPort, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(UDPProtocolPacket, getDstPort, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(UDPProtocolPacket, getLength, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(UDPProtocolPacket, getChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(UDPProtocolPacket, setSrcPort, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(UDPProtocolPacket, setDstPort, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(UDPProtocolPacket, setLength, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(UDPProtocolPacket, setChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, getData, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, setData, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, resetChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, calculateChecksum, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(TransportPacket, completePacket, arginfo_prnl_complete, ZEND_ACC_PUBLIC)
+	{NULL, NULL, NULL}
+};
+
+int prnl_classes_minit(int module_number TSRMLS_DC)
+{
+	zend_class_entry ce;
+
+	memcpy(&prnl_packet_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+	prnl_packet_handlers.clone_obj = prnl_packet_clone;
+
+	INIT_CLASS_ENTRY(ce, "ICompleteableProtocolPacket", prnl_completeable_methods);
+	prnl_ce_completeable = zend_register_internal_interface(&ce TSRMLS_CC);
+
+	INIT_CLASS_ENTRY(ce, "RawPacket", prnl_raw_packet_methods);
+	ce.create_object = prnl_packet_new;
+	prnl_ce_raw_packet = zend_register_internal_class(&ce TSRMLS_CC);
+	zend_declare_property_null(prnl_ce_raw_packet, "_buffer", sizeof("_buffer") - 1, ZEND_ACC_PROTECTED TSRMLS_CC);
+
+	INIT_CLASS_ENTRY(ce, "IPv4ProtocolPacket", prnl_ipv4_methods);
+	prnl_ce_ipv4 = zend_register_internal_class_ex(&ce, prnl_ce_raw_packet, NULL TSRMLS_CC);
+
+	INIT_CLASS_ENTRY(ce, "TCPProtocolPacket", prnl_tcp_methods);
+	prnl_ce_tcp = zend_register_internal_class_ex(&ce, prnl_ce_raw_packet, NULL TSRMLS_CC);
+	zend_class_implements(prnl_ce_tcp TSRMLS_CC, 1, prnl_ce_completeable);
+
+	INIT_CLASS_ENTRY(ce, "UDPProtocolPacket", prnl_udp_methods);
+	prnl_ce_udp = zend_register_internal_class_ex(&ce, prnl_ce_raw_packet, NULL TSRMLS_CC);
+	zend_class_implements(prnl_ce_udp TSRMLS_CC, 1, prnl_ce_completeable);
+
+	return SUCCESS;
+}
+/* }}} */
@@ -0,0 +1,122 @@
+/*
+ * PRNL Native Extension - batch decoder
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "php.h"
+#include "php_prnl_native.h"
+
+static const char *prnl_decode_columns[PRNL_DECODE_COLUMNS] = {
+	"src", "dst", "proto", "sport", "dport", "length", "ttl", "flags"
+};
+
+/*
+ * Decode the header fields of one packet, fields that are not available
+ * (short packets, non-first fragments, other protocols) are 0
+ */
+static void prnl_decode_packet(const unsigned char *p, size_t len, long *values)
+{
+	size_t ip_len;
+
+	memset(values, 0, sizeof(long) * PRNL_DECODE_COLUMNS);
+
+	if (len < 20 || (p[0] >> 4) != 4) {
+		return;
+	}
+
+	ip_len = (p[0] & 0x0F) * 4;
+
+	values[0] = (long) (((uint32_t) p[12] << 24) | (p[13] << 16) | (p[14] << 8) | p[15]);
+	values[1] = (long) (((uint32_t) p[16] << 24) | (p[17] << 16) | (p[18] << 8) | p[19]);
+	values[2] = p[9];
+	values[5] = (p[2] << 8) | p[3];
+	values[6] = p[8];
+
+	//the ports are only in the first fragment
+	if (((p[6] << 8) | p[7]) & 0x1FFF) {
+		return;
+	}
+
+	if ((p[9] == IPPROTO_TCP || p[9] == IPPROTO_UDP) && len >= ip_len + 4) {
+		values[3] = (p[ip_len] << 8) | p[ip_len + 1];
+		values[4] = (p[ip_len + 2] << 8) | p[ip_len + 3];
+	}
+
+	if (p[9] == IPPROTO_TCP && len >= ip_len + 14) {
+		values[7] = p[ip_len + 13];
+	}
+}
+
+/* {{{ proto array prnl_decode_batch(array packets, int fields)
+   Decode the IPv4/TCP/UDP header fields of raw packets into one array per field */
+PHP_FUNCTION(prnl_decode_batch)
+{
+	zval *zpackets, **zpacket;
+	zval *columns[PRNL_DECODE_COLUMNS];
+	long fields, values[PRNL_DECODE_COLUMNS];
+	HashPosition pos;
+	int i, count;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "al", &zpackets, &fields) == FAILURE) {
+		return;
+	}
+
+	count = zend_hash_num_elements(Z_ARRVAL_P(zpackets));
+
+	array_init(return_value);
+
+	for (i = 0; i < PRNL_DECODE_COLUMNS; i++) {
+		columns[i] = NULL;
+
+		if (fields & (1 << i)) {
+			MAKE_STD_ZVAL(columns[i]);
+			array_init_size(columns[i], count);
+			add_assoc_zval(return_value, prnl_decode_columns[i], columns[i]);
+		}
+	}
+
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(zpackets), &pos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(zpackets), (void **) &zpacket, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(zpackets), &pos)) {
+
+		//a row for every packet, so the columns stay aligned with the input
+		if (Z_TYPE_PP(zpacket) == IS_STRING) {
+			prnl_decode_packet((const unsigned char *) Z_STRVAL_PP(zpacket), Z_STRLEN_PP(zpacket), values);
+		}
+		else {
+			memset(values, 0, sizeof(values));
+		}
+
+		for (i = 0; i < PRNL_DECODE_COLUMNS; i++) {
+			if (columns[i]) {
+				add_next_index_long(columns[i], values[i]);
+			}
+		}
+	}
+}
+/* }}} */
@@ -0,0 +1,488 @@
+/*
+ * PRNL Native Extension - flow table
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include "php.h"
+#include "php_prnl_native.h"
+
+/*
+ * Flow table with a fixed memory budget.
+ *
+ * Flows live in a preallocated entry array, an open addressing (linear
+ * probing) index of 32 bit entry numbers points into it. Deleting uses
+ * backward shifting, so there are no tombstones and lookups stay short.
+ * The entries are chained in a doubly linked LRU list: the head is the
+ * most recently seen flow, idle expiry and eviction work from the tail.
+ */
+#define PRNL_FLOW_NONE 0xFFFFFFFF
+
+//one pending (expired but not yet collected) record for every 8 flows
+#define PRNL_FLOW_PENDING_SHARE 8
+
+#define PRNL_FLOW_RES_NAME "PRNL Flow Table"
+
+typedef struct _prnl_flow {
+	unsigned char key[PRNL_FLOW_KEY_SIZE];
+	uint32_t hash;
+	uint32_t prev;
+	uint32_t next;
+	uint64_t packets;
+	uint64_t bytes;
+	double first;
+	double last;
+} prnl_flow;
+
+typedef struct _prnl_flow_record {
+	prnl_flow flow;
+	int reason;
+} prnl_flow_record;
+
+typedef struct _prnl_flow_table {
+	prnl_flow *entries;
+	uint32_t *index;
+	uint32_t mask;
+	uint32_t max;
+	uint32_t count;
+	uint32_t free;
+	uint32_t lru_head;
+	uint32_t lru_tail;
+	double idle;
+	double active;
+	prnl_flow_record *pending;
+	uint32_t pending_count;
+	uint32_t pending_size;
+	uint32_t dropped;
+} prnl_flow_table;
+
+static int le_prnl_flow_table;
+
+static void prnl_flow_table_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	prnl_flow_table *table = (prnl_flow_table *) rsrc->ptr;
+
+	efree(table->entries);
+	efree(table->index);
+	efree(table->pending);
+	efree(table);
+}
+
+int prnl_flow_minit(int module_number TSRMLS_DC)
+{
+	le_prnl_flow_table = zend_register_list_destructors_ex(prnl_flow_table_dtor, NULL, PRNL_FLOW_RES_NAME, module_number);
+
+	return SUCCESS;
+}
+
+//FNV-1a over the key
+static inline uint32_t prnl_flow_hash(const unsigned char *key)
+{
+	uint32_t hash = 2166136261U;
+	int i;
+
+	for (i = 0; i < PRNL_FLOW_KEY_SIZE; i++) {
+		hash ^= key[i];
+		hash *= 16777619U;
+	}
+
+	//FNV spreads badly over the low bits for short keys
+	hash ^= hash >> 15;
+	hash *= 0x2C1B3C6DU;
+	hash ^= hash >> 12;
+
+	return hash;
+}
+
+static uint32_t prnl_flow_find_slot(prnl_flow_table *table, const unsigned char *key, uint32_t hash)
+{
+	uint32_t slot = hash & table->mask, entry;
+
+	while ((entry = table->index[slot]) != PRNL_FLOW_NONE) {
+		if (table->entries[entry].hash == hash && memcmp(table->entries[entry].key, key, PRNL_FLOW_KEY_SIZE) == 0) {
+			return slot;
+		}
+		slot = (slot + 1) & table->mask;
+	}
+
+	return slot;
+}
+
+static void prnl_flow_lru_unlink(prnl_flow_table *table, uint32_t entry)
+{
+	prnl_flow *flow = &table->entries[entry];
+
+	if (flow->prev != PRNL_FLOW_NONE) {
+		table->entries[flow->prev].next = flow->next;
+	}
+	else {
+		table->lru_head = flow->next;
+	}
+
+	if (flow->next != PRNL_FLOW_NONE) {
+		table->entries[flow->next].prev = flow->prev;
+	}
+	else {
+		table->lru_tail = flow->prev;
+	}
+}
+
+static void prnl_flow_lru_push(prnl_flow_table *table, uint32_t entry)
+{
+	prnl_flow *flow = &table->entries[entry];
+
+	flow->prev = PRNL_FLOW_NONE;
+	flow->next = table->lru_head;
+
+	if (table->lru_head != PRNL_FLOW_NONE) {
+		table->entries[table->lru_head].prev = entry;
+	}
+	else {
+		table->lru_tail = entry;
+	}
+	table->lru_head = entry;
+}
+
+//the pending queue is part of the budget, when nobody collects it the records are dropped
+static void prnl_flow_queue(prnl_flow_table *table, prnl_flow *flow, int reason)
+{
+	if (table->pending_count == table->pending_size) {
+		table->dropped++;
+		return;
+	}
+
+	table->pending[table->pending_count].flow = *flow;
+	table->pending[table->pending_count].reason = reason;
+	table->pending_count++;
+}
+
+static void prnl_flow_delete(prnl_flow_table *table, uint32_t entry)
+{
+	uint32_t slot, next, home;
+
+	slot = prnl_flow_find_slot(table, table->entries[entry].key, table->entries[entry].hash);
+
+	//backward shift the rest of the cluster into the hole
+	next = slot;
+	for (;;) {
+		next = (next + 1) & table->mask;
+		if (table->index[next] == PRNL_FLOW_NONE) {
+			break;
+		}
+
+		home = table->entries[table->index[next]].hash & table->mask;
+		if (((next - home) & table->mask) >= ((next - slot) & table->mask)) {
+			table->index[slot] = table->index[next];
+			slot = next;
+		}
+	}
+	table->index[slot] = PRNL_FLOW_NONE;
+
+	prnl_flow_lru_unlink(table, entry);
+
+	table->entries[entry].next = table->free;
+	table->free = entry;
+	table->count--;
+}
+
+static void prnl_flow_to_array(zval *result, prnl_flow *flow, int reason)
+{
+	array_init(result);
+	add_assoc_stringl(result, "key", (char *) flow->key, PRNL_FLOW_KEY_SIZE, 1);
+	add_assoc_long(result, "packets", (long) flow->packets);
+	add_assoc_long(result, "bytes", (long) flow->bytes);
+	add_assoc_double(result, "first", flow->first);
+	add_assoc_double(result, "last", flow->last);
+	if (reason) {
+		add_assoc_long(result, "reason", reason);
+	}
+}
+
+/* {{{ proto resource prnl_flow_table_create(int memoryBudget, float idleTimeout, float activeTimeout)
+   Create a flow table that never uses more than memoryBudget bytes */
+PHP_FUNCTION(prnl_flow_table_create)
+{
+	long budget;
+	double idle, active;
+	prnl_flow_table *table;
+	long cost, max;
+	uint32_t size, i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ldd", &budget, &idle, &active) == FAILURE) {
+		return;
+	}
+
+	//every flow costs an entry, its share of the pending queue and two index slots (load factor <= 0.5)
+	cost = (long) (sizeof(prnl_flow) + sizeof(prnl_flow_record) / PRNL_FLOW_PENDING_SHARE);
+	max = budget / (cost + 2 * (long) sizeof(uint32_t));
+	if (max < 16 || max > 0x20000000) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Invalid memory budget");
+		RETURN_FALSE;
+	}
+
+	for (size = 16; size < max * 2; size <<= 1);
+
+	//the index is rounded up to a power of two, take the extra slots out of the entries
+	if (max * cost + (long) size * (long) sizeof(uint32_t) > budget) {
+		max = (budget - (long) size * (long) sizeof(uint32_t)) / cost;
+	}
+
+	table = (prnl_flow_table *) ecalloc(1, sizeof(prnl_flow_table));
+	table->entries = (prnl_flow *) safe_emalloc(max, sizeof(prnl_flow), 0);
+	table->index = (uint32_t *) safe_emalloc(size, sizeof(uint32_t), 0);
+	memset(table->index, 0xFF, size * sizeof(uint32_t));
+	table->pending_size = (uint32_t) max / PRNL_FLOW_PENDING_SHARE;
+	table->pending = (prnl_flow_record *) safe_emalloc(table->pending_size, sizeof(prnl_flow_record), 0);
+
+	for (i = 0; i < max; i++) {
+		table->entries[i].next = i + 1 < max ? i + 1 : PRNL_FLOW_NONE;
+	}
+
+	table->mask = size - 1;
+	table->max = (uint32_t) max;
+	table->free = 0;
+	table->lru_head = PRNL_FLOW_NONE;
+	table->lru_tail = PRNL_FLOW_NONE;
+	table->idle = idle;
+	table->active = active;
+
+	ZEND_REGISTER_RESOURCE(return_value, table, le_prnl_flow_table);
+}
+/* }}} */
+
+/* {{{ proto bool prnl_flow_update(resource table, string key, int bytes, float now)
+   Account a packet to a flow, returns true when the flow is new */
+PHP_FUNCTION(prnl_flow_update)
+{
+	zval *ztable;
+	char *key;
+	int key_len;
+	long bytes;
+	double now;
+	prnl_flow_table *table;
+	prnl_flow *flow;
+	uint32_t hash, slot, entry;
+	int created = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rsld", &ztable, &key, &key_len, &bytes, &now) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(table, prnl_flow_table *, &ztable, -1, PRNL_FLOW_RES_NAME, le_prnl_flow_table);
+
+	if (key_len != PRNL_FLOW_KEY_SIZE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Flow keys are %d bytes", PRNL_FLOW_KEY_SIZE);
+		RETURN_FALSE;
+	}
+
+	hash = prnl_flow_hash((unsigned char *) key);
+	slot = prnl_flow_find_slot(table, (unsigned char *) key, hash);
+	entry = table->index[slot];
+
+	if (entry == PRNL_FLOW_NONE) {
+		if (table->free == PRNL_FLOW_NONE) {
+			//out of budget, make room by evicting the least recently seen flow
+			prnl_flow_queue(table, &table->entries[table->lru_tail], PRNL_FLOW_EVICTED);
+			prnl_flow_delete(table, table->lru_tail);
+			slot = prnl_flow_find_slot(table, (unsigned char *) key, hash);
+		}
+
+		entry = table->free;
+		table->free = table->entries[entry].next;
+		table->index[slot] = entry;
+		table->count++;
+
+		flow = &table->entries[entry];
+		memcpy(flow->key, key, PRNL_FLOW_KEY_SIZE);
+		flow->hash = hash;
+		flow->packets = 0;
+		flow->bytes = 0;
+		flow->first = now;
+		created = 1;
+	}
+	else {
+		flow = &table->entries[entry];
+		prnl_flow_lru_unlink(table, entry);
+
+		if (table->active > 0 && now - flow->first >= table->active) {
+			prnl_flow_queue(table, flow, PRNL_FLOW_ACTIVE);
+			flow->packets = 0;
+			flow->bytes = 0;
+			flow->first = now;
+		}
+	}
+
+	flow->packets++;
+	flow->bytes += bytes;
+	flow->last = now;
+	prnl_flow_lru_push(table, entry);
+
+	RETURN_BOOL(created);
+}
+/* }}} */
+
+/* {{{ proto array prnl_flow_get(resource table, string key)
+   Return the counters of a flow, null when it isn't tracked */
+PHP_FUNCTION(prnl_flow_get)
+{
+	zval *ztable;
+	char *key;
+	int key_len;
+	prnl_flow_table *table;
+	uint32_t slot;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rs", &ztable, &key, &key_len) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(table, prnl_flow_table *, &ztable, -1, PRNL_FLOW_RES_NAME, le_prnl_flow_table);
+
+	if (key_len != PRNL_FLOW_KEY_SIZE) {
+		RETURN_NULL();
+	}
+
+	slot = prnl_flow_find_slot(table, (unsigned char *) key, prnl_flow_hash((unsigned char *) key));
+	if (table->index[slot] == PRNL_FLOW_NONE) {
+		RETURN_NULL();
+	}
+
+	prnl_flow_to_array(return_value, &table->entries[table->index[slot]], 0);
+}
+/* }}} */
+
+/* {{{ proto bool prnl_flow_remove(resource table, string key)
+   Stop tracking a flow */
+PHP_FUNCTION(prnl_flow_remove)
+{
+	zval *ztable;
+	char *key;
+	int key_len;
+	prnl_flow_table *table;
+	uint32_t slot;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rs", &ztable, &key, &key_len) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(table, prnl_flow_table *, &ztable, -1, PRNL_FLOW_RES_NAME, le_prnl_flow_table);
+
+	if (key_len != PRNL_FLOW_KEY_SIZE) {
+		RETURN_FALSE;
+	}
+
+	slot = prnl_flow_find_slot(table, (unsigned char *) key, prnl_flow_hash((unsigned char *) key));
+	if (table->index[slot] == PRNL_FLOW_NONE) {
+		RETURN_FALSE;
+	}
+
+	prnl_flow_delete(table, table->index[slot]);
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto array prnl_flow_expire(resource table, float now)
+   Remove the flows idle for longer than the idle timeout and return them,
+   together with the flows evicted or rolled over by the active timeout since the last call
+   (as far as they fit in the pending queue, see 'dropped' of prnl_flow_table_info) */
+PHP_FUNCTION(prnl_flow_expire)
+{
+	zval *ztable, *zflow;
+	double now;
+	prnl_flow_table *table;
+	uint32_t i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rd", &ztable, &now) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(table, prnl_flow_table *, &ztable, -1, PRNL_FLOW_RES_NAME, le_prnl_flow_table);
+
+	array_init(return_value);
+
+	for (i = 0; i < table->pending_count; i++) {
+		MAKE_STD_ZVAL(zflow);
+		prnl_flow_to_array(zflow, &table->pending[i].flow, table->pending[i].reason);
+		add_next_index_zval(return_value, zflow);
+	}
+	table->pending_count = 0;
+
+	//the tail is the least recently seen flow, stop at the first one that is still active
+	while (table->lru_tail != PRNL_FLOW_NONE && now - table->entries[table->lru_tail].last >= table->idle) {
+		MAKE_STD_ZVAL(zflow);
+		prnl_flow_to_array(zflow, &table->entries[table->lru_tail], PRNL_FLOW_IDLE);
+		add_next_index_zval(return_value, zflow);
+
+		prnl_flow_delete(table, table->lru_tail);
+	}
+}
+/* }}} */
+
+/* {{{ proto array prnl_flow_export(resource table)
+   Return all tracked flows, most recently seen first */
+PHP_FUNCTION(prnl_flow_export)
+{
+	zval *ztable, *zflow;
+	prnl_flow_table *table;
+	uint32_t entry;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &ztable) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(table, prnl_flow_table *, &ztable, -1, PRNL_FLOW_RES_NAME, le_prnl_flow_table);
+
+	array_init(return_value);
+
+	for (entry = table->lru_head; entry != PRNL_FLOW_NONE; entry = table->entries[entry].next) {
+		MAKE_STD_ZVAL(zflow);
+		prnl_flow_to_array(zflow, &table->entries[entry], 0);
+		add_next_index_zval(return_value, zflow);
+	}
+}
+/* }}} */
+
+/* {{{ proto array prnl_flow_table_info(resource table)
+   Return the number of flows, the maximum, the memory in use and the number of dropped records */
+PHP_FUNCTION(prnl_flow_table_info)
+{
+	zval *ztable;
+	prnl_flow_table *table;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &ztable) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(table, prnl_flow_table *, &ztable, -1, PRNL_FLOW_RES_NAME, le_prnl_flow_table);
+
+	array_init(return_value);
+	add_assoc_long(return_value, "count", (long) table->count);
+	add_assoc_long(return_value, "max", (long) table->max);
+	add_assoc_long(return_value, "memory", (long) (table->max * sizeof(prnl_flow) + (table->mask + 1) * sizeof(uint32_t)
+		+ table->pending_size * sizeof(prnl_flow_record)));
+	add_assoc_long(return_value, "dropped", (long) table->dropped);
+}
+/* }}} */
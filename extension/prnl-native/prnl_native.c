@@ -0,0 +1,160 @@
+/*
+ * PRNL Native Extension
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+
+#include "php.h"
+#include "php_ini.h"
+#include "php_prnl_native.h"
+
+/*
+ * prnlnative.classes registers the native packet classes, off by default so
+ * __PRNL_NO_EXTERNAL_MODULES can still select the PHP ones.
+ * prnlnative.profile installs the profiler hooks (prnl_profile.c).
+ */
+PHP_INI_BEGIN()
+	PHP_INI_ENTRY("prnlnative.classes", "0", PHP_INI_SYSTEM, NULL)
+	PHP_INI_ENTRY("prnlnative.profile", "0", PHP_INI_SYSTEM, NULL)
+PHP_INI_END()
+
+static const zend_module_dep prnlnative_deps[] = {
+	ZEND_MOD_REQUIRED("sockets")
+	{NULL, NULL, NULL}
+};
+
+static zend_function_entry prnlnative_functions[] = {
+	PHP_FE(prnl_clock_gettime, NULL)
+	PHP_FE(prnl_socket_set_txtime, NULL)
+	PHP_FE(prnl_sendmmsg, NULL)
+	PHP_FE(prnl_packet_socket, NULL)
+	PHP_FE(prnl_packet_fanout, NULL)
+	PHP_FE(prnl_ring_open, NULL)
+	PHP_FE(prnl_ring_push, NULL)
+	PHP_FE(prnl_ring_push_batch, NULL)
+	PHP_FE(prnl_ring_pop, NULL)
+	PHP_FE(prnl_ring_stats, NULL)
+	PHP_FE(prnl_ring_close, NULL)
+	PHP_FE(prnl_socket_stats, NULL)
+	PHP_FE(prnl_recvmsg, NULL)
+	PHP_FE(prnl_recvmmsg, NULL)
+	PHP_FE(prnl_flow_table_create, NULL)
+	PHP_FE(prnl_flow_update, NULL)
+	PHP_FE(prnl_flow_get, NULL)
+	PHP_FE(prnl_flow_remove, NULL)
+	PHP_FE(prnl_flow_expire, NULL)
+	PHP_FE(prnl_flow_export, NULL)
+	PHP_FE(prnl_flow_table_info, NULL)
+	PHP_FE(prnl_timer_wheel_create, NULL)
+	PHP_FE(prnl_timer_add, NULL)
+	PHP_FE(prnl_timer_cancel, NULL)
+	PHP_FE(prnl_timer_reschedule, NULL)
+	PHP_FE(prnl_timer_advance, NULL)
+	PHP_FE(prnl_timer_info, NULL)
+	PHP_FE(prnl_gso_segment, NULL)
+	PHP_FE(prnl_ip_fragment, NULL)
+	PHP_FE(prnl_checksum, NULL)
+	PHP_FE(prnl_decode_batch, NULL)
+	PHP_FE(prnl_profile_dump, NULL)
+	{NULL, NULL, NULL}
+};
+
+PHP_MINIT_FUNCTION(prnlnative)
+{
+	REGISTER_INI_ENTRIES();
+
+	prnl_ring_minit(module_number TSRMLS_CC);
+	prnl_flow_minit(module_number TSRMLS_CC);
+	prnl_timer_minit(module_number TSRMLS_CC);
+	if (INI_BOOL("prnlnative.classes")) {
+		prnl_classes_minit(module_number TSRMLS_CC);
+	}
+	prnl_profile_minit(module_number TSRMLS_CC);
+
+	return SUCCESS;
+}
+
+PHP_MSHUTDOWN_FUNCTION(prnlnative)
+{
+	prnl_profile_mshutdown(module_number TSRMLS_CC);
+	prnl_recv_mshutdown(module_number TSRMLS_CC);
+
+	UNREGISTER_INI_ENTRIES();
+
+	return SUCCESS;
+}
+
+PHP_RINIT_FUNCTION(prnlnative)
+{
+	prnl_profile_rinit(TSRMLS_C);
+
+	return SUCCESS;
+}
+
+zend_module_entry prnlnative_module_entry = {
+	STANDARD_MODULE_HEADER_EX, NULL,
+	prnlnative_deps,
+	PHP_PRNL_NATIVE_EXTNAME,
+	prnlnative_functions,
+	PHP_MINIT(prnlnative),
+	PHP_MSHUTDOWN(prnlnative),
+	PHP_RINIT(prnlnative),
+	NULL, /* RSHUTDOWN */
+	NULL, /* MINFO */
+	PHP_PRNL_NATIVE_VERSION,
+	STANDARD_MODULE_PROPERTIES
+};
+
+#ifdef COMPILE_DL_PRNLNATIVE
+ZEND_GET_MODULE(prnlnative)
+#endif
+
+/*
+ * Fetch the php_socket behind a resource created by ext/sockets, so
+ * the native functions can work on the same socket as RawNetwork.
+ */
+php_socket *prnl_fetch_socket(zval *zsocket TSRMLS_DC)
+{
+	return (php_socket *) zend_fetch_resource(&zsocket TSRMLS_CC, -1, "Socket", NULL, 1, php_sockets_le_socket());
+}
+
+/* {{{ proto int prnl_clock_gettime(int clockid)
+   Return the current time of the given clock in nanoseconds */
+PHP_FUNCTION(prnl_clock_gettime)
+{
+	long clockid;
+	struct timespec ts;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &clockid) == FAILURE) {
+		return;
+	}
+
+	if (clock_gettime((clockid_t) clockid, &ts) < 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "clock_gettime failed: %s", strerror(errno));
+		RETURN_FALSE;
+	}
+
+	RETURN_LONG((long) ts.tv_sec * 1000000000L + ts.tv_nsec);
+}
+/* }}} */
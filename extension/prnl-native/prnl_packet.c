@@ -0,0 +1,110 @@
+/*
+ * PRNL Native Extension - packet sockets
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "php.h"
+#include "php_prnl_native.h"
+
+#ifndef PACKET_FANOUT
+#define PACKET_FANOUT 18
+#endif
+
+/* {{{ proto resource prnl_packet_socket(int protocol [, string interface])
+   Open a cooked (SOCK_DGRAM) AF_PACKET socket, optionally bound to one interface.
+   The result is a normal sockets extension resource. */
+PHP_FUNCTION(prnl_packet_socket)
+{
+	long protocol;
+	char *ifname = NULL;
+	int ifname_len = 0, fd;
+	struct sockaddr_ll addr;
+	php_socket *php_sock;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l|s!", &protocol, &ifname, &ifname_len) == FAILURE) {
+		return;
+	}
+
+	fd = socket(AF_PACKET, SOCK_DGRAM, htons((unsigned short) protocol));
+	if (fd < 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to create packet socket: %s", strerror(errno));
+		RETURN_FALSE;
+	}
+
+	if (ifname_len > 0) {
+		memset(&addr, 0, sizeof(addr));
+		addr.sll_family = AF_PACKET;
+		addr.sll_protocol = htons((unsigned short) protocol);
+		addr.sll_ifindex = if_nametoindex(ifname);
+
+		if (addr.sll_ifindex == 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to bind to interface '%s': %s", ifname, strerror(errno));
+			close(fd);
+			RETURN_FALSE;
+		}
+	}
+
+	php_sock = (php_socket *) ecalloc(1, sizeof(php_socket));
+	php_sock->bsd_socket = fd;
+	php_sock->type = AF_PACKET;
+	php_sock->blocking = 1;
+
+	ZEND_REGISTER_RESOURCE(return_value, php_sock, php_sockets_le_socket());
+}
+/* }}} */
+
+/* {{{ proto bool prnl_packet_fanout(resource socket, int group, int mode)
+   Join the packet socket to a PACKET_FANOUT group, mode may include the fanout flags */
+PHP_FUNCTION(prnl_packet_fanout)
+{
+	zval *zsocket;
+	long group, mode;
+	php_socket *php_sock;
+	int arg;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rll", &zsocket, &group, &mode) == FAILURE) {
+		return;
+	}
+
+	if ((php_sock = prnl_fetch_socket(zsocket TSRMLS_CC)) == NULL) {
+		RETURN_FALSE;
+	}
+
+	arg = (int) ((group & 0xFFFF) | ((mode & 0xFFFF) << 16));
+
+	if (setsockopt(php_sock->bsd_socket, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0) {
+		php_sock->error = errno;
+		RETURN_FALSE;
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
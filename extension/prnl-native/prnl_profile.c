@@ -0,0 +1,234 @@
+/*
+ * PRNL Native Extension - hot path profiler
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "php.h"
+#include "php_ini.h"
+#include "php_prnl_native.h"
+
+/*
+ * With prnlnative.profile=1 the executor hooks are replaced by wrappers that
+ * count the calls and the inclusive wall time of every function and method,
+ * user code (Memory, the protocol classes) and internal functions (the native
+ * classes, sockets) alike. With the setting off the hooks are never installed,
+ * so profiling costs nothing.
+ */
+
+typedef struct {
+	char *name;
+	unsigned long calls;
+	uint64_t ns;
+} prnl_profile_entry;
+
+//keyed by the opcodes of a user function (shared by closure copies) or the internal function
+static HashTable prnl_profile_table;
+static int prnl_profile_enabled = 0;
+
+static void (*prnl_original_execute)(zend_op_array *op_array TSRMLS_DC);
+static void (*prnl_original_execute_internal)(zend_execute_data *execute_data_ptr, int return_value_used TSRMLS_DC);
+
+static inline uint64_t prnl_profile_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void prnl_profile_entry_dtor(void *data)
+{
+	pefree(((prnl_profile_entry *) data)->name, 1);
+}
+
+/*
+ * Entries live until the next request, reset only zeroes them, so the
+ * pointer held by a running call stays valid.
+ */
+static prnl_profile_entry *prnl_profile_get(ulong key, zend_class_entry *scope, const char *function_name)
+{
+	prnl_profile_entry entry, *found;
+	char name[256];
+
+	if (zend_hash_index_find(&prnl_profile_table, key, (void **) &found) == SUCCESS) {
+		return found;
+	}
+
+	if (scope) {
+		snprintf(name, sizeof(name), "%s::%s", scope->name, function_name);
+	}
+	else {
+		snprintf(name, sizeof(name), "%s", function_name);
+	}
+
+	entry.name = pestrdup(name, 1);
+	entry.calls = 0;
+	entry.ns = 0;
+
+	zend_hash_index_update(&prnl_profile_table, key, &entry, sizeof(entry), (void **) &found);
+
+	return found;
+}
+
+static void prnl_profile_execute(zend_op_array *op_array TSRMLS_DC)
+{
+	prnl_profile_entry *entry;
+	uint64_t start;
+
+	//the main script and included files
+	if (!op_array->function_name) {
+		prnl_original_execute(op_array TSRMLS_CC);
+		return;
+	}
+
+	entry = prnl_profile_get((ulong) op_array->opcodes, op_array->scope, op_array->function_name);
+
+	start = prnl_profile_now();
+	prnl_original_execute(op_array TSRMLS_CC);
+
+	entry->calls++;
+	entry->ns += prnl_profile_now() - start;
+}
+
+static void prnl_profile_execute_internal(zend_execute_data *execute_data_ptr, int return_value_used TSRMLS_DC)
+{
+	zend_function *function = execute_data_ptr->function_state.function;
+	prnl_profile_entry *entry;
+	uint64_t start;
+
+	entry = prnl_profile_get((ulong) function, function->common.scope, function->common.function_name);
+
+	start = prnl_profile_now();
+
+	if (prnl_original_execute_internal) {
+		prnl_original_execute_internal(execute_data_ptr, return_value_used TSRMLS_CC);
+	}
+	else {
+		execute_internal(execute_data_ptr, return_value_used TSRMLS_CC);
+	}
+
+	entry->calls++;
+	entry->ns += prnl_profile_now() - start;
+}
+
+int prnl_profile_minit(int module_number TSRMLS_DC)
+{
+	if (!INI_BOOL("prnlnative.profile")) {
+		return SUCCESS;
+	}
+
+	zend_hash_init(&prnl_profile_table, 64, NULL, prnl_profile_entry_dtor, 1);
+
+	prnl_original_execute = zend_execute;
+	zend_execute = prnl_profile_execute;
+
+	prnl_original_execute_internal = zend_execute_internal;
+	zend_execute_internal = prnl_profile_execute_internal;
+
+	prnl_profile_enabled = 1;
+
+	return SUCCESS;
+}
+
+int prnl_profile_mshutdown(int module_number TSRMLS_DC)
+{
+	if (prnl_profile_enabled) {
+		zend_execute = prnl_original_execute;
+		zend_execute_internal = prnl_original_execute_internal;
+
+		zend_hash_destroy(&prnl_profile_table);
+		prnl_profile_enabled = 0;
+	}
+
+	return SUCCESS;
+}
+
+int prnl_profile_rinit(TSRMLS_D)
+{
+	//the op arrays of the previous request are gone, and so are their keys
+	if (prnl_profile_enabled) {
+		zend_hash_clean(&prnl_profile_table);
+	}
+
+	return SUCCESS;
+}
+
+/* {{{ proto array prnl_profile_dump([bool reset])
+   Return calls and inclusive nanoseconds per function, false when prnlnative.profile is off */
+PHP_FUNCTION(prnl_profile_dump)
+{
+	zend_bool reset = 0;
+	HashPosition pos;
+	prnl_profile_entry *entry;
+	zval **zfound, *zentry;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|b", &reset) == FAILURE) {
+		return;
+	}
+
+	if (!prnl_profile_enabled) {
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+
+	for (zend_hash_internal_pointer_reset_ex(&prnl_profile_table, &pos);
+		zend_hash_get_current_data_ex(&prnl_profile_table, (void **) &entry, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&prnl_profile_table, &pos)) {
+
+		if (entry->calls == 0) {
+			continue;
+		}
+
+		//closures and functions of the same name are reported together
+		if (zend_symtable_find(Z_ARRVAL_P(return_value), entry->name, strlen(entry->name) + 1, (void **) &zfound) == SUCCESS) {
+			zval **zcalls, **zns;
+
+			zend_hash_find(Z_ARRVAL_PP(zfound), "calls", sizeof("calls"), (void **) &zcalls);
+			zend_hash_find(Z_ARRVAL_PP(zfound), "ns", sizeof("ns"), (void **) &zns);
+
+			Z_LVAL_PP(zcalls) += entry->calls;
+			Z_LVAL_PP(zns) += (long) entry->ns;
+		}
+		else {
+			MAKE_STD_ZVAL(zentry);
+			array_init(zentry);
+			add_assoc_long(zentry, "calls", entry->calls);
+			add_assoc_long(zentry, "ns", (long) entry->ns);
+
+			add_assoc_zval(return_value, entry->name, zentry);
+		}
+
+		if (reset) {
+			entry->calls = 0;
+			entry->ns = 0;
+		}
+	}
+}
+/* }}} */
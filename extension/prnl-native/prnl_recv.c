@@ -0,0 +1,236 @@
+/*
+ * PRNL Native Extension - receiving with control messages
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <stdint.h>
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+
+#include "php.h"
+#include "php_prnl_native.h"
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+#ifndef SO_TIMESTAMPNS
+#define SO_TIMESTAMPNS 35
+#endif
+
+#ifndef SCM_TIMESTAMPNS
+#define SCM_TIMESTAMPNS SO_TIMESTAMPNS
+#endif
+
+#define PRNL_CONTROL_SIZE 256
+
+//largest IPv4 packet, also keeps length * PRNL_BATCH_SIZE far from overflowing
+#define PRNL_RECV_MAX_LENGTH 65535
+
+//buffers of prnl_recvmmsg, kept between calls so a batch doesn't allocate megabytes every time
+static char *prnl_recv_buffer = NULL;
+static size_t prnl_recv_buffer_size = 0;
+static char prnl_recv_control[PRNL_BATCH_SIZE][PRNL_CONTROL_SIZE];
+static struct sockaddr_storage prnl_recv_names[PRNL_BATCH_SIZE];
+
+int prnl_recv_mshutdown(int module_number TSRMLS_DC)
+{
+	if (prnl_recv_buffer) {
+		pefree(prnl_recv_buffer, 1);
+		prnl_recv_buffer = NULL;
+		prnl_recv_buffer_size = 0;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ * Add the control messages the caller enabled on the socket to the result
+ */
+static void prnl_parse_control(zval *result, struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+	struct timespec ts;
+	struct in_pktinfo pktinfo;
+	char addr[INET_ADDRSTRLEN];
+	uint32_t drops;
+
+	//packet sockets tell the interface in the source address
+	if (msg->msg_namelen >= sizeof(struct sockaddr_ll) && ((struct sockaddr *) msg->msg_name)->sa_family == AF_PACKET) {
+		add_assoc_long(result, "ifindex", ((struct sockaddr_ll *) msg->msg_name)->sll_ifindex);
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+			memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+			add_assoc_long(result, "drops", (long) drops);
+		}
+		else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			//kernel receive time, nanoseconds on CLOCK_REALTIME
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			add_assoc_long(result, "timestamp", (long) ts.tv_sec * 1000000000L + ts.tv_nsec);
+		}
+		else if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+			//ipi_addr is the destination address of the header, ipi_spec_dst the local address
+			memcpy(&pktinfo, CMSG_DATA(cmsg), sizeof(pktinfo));
+			add_assoc_long(result, "ifindex", pktinfo.ipi_ifindex);
+
+			if (inet_ntop(AF_INET, &pktinfo.ipi_addr, addr, sizeof(addr)) != NULL) {
+				add_assoc_string(result, "dst", addr, 1);
+			}
+		}
+	}
+}
+
+/* {{{ proto array prnl_recvmsg(resource socket, int length [, int flags])
+   Receive one packet with recvmsg, returns array('data' => ..., <control messages>) */
+PHP_FUNCTION(prnl_recvmsg)
+{
+	zval *zsocket;
+	long length, flags = 0;
+	php_socket *php_sock;
+	struct msghdr msg;
+	struct iovec iov;
+	struct sockaddr_storage name;
+	char control[PRNL_CONTROL_SIZE];
+	char *buffer;
+	ssize_t received;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rl|l", &zsocket, &length, &flags) == FAILURE) {
+		return;
+	}
+
+	if ((php_sock = prnl_fetch_socket(zsocket TSRMLS_CC)) == NULL) {
+		RETURN_FALSE;
+	}
+
+	if (length < 1 || length > PRNL_RECV_MAX_LENGTH) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Length must be between 1 and %d", PRNL_RECV_MAX_LENGTH);
+		RETURN_FALSE;
+	}
+
+	buffer = emalloc(length);
+
+	iov.iov_base = buffer;
+	iov.iov_len = length;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &name;
+	msg.msg_namelen = sizeof(name);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	received = recvmsg(php_sock->bsd_socket, &msg, (int) flags);
+
+	if (received < 0) {
+		php_sock->error = errno;
+		efree(buffer);
+		RETURN_FALSE;
+	}
+
+	//copy, a buffer of the full length would stay allocated as long as the packet lives
+	array_init(return_value);
+	add_assoc_stringl(return_value, "data", buffer, received, 1);
+	efree(buffer);
+
+	prnl_parse_control(return_value, &msg);
+}
+/* }}} */
+
+/* {{{ proto array prnl_recvmmsg(resource socket, int length, int max [, int flags])
+   Receive up to max packets with one recvmmsg call, every packet as prnl_recvmsg returns it.
+   Waits for the first packet only (MSG_WAITFORONE), unless other flags are given. */
+PHP_FUNCTION(prnl_recvmmsg)
+{
+	zval *zsocket, *zpacket;
+	long length, max, flags = MSG_WAITFORONE;
+	php_socket *php_sock;
+	struct mmsghdr msgs[PRNL_BATCH_SIZE];
+	struct iovec iovs[PRNL_BATCH_SIZE];
+	int i, received;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rll|l", &zsocket, &length, &max, &flags) == FAILURE) {
+		return;
+	}
+
+	if ((php_sock = prnl_fetch_socket(zsocket TSRMLS_CC)) == NULL) {
+		RETURN_FALSE;
+	}
+
+	if (length < 1 || length > PRNL_RECV_MAX_LENGTH || max < 1) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Length must be between 1 and %d and max positive", PRNL_RECV_MAX_LENGTH);
+		RETURN_FALSE;
+	}
+
+	if (max > PRNL_BATCH_SIZE) {
+		max = PRNL_BATCH_SIZE;
+	}
+
+	if (prnl_recv_buffer_size < (size_t) (length * max)) {
+		prnl_recv_buffer = perealloc(prnl_recv_buffer, length * max, 1);
+		prnl_recv_buffer_size = length * max;
+	}
+
+	memset(msgs, 0, sizeof(struct mmsghdr) * max);
+
+	for (i = 0; i < max; i++) {
+		iovs[i].iov_base = prnl_recv_buffer + i * length;
+		iovs[i].iov_len = length;
+
+		msgs[i].msg_hdr.msg_name = &prnl_recv_names[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(prnl_recv_names[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = prnl_recv_control[i];
+		msgs[i].msg_hdr.msg_controllen = PRNL_CONTROL_SIZE;
+	}
+
+	received = recvmmsg(php_sock->bsd_socket, msgs, (unsigned int) max, (int) flags, NULL);
+
+	if (received < 0) {
+		php_sock->error = errno;
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+
+	for (i = 0; i < received; i++) {
+		MAKE_STD_ZVAL(zpacket);
+		array_init(zpacket);
+		add_assoc_stringl(zpacket, "data", (char *) iovs[i].iov_base, msgs[i].msg_len, 1);
+
+		prnl_parse_control(zpacket, &msgs[i].msg_hdr);
+
+		add_next_index_zval(return_value, zpacket);
+	}
+}
+/* }}} */
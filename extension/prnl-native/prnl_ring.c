@@ -0,0 +1,308 @@
+/*
+ * PRNL Native Extension - shared memory ring
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "php.h"
+#include "php_prnl_native.h"
+
+/*
+ * Single producer / single consumer ring in a SysV shared memory segment.
+ * The layout is shared with the shmop fallback in SharedRing:
+ *
+ *   0    magic, capacity
+ *   64   head (only written by the producer)
+ *   128  tail (only written by the consumer)
+ *   192  data, records of a 32 bit length followed by the payload padded
+ *        to 4 bytes. A length of PRNL_RING_WRAP means continue at the start.
+ *
+ * Head and tail are free running 32 bit counters on their own cache line.
+ */
+#define PRNL_RING_MAGIC       0x524E5250
+#define PRNL_RING_HEAD        64
+#define PRNL_RING_TAIL        128
+#define PRNL_RING_HEADER_SIZE 192
+#define PRNL_RING_WRAP        0xFFFFFFFF
+
+#define PRNL_RING_RES_NAME "PRNL Ring"
+
+#define PRNL_RING_ALIGN(len) (((len) + 3) & ~3)
+
+typedef struct _prnl_ring {
+	char *base;
+	char *data;
+	uint32_t capacity;
+	uint32_t mask;
+	volatile uint32_t *head;
+	volatile uint32_t *tail;
+} prnl_ring;
+
+static int le_prnl_ring;
+
+static void prnl_ring_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	prnl_ring *ring = (prnl_ring *) rsrc->ptr;
+
+	shmdt(ring->base);
+	efree(ring);
+}
+
+int prnl_ring_minit(int module_number TSRMLS_DC)
+{
+	le_prnl_ring = zend_register_list_destructors_ex(prnl_ring_dtor, NULL, PRNL_RING_RES_NAME, module_number);
+
+	return SUCCESS;
+}
+
+static int prnl_ring_push_one(prnl_ring *ring, const char *packet, uint32_t len)
+{
+	uint32_t head, tail, pos, contig, rec, need;
+
+	rec = 4 + PRNL_RING_ALIGN(len);
+	head = *ring->head;
+	tail = __atomic_load_n(ring->tail, __ATOMIC_ACQUIRE);
+
+	pos = head & ring->mask;
+	contig = ring->capacity - pos;
+	need = rec > contig ? contig + rec : rec;
+
+	if (need > ring->capacity - (head - tail)) {
+		return FAILURE;
+	}
+
+	if (rec > contig) {
+		*(uint32_t *) (ring->data + pos) = PRNL_RING_WRAP;
+		head += contig;
+		pos = 0;
+	}
+
+	*(uint32_t *) (ring->data + pos) = len;
+	memcpy(ring->data + pos + 4, packet, len);
+
+	//publish the record only after its bytes are written
+	__atomic_store_n(ring->head, head + rec, __ATOMIC_RELEASE);
+
+	return SUCCESS;
+}
+
+/* {{{ proto resource prnl_ring_open(int key, int capacity [, bool create])
+   Attach (and optionally create) a ring, capacity must be a power of two */
+PHP_FUNCTION(prnl_ring_open)
+{
+	long key, capacity;
+	zend_bool create = 1;
+	int shmid;
+	char *base;
+	uint32_t *header;
+	prnl_ring *ring;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ll|b", &key, &capacity, &create) == FAILURE) {
+		return;
+	}
+
+	if (capacity < 64 || capacity > 0x40000000 || (capacity & (capacity - 1)) != 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Ring capacity must be a power of two");
+		RETURN_FALSE;
+	}
+
+	shmid = shmget((key_t) key, PRNL_RING_HEADER_SIZE + capacity, create ? IPC_CREAT | 0600 : 0);
+	if (shmid < 0 || (base = (char *) shmat(shmid, NULL, 0)) == (char *) -1) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to attach ring: %s", strerror(errno));
+		RETURN_FALSE;
+	}
+
+	header = (uint32_t *) base;
+	if (header[0] != PRNL_RING_MAGIC) {
+		if (!create) {
+			shmdt(base);
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Shared memory segment is not a ring");
+			RETURN_FALSE;
+		}
+
+		header[1] = (uint32_t) capacity;
+		*(uint32_t *) (base + PRNL_RING_HEAD) = 0;
+		*(uint32_t *) (base + PRNL_RING_TAIL) = 0;
+		__atomic_store_n(&header[0], PRNL_RING_MAGIC, __ATOMIC_RELEASE);
+	}
+	else if (header[1] != (uint32_t) capacity) {
+		shmdt(base);
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Ring capacity mismatch (%u)", header[1]);
+		RETURN_FALSE;
+	}
+
+	ring = (prnl_ring *) emalloc(sizeof(prnl_ring));
+	ring->base = base;
+	ring->data = base + PRNL_RING_HEADER_SIZE;
+	ring->capacity = (uint32_t) capacity;
+	ring->mask = (uint32_t) capacity - 1;
+	ring->head = (volatile uint32_t *) (base + PRNL_RING_HEAD);
+	ring->tail = (volatile uint32_t *) (base + PRNL_RING_TAIL);
+
+	ZEND_REGISTER_RESOURCE(return_value, ring, le_prnl_ring);
+}
+/* }}} */
+
+/* {{{ proto bool prnl_ring_push(resource ring, string packet)
+   Append one packet, returns false when the ring is full */
+PHP_FUNCTION(prnl_ring_push)
+{
+	zval *zring;
+	char *packet;
+	int packet_len;
+	prnl_ring *ring;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rs", &zring, &packet, &packet_len) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(ring, prnl_ring *, &zring, -1, PRNL_RING_RES_NAME, le_prnl_ring);
+
+	//a record over half the ring may never fit next to the wrap point, even in an empty ring
+	if (4 + PRNL_RING_ALIGN((uint32_t) packet_len) > ring->capacity / 2) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Packet is larger than half the ring");
+		RETURN_FALSE;
+	}
+
+	RETURN_BOOL(prnl_ring_push_one(ring, packet, (uint32_t) packet_len) == SUCCESS);
+}
+/* }}} */
+
+/* {{{ proto int prnl_ring_push_batch(resource ring, array packets)
+   Append packets until the ring is full, returns the number appended */
+PHP_FUNCTION(prnl_ring_push_batch)
+{
+	zval *zring, *zpackets, **zpacket;
+	HashPosition pos;
+	prnl_ring *ring;
+	long pushed = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ra", &zring, &zpackets) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(ring, prnl_ring *, &zring, -1, PRNL_RING_RES_NAME, le_prnl_ring);
+
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(zpackets), &pos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(zpackets), (void **) &zpacket, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(zpackets), &pos)) {
+		convert_to_string_ex(zpacket);
+
+		if (4 + PRNL_RING_ALIGN((uint32_t) Z_STRLEN_PP(zpacket)) > ring->capacity / 2) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Packet %ld is larger than half the ring", pushed);
+			break;
+		}
+
+		if (prnl_ring_push_one(ring, Z_STRVAL_PP(zpacket), (uint32_t) Z_STRLEN_PP(zpacket)) == FAILURE) {
+			break;
+		}
+
+		pushed++;
+	}
+
+	RETURN_LONG(pushed);
+}
+/* }}} */
+
+/* {{{ proto array prnl_ring_pop(resource ring [, int max])
+   Take up to max packets of the ring */
+PHP_FUNCTION(prnl_ring_pop)
+{
+	zval *zring;
+	long max = 1, popped = 0;
+	prnl_ring *ring;
+	uint32_t head, tail, pos, len;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r|l", &zring, &max) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(ring, prnl_ring *, &zring, -1, PRNL_RING_RES_NAME, le_prnl_ring);
+
+	array_init(return_value);
+
+	tail = *ring->tail;
+	head = __atomic_load_n(ring->head, __ATOMIC_ACQUIRE);
+
+	while (tail != head && popped < max) {
+		pos = tail & ring->mask;
+		len = *(uint32_t *) (ring->data + pos);
+
+		if (len == PRNL_RING_WRAP) {
+			tail += ring->capacity - pos;
+			continue;
+		}
+
+		add_next_index_stringl(return_value, ring->data + pos + 4, len, 1);
+		tail += 4 + PRNL_RING_ALIGN(len);
+		popped++;
+	}
+
+	//the bytes are copied, hand the space back to the producer
+	__atomic_store_n(ring->tail, tail, __ATOMIC_RELEASE);
+}
+/* }}} */
+
+/* {{{ proto array prnl_ring_stats(resource ring)
+   Return the used and total bytes of the ring */
+PHP_FUNCTION(prnl_ring_stats)
+{
+	zval *zring;
+	prnl_ring *ring;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zring) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(ring, prnl_ring *, &zring, -1, PRNL_RING_RES_NAME, le_prnl_ring);
+
+	array_init(return_value);
+	add_assoc_long(return_value, "used", (long) (__atomic_load_n(ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(ring->tail, __ATOMIC_ACQUIRE)));
+	add_assoc_long(return_value, "capacity", (long) ring->capacity);
+}
+/* }}} */
+
+/* {{{ proto bool prnl_ring_close(resource ring)
+   Detach the ring */
+PHP_FUNCTION(prnl_ring_close)
+{
+	zval *zring;
+	prnl_ring *ring;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zring) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(ring, prnl_ring *, &zring, -1, PRNL_RING_RES_NAME, le_prnl_ring);
+
+	zend_list_delete(Z_LVAL_P(zring));
+
+	RETURN_TRUE;
+}
+/* }}} */
@@ -0,0 +1,363 @@
+/*
+ * PRNL Native Extension - segmentation offload and fragmentation
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "php.h"
+#include "ext/standard/php_rand.h"
+#include "php_prnl_native.h"
+
+#define PRNL_TCP_FIN 0x01
+#define PRNL_TCP_PSH 0x08
+#define PRNL_TCP_CWR 0x80
+
+static inline uint16_t prnl_get16(const unsigned char *p)
+{
+	return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+static inline void prnl_put16(unsigned char *p, uint16_t value)
+{
+	p[0] = value >> 8;
+	p[1] = value & 0xFF;
+}
+
+static inline void prnl_put32(unsigned char *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = (value >> 16) & 0xFF;
+	p[2] = (value >> 8) & 0xFF;
+	p[3] = value & 0xFF;
+}
+
+/*
+ * Add data to a ones' complement sum, the result is folded to 16 bits
+ * but not inverted so it can be continued
+ */
+uint32_t prnl_csum_partial(const unsigned char *data, size_t length, uint32_t sum)
+{
+	uint64_t total = sum;
+
+	while (length > 1) {
+		total += (data[0] << 8) | data[1];
+		data += 2;
+		length -= 2;
+	}
+
+	if (length) {
+		total += data[0] << 8;
+	}
+
+	while (total >> 16) {
+		total = (total & 0xFFFF) + (total >> 16);
+	}
+
+	return (uint32_t) total;
+}
+
+uint16_t prnl_csum_finish(uint32_t sum)
+{
+	while (sum >> 16) {
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+
+	return (uint16_t) (~sum & 0xFFFF);
+}
+
+/*
+ * Split a IPv4 TCP/UDP packet in packets of at most mss payload bytes,
+ * the packets are added to result
+ */
+int prnl_gso_segment_ex(zval *result, const unsigned char *packet, size_t packet_len, long mss TSRMLS_DC)
+{
+	unsigned char *segment, *l4;
+	size_t ip_len, l4_len, header_len, payload_len, offset, chunk, total;
+	uint32_t pseudo, seq = 0;
+	uint16_t id, csum;
+	int protocol;
+
+	if (mss < 1) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "MSS must be positive");
+		return FAILURE;
+	}
+
+	ip_len = packet_len > 0 ? (packet[0] & 0x0F) * 4 : 0;
+	if (ip_len < 20 || packet_len < ip_len) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Invalid IPv4 packet");
+		return FAILURE;
+	}
+
+	protocol = packet[9];
+	if (protocol == IPPROTO_TCP) {
+		//a packet too short for the data offset fails the header check below
+		l4_len = packet_len >= ip_len + 20 ? (packet[ip_len + 12] >> 4) * 4 : 0;
+	}
+	else if (protocol == IPPROTO_UDP) {
+		l4_len = 8;
+	}
+	else {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Only TCP and UDP packets can be segmented");
+		return FAILURE;
+	}
+
+	//the flags and checksum of every TCP segment are patched, so the full 20 byte header must be there
+	header_len = ip_len + l4_len;
+	if (l4_len < (protocol == IPPROTO_TCP ? 20 : 8) || packet_len < header_len) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Invalid %s header", protocol == IPPROTO_TCP ? "TCP" : "UDP");
+		return FAILURE;
+	}
+
+	if (protocol == IPPROTO_TCP) {
+		seq = ((uint32_t) packet[ip_len + 4] << 24) | (packet[ip_len + 5] << 16) | (packet[ip_len + 6] << 8) | packet[ip_len + 7];
+	}
+
+	payload_len = packet_len - header_len;
+	id = prnl_get16(packet + 4);
+
+	//src and dst address and the protocol of the pseudo header, the length differs per segment
+	pseudo = prnl_csum_partial(packet + 12, 8, protocol);
+
+	array_init(result);
+
+	offset = 0;
+	do {
+		chunk = payload_len - offset < (size_t) mss ? payload_len - offset : (size_t) mss;
+		total = header_len + chunk;
+
+		segment = emalloc(total + 1);
+		memcpy(segment, packet, header_len);
+		memcpy(segment + header_len, packet + header_len + offset, chunk);
+		segment[total] = '\0';
+
+		prnl_put16(segment + 2, (uint16_t) total);
+		prnl_put16(segment + 4, id++);
+		prnl_put16(segment + 10, 0);
+		prnl_put16(segment + 10, prnl_csum_finish(prnl_csum_partial(segment, ip_len, 0)));
+
+		l4 = segment + ip_len;
+		if (protocol == IPPROTO_TCP) {
+			prnl_put32(l4 + 4, seq + (uint32_t) offset);
+
+			//like the kernel: CWR only on the first, FIN and PSH only on the last segment
+			if (offset > 0) {
+				l4[13] &= ~PRNL_TCP_CWR;
+			}
+			if (offset + chunk < payload_len) {
+				l4[13] &= ~(PRNL_TCP_FIN | PRNL_TCP_PSH);
+			}
+
+			prnl_put16(l4 + 16, 0);
+			csum = prnl_csum_finish(prnl_csum_partial(l4, l4_len + chunk, pseudo + l4_len + chunk));
+			prnl_put16(l4 + 16, csum);
+		}
+		else {
+			prnl_put16(l4 + 4, (uint16_t) (l4_len + chunk));
+			prnl_put16(l4 + 6, 0);
+			csum = prnl_csum_finish(prnl_csum_partial(l4, l4_len + chunk, pseudo + l4_len + chunk));
+			prnl_put16(l4 + 6, csum == 0 ? 0xFFFF : csum);
+		}
+
+		add_next_index_stringl(result, (char *) segment, total, 0);
+
+		offset += chunk;
+	} while (offset < payload_len);
+
+	return SUCCESS;
+}
+
+/* {{{ proto array prnl_gso_segment(string packet, int mss)
+   Split a IPv4 TCP/UDP packet in packets of at most mss payload bytes */
+PHP_FUNCTION(prnl_gso_segment)
+{
+	char *packet;
+	int packet_len;
+	long mss;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "sl", &packet, &packet_len, &mss) == FAILURE) {
+		return;
+	}
+
+	if (prnl_gso_segment_ex(return_value, (unsigned char *) packet, packet_len, mss TSRMLS_CC) == FAILURE) {
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+/*
+ * Build the header of the fragments after the first: only the options with
+ * the copy bit set (RFC 791) are kept, padded to a multiple of 4 bytes.
+ * Returns the header length.
+ */
+static size_t prnl_ip_later_header(unsigned char *header, const unsigned char *packet, size_t ip_len)
+{
+	size_t i = 20, len = 20, option_len;
+
+	memcpy(header, packet, 20);
+
+	while (i < ip_len && packet[i] != 0) {
+		//no operation, no copy bit
+		if (packet[i] == 1) {
+			i++;
+			continue;
+		}
+
+		option_len = i + 1 < ip_len ? packet[i + 1] : 0;
+		if (option_len < 2 || i + option_len > ip_len) {
+			break;
+		}
+
+		if (packet[i] & 0x80) {
+			memcpy(header + len, packet + i, option_len);
+			len += option_len;
+		}
+		i += option_len;
+	}
+
+	while (len & 3) {
+		header[len++] = 0;
+	}
+	header[0] = (packet[0] & 0xF0) | (unsigned char) (len / 4);
+
+	return len;
+}
+
+/*
+ * Split a IPv4 packet in fragments of at most mtu bytes, the fragments
+ * are added to result
+ */
+int prnl_ip_fragment_ex(zval *result, const unsigned char *packet, size_t packet_len, long mtu TSRMLS_DC)
+{
+	unsigned char *fragment, later[60];
+	const unsigned char *header;
+	size_t ip_len, later_len, header_len, payload_len, max_payload, later_max, offset, chunk, total;
+	uint16_t field, base, id;
+	int more;
+
+	ip_len = packet_len > 0 ? (packet[0] & 0x0F) * 4 : 0;
+	if (ip_len < 20 || packet_len < ip_len) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Invalid IPv4 packet");
+		return FAILURE;
+	}
+
+	//fragment offsets count in 8 byte units
+	max_payload = mtu > (long) ip_len ? (mtu - ip_len) & ~7 : 0;
+	if (max_payload == 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "MTU too small for the IP header");
+		return FAILURE;
+	}
+
+	field = prnl_get16(packet + 6);
+	if (field & 0x4000 && packet_len > (size_t) mtu) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Packet exceeds the MTU and has the don't fragment flag set");
+		return FAILURE;
+	}
+
+	//a fragment can be fragmented again, keep its offset and more fragments flag
+	base = field & 0x1FFF;
+	more = field & 0x2000;
+	payload_len = packet_len - ip_len;
+
+	//the kernel gives every fragment sent with ID 0 an ID of its own, so they would never reassemble
+	id = prnl_get16(packet + 4);
+	if (id == 0) {
+		id = (uint16_t) (php_rand(TSRMLS_C) % 0xFFFF + 1);
+	}
+
+	later_len = prnl_ip_later_header(later, packet, ip_len);
+	later_max = (mtu - later_len) & ~7;
+
+	array_init(result);
+
+	offset = 0;
+	do {
+		header = offset == 0 ? packet : later;
+		header_len = offset == 0 ? ip_len : later_len;
+
+		chunk = offset == 0 ? max_payload : later_max;
+		if (payload_len - offset < chunk) {
+			chunk = payload_len - offset;
+		}
+		total = header_len + chunk;
+
+		fragment = emalloc(total + 1);
+		memcpy(fragment, header, header_len);
+		memcpy(fragment + header_len, packet + ip_len + offset, chunk);
+		fragment[total] = '\0';
+
+		field = (base + offset / 8) & 0x1FFF;
+		if (offset + chunk < payload_len || more) {
+			field |= 0x2000;
+		}
+
+		prnl_put16(fragment + 2, (uint16_t) total);
+		prnl_put16(fragment + 4, id);
+		prnl_put16(fragment + 6, field);
+		prnl_put16(fragment + 10, 0);
+		prnl_put16(fragment + 10, prnl_csum_finish(prnl_csum_partial(fragment, header_len, 0)));
+
+		add_next_index_stringl(result, (char *) fragment, total, 0);
+
+		offset += chunk;
+	} while (offset < payload_len);
+
+	return SUCCESS;
+}
+
+/* {{{ proto array prnl_ip_fragment(string packet, int mtu)
+   Split a IPv4 packet in fragments of at most mtu bytes */
+PHP_FUNCTION(prnl_ip_fragment)
+{
+	char *packet;
+	int packet_len;
+	long mtu;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "sl", &packet, &packet_len, &mtu) == FAILURE) {
+		return;
+	}
+
+	if (prnl_ip_fragment_ex(return_value, (unsigned char *) packet, packet_len, mtu TSRMLS_CC) == FAILURE) {
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+/* {{{ proto int prnl_checksum(string data [, int sum])
+   Internet checksum of data, continuing a partial sum (e.g. a pseudo header) when given */
+PHP_FUNCTION(prnl_checksum)
+{
+	char *data;
+	int data_len;
+	long sum = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|l", &data, &data_len, &sum) == FAILURE) {
+		return;
+	}
+
+	RETURN_LONG(prnl_csum_finish(prnl_csum_partial((unsigned char *) data, data_len, (uint32_t) sum)));
+}
+/* }}} */
@@ -0,0 +1,212 @@
+/*
+ * PRNL Native Extension - batched sending
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "php.h"
+#include "php_prnl_native.h"
+
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#endif
+
+#ifndef SCM_TXTIME
+#define SCM_TXTIME SO_TXTIME
+#endif
+
+//same layout as struct sock_txtime in linux/net_tstamp.h
+struct prnl_sock_txtime {
+	clockid_t clockid;
+	uint32_t flags;
+};
+
+/* {{{ proto bool prnl_socket_set_txtime(resource socket, int clockid [, int flags])
+   Enable SO_TXTIME on the socket so packets can carry a launch time */
+PHP_FUNCTION(prnl_socket_set_txtime)
+{
+	zval *zsocket;
+	long clockid, flags = 0;
+	php_socket *php_sock;
+	struct prnl_sock_txtime txtime;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rl|l", &zsocket, &clockid, &flags) == FAILURE) {
+		return;
+	}
+
+	if ((php_sock = prnl_fetch_socket(zsocket TSRMLS_CC)) == NULL) {
+		RETURN_FALSE;
+	}
+
+	txtime.clockid = (clockid_t) clockid;
+	txtime.flags = (uint32_t) flags;
+
+	if (setsockopt(php_sock->bsd_socket, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) < 0) {
+		php_sock->error = errno;
+		RETURN_FALSE;
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto int prnl_sendmmsg(resource socket, array packets, array addresses [, array launchTimes])
+   Send a batch of packets with sendmmsg. When launch times are given every packet carries
+   a SCM_TXTIME control message. Returns the number of packets handed to the kernel. */
+PHP_FUNCTION(prnl_sendmmsg)
+{
+	zval *zsocket, *zpackets, *zaddrs, *ztimes = NULL;
+	zval **zpacket, **zaddr, **ztime, ztimecopy;
+	HashPosition ppos, apos, tpos;
+	php_socket *php_sock;
+	struct mmsghdr msgs[PRNL_BATCH_SIZE];
+	struct iovec iovs[PRNL_BATCH_SIZE];
+	struct sockaddr_in addrs[PRNL_BATCH_SIZE];
+	char cmsgbufs[PRNL_BATCH_SIZE][CMSG_SPACE(sizeof(uint64_t))];
+	struct cmsghdr *cmsg;
+	uint64_t launchTime;
+	long sent = 0;
+	int count, done, ret;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "raa|a!", &zsocket, &zpackets, &zaddrs, &ztimes) == FAILURE) {
+		return;
+	}
+
+	if ((php_sock = prnl_fetch_socket(zsocket TSRMLS_CC)) == NULL) {
+		RETURN_FALSE;
+	}
+
+	if (zend_hash_num_elements(Z_ARRVAL_P(zaddrs)) != zend_hash_num_elements(Z_ARRVAL_P(zpackets))
+		|| (ztimes && zend_hash_num_elements(Z_ARRVAL_P(ztimes)) != zend_hash_num_elements(Z_ARRVAL_P(zpackets)))) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Every packet needs an address (and launch time)");
+		RETURN_FALSE;
+	}
+
+	//check everything up front, a bad entry in a later batch must not leave earlier ones sent,
+	//and nothing is converted in place so the caller's arrays stay untouched
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(zpackets), &ppos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(zpackets), (void **) &zpacket, &ppos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(zpackets), &ppos)) {
+		if (Z_TYPE_PP(zpacket) != IS_STRING) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Packets must be strings");
+			RETURN_FALSE;
+		}
+	}
+
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(zaddrs), &apos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(zaddrs), (void **) &zaddr, &apos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(zaddrs), &apos)) {
+		if (Z_TYPE_PP(zaddr) != IS_STRING) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Addresses must be strings");
+			RETURN_FALSE;
+		}
+
+		if (inet_pton(AF_INET, Z_STRVAL_PP(zaddr), &addrs[0].sin_addr) != 1) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Invalid address '%s'", Z_STRVAL_PP(zaddr));
+			RETURN_FALSE;
+		}
+	}
+
+	zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(zpackets), &ppos);
+	zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(zaddrs), &apos);
+	if (ztimes) {
+		zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(ztimes), &tpos);
+	}
+
+	do {
+		memset(msgs, 0, sizeof(msgs));
+
+		for (count = 0; count < PRNL_BATCH_SIZE; count++) {
+			if (zend_hash_get_current_data_ex(Z_ARRVAL_P(zpackets), (void **) &zpacket, &ppos) == FAILURE) {
+				break;
+			}
+			zend_hash_get_current_data_ex(Z_ARRVAL_P(zaddrs), (void **) &zaddr, &apos);
+
+			memset(&addrs[count], 0, sizeof(struct sockaddr_in));
+			addrs[count].sin_family = AF_INET;
+			inet_pton(AF_INET, Z_STRVAL_PP(zaddr), &addrs[count].sin_addr);
+
+			iovs[count].iov_base = Z_STRVAL_PP(zpacket);
+			iovs[count].iov_len = Z_STRLEN_PP(zpacket);
+
+			msgs[count].msg_hdr.msg_name = &addrs[count];
+			msgs[count].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			msgs[count].msg_hdr.msg_iov = &iovs[count];
+			msgs[count].msg_hdr.msg_iovlen = 1;
+
+			if (ztimes) {
+				zend_hash_get_current_data_ex(Z_ARRVAL_P(ztimes), (void **) &ztime, &tpos);
+				ztimecopy = **ztime;
+				zval_copy_ctor(&ztimecopy);
+				convert_to_long(&ztimecopy);
+				launchTime = (uint64_t) Z_LVAL(ztimecopy);
+
+				msgs[count].msg_hdr.msg_control = cmsgbufs[count];
+				msgs[count].msg_hdr.msg_controllen = sizeof(cmsgbufs[count]);
+
+				cmsg = CMSG_FIRSTHDR(&msgs[count].msg_hdr);
+				cmsg->cmsg_level = SOL_SOCKET;
+				cmsg->cmsg_type = SCM_TXTIME;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+				memcpy(CMSG_DATA(cmsg), &launchTime, sizeof(uint64_t));
+
+				zend_hash_move_forward_ex(Z_ARRVAL_P(ztimes), &tpos);
+			}
+
+			zend_hash_move_forward_ex(Z_ARRVAL_P(zpackets), &ppos);
+			zend_hash_move_forward_ex(Z_ARRVAL_P(zaddrs), &apos);
+		}
+
+		//the kernel may accept only part of a batch, push the rest after it
+		for (done = 0; done < count; done += ret) {
+			ret = sendmmsg(php_sock->bsd_socket, msgs + done, count - done, 0);
+
+			if (ret < 0) {
+				if (errno == EINTR) {
+					ret = 0;
+					continue;
+				}
+
+				php_sock->error = errno;
+
+				if (sent + done == 0) {
+					RETURN_FALSE;
+				}
+				RETURN_LONG(sent + done);
+			}
+		}
+
+		sent += count;
+	} while (count == PRNL_BATCH_SIZE);
+
+	RETURN_LONG(sent);
+}
+/* }}} */
@@ -0,0 +1,96 @@
+/*
+ * PRNL Native Extension - socket statistics
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/sockios.h>
+#include <linux/if_packet.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "php.h"
+#include "php_prnl_native.h"
+
+#ifndef SO_MEMINFO
+#define SO_MEMINFO 55
+#endif
+
+//index of the allocated receive memory in the SO_MEMINFO array
+#define PRNL_MEMINFO_RMEM_ALLOC 0
+#define PRNL_MEMINFO_VARS 9
+
+/* {{{ proto array prnl_socket_stats(resource socket)
+   Return the kernel queue and drop statistics of a socket. PACKET_STATISTICS
+   is reset by the kernel on every read, so packets and drops are deltas. */
+PHP_FUNCTION(prnl_socket_stats)
+{
+	zval *zsocket;
+	php_socket *php_sock;
+	struct stat st;
+	struct tpacket_stats pstats;
+	uint32_t meminfo[PRNL_MEMINFO_VARS];
+	socklen_t len;
+	int value;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zsocket) == FAILURE) {
+		return;
+	}
+
+	if ((php_sock = prnl_fetch_socket(zsocket TSRMLS_CC)) == NULL) {
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+
+	if (fstat(php_sock->bsd_socket, &st) == 0) {
+		add_assoc_long(return_value, "inode", (long) st.st_ino);
+	}
+
+	if (ioctl(php_sock->bsd_socket, SIOCINQ, &value) == 0) {
+		add_assoc_long(return_value, "queued", value);
+	}
+
+	len = sizeof(value);
+	if (getsockopt(php_sock->bsd_socket, SOL_SOCKET, SO_RCVBUF, &value, &len) == 0) {
+		add_assoc_long(return_value, "rcvbuf", value);
+	}
+
+	len = sizeof(meminfo);
+	if (getsockopt(php_sock->bsd_socket, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0) {
+		add_assoc_long(return_value, "rmem", (long) meminfo[PRNL_MEMINFO_RMEM_ALLOC]);
+	}
+
+	if (php_sock->type == AF_PACKET) {
+		len = sizeof(pstats);
+		if (getsockopt(php_sock->bsd_socket, SOL_PACKET, PACKET_STATISTICS, &pstats, &len) == 0) {
+			add_assoc_long(return_value, "packets", (long) pstats.tp_packets);
+			add_assoc_long(return_value, "drops", (long) pstats.tp_drops);
+		}
+	}
+}
+/* }}} */
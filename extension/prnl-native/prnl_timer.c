@@ -0,0 +1,430 @@
+/*
+ * PRNL Native Extension - timer wheel
+ *
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "php.h"
+#include "php_prnl_native.h"
+
+/*
+ * Hashed hierarchical timer wheel, the same layout as TimerWheel:
+ * level 0 has 256 slots of one tick, levels 1-3 have 64 slots each
+ * covering 64 times the range of the level below. A timer goes into the
+ * lowest level that can hold its delay and moves down (cascades) when the
+ * level below wraps. Insert, cancel and reschedule are O(1).
+ *
+ * Timers are nodes in a pool, linked per slot. A timer id is the node
+ * index plus a generation, so a stale id never cancels a reused node.
+ */
+#define PRNL_WHEEL_BITS0  8
+#define PRNL_WHEEL_BITSN  6
+#define PRNL_WHEEL_SIZE0  (1 << PRNL_WHEEL_BITS0)
+#define PRNL_WHEEL_SIZEN  (1 << PRNL_WHEEL_BITSN)
+#define PRNL_WHEEL_LEVELS 4
+#define PRNL_WHEEL_SLOTS  (PRNL_WHEEL_SIZE0 + (PRNL_WHEEL_LEVELS - 1) * PRNL_WHEEL_SIZEN)
+#define PRNL_WHEEL_RANGE  ((uint64_t) 1 << (PRNL_WHEEL_BITS0 + (PRNL_WHEEL_LEVELS - 1) * PRNL_WHEEL_BITSN))
+
+#define PRNL_TIMER_NONE 0xFFFFFFFF
+
+#define PRNL_WHEEL_RES_NAME "PRNL Timer Wheel"
+
+typedef struct _prnl_timer {
+	uint64_t expires;
+	uint32_t prev;
+	uint32_t next;
+	uint32_t slot;
+	uint32_t generation;
+	zval *data;
+} prnl_timer;
+
+typedef struct _prnl_wheel {
+	uint32_t heads[PRNL_WHEEL_SLOTS];
+	prnl_timer *timers;
+	uint32_t size;
+	uint32_t free;
+	uint32_t count;
+	uint64_t current;
+	double resolution;
+} prnl_wheel;
+
+static int le_prnl_wheel;
+
+static void prnl_wheel_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	prnl_wheel *wheel = (prnl_wheel *) rsrc->ptr;
+	uint32_t i;
+
+	for (i = 0; i < wheel->size; i++) {
+		if (wheel->timers[i].slot != PRNL_TIMER_NONE) {
+			zval_ptr_dtor(&wheel->timers[i].data);
+		}
+	}
+
+	efree(wheel->timers);
+	efree(wheel);
+}
+
+int prnl_timer_minit(int module_number TSRMLS_DC)
+{
+	le_prnl_wheel = zend_register_list_destructors_ex(prnl_wheel_dtor, NULL, PRNL_WHEEL_RES_NAME, module_number);
+
+	return SUCCESS;
+}
+
+static uint32_t prnl_wheel_slot(prnl_wheel *wheel, uint64_t expires, uint64_t earliest)
+{
+	uint64_t delta;
+
+	if (expires < earliest) {
+		expires = earliest;
+	}
+
+	delta = expires - wheel->current;
+
+	if (delta < PRNL_WHEEL_SIZE0) {
+		return (uint32_t) (expires & (PRNL_WHEEL_SIZE0 - 1));
+	}
+	if (delta < ((uint64_t) 1 << (PRNL_WHEEL_BITS0 + PRNL_WHEEL_BITSN))) {
+		return PRNL_WHEEL_SIZE0 + (uint32_t) ((expires >> PRNL_WHEEL_BITS0) & (PRNL_WHEEL_SIZEN - 1));
+	}
+	if (delta < ((uint64_t) 1 << (PRNL_WHEEL_BITS0 + 2 * PRNL_WHEEL_BITSN))) {
+		return PRNL_WHEEL_SIZE0 + PRNL_WHEEL_SIZEN + (uint32_t) ((expires >> (PRNL_WHEEL_BITS0 + PRNL_WHEEL_BITSN)) & (PRNL_WHEEL_SIZEN - 1));
+	}
+
+	//beyond the range of the wheel, park it in the last slot and re-evaluate on cascade
+	if (delta >= PRNL_WHEEL_RANGE) {
+		expires = wheel->current + PRNL_WHEEL_RANGE - 1;
+	}
+
+	return PRNL_WHEEL_SIZE0 + 2 * PRNL_WHEEL_SIZEN + (uint32_t) ((expires >> (PRNL_WHEEL_BITS0 + 2 * PRNL_WHEEL_BITSN)) & (PRNL_WHEEL_SIZEN - 1));
+}
+
+/*
+ * A new timer that is already due fires on the next tick. A cascading timer
+ * may still go into the current slot, which advance runs right after cascading.
+ */
+static void prnl_wheel_link(prnl_wheel *wheel, uint32_t index, int cascading)
+{
+	prnl_timer *timer = &wheel->timers[index];
+
+	timer->slot = prnl_wheel_slot(wheel, timer->expires, cascading ? wheel->current : wheel->current + 1);
+	timer->prev = PRNL_TIMER_NONE;
+	timer->next = wheel->heads[timer->slot];
+
+	if (timer->next != PRNL_TIMER_NONE) {
+		wheel->timers[timer->next].prev = index;
+	}
+	wheel->heads[timer->slot] = index;
+}
+
+static void prnl_wheel_unlink(prnl_wheel *wheel, uint32_t index)
+{
+	prnl_timer *timer = &wheel->timers[index];
+
+	if (timer->prev != PRNL_TIMER_NONE) {
+		wheel->timers[timer->prev].next = timer->next;
+	}
+	else {
+		wheel->heads[timer->slot] = timer->next;
+	}
+
+	if (timer->next != PRNL_TIMER_NONE) {
+		wheel->timers[timer->next].prev = timer->prev;
+	}
+}
+
+static void prnl_wheel_release(prnl_wheel *wheel, uint32_t index)
+{
+	prnl_timer *timer = &wheel->timers[index];
+
+	timer->slot = PRNL_TIMER_NONE;
+	timer->generation++;
+	timer->next = wheel->free;
+	wheel->free = index;
+	wheel->count--;
+}
+
+static prnl_timer *prnl_wheel_find(prnl_wheel *wheel, long id, uint32_t *index)
+{
+	*index = (uint32_t) (id & 0xFFFFFFFF);
+
+	if (id < 0 || *index >= wheel->size || wheel->timers[*index].slot == PRNL_TIMER_NONE
+		|| wheel->timers[*index].generation != (uint32_t) ((uint64_t) id >> 32)) {
+		return NULL;
+	}
+
+	return &wheel->timers[*index];
+}
+
+static uint64_t prnl_wheel_tick(prnl_wheel *wheel, double time)
+{
+	return time <= 0 ? 0 : (uint64_t) floor(time / wheel->resolution);
+}
+
+//move all timers of a slot one level down
+static void prnl_wheel_cascade(prnl_wheel *wheel, uint32_t slot)
+{
+	uint32_t index = wheel->heads[slot], next;
+
+	wheel->heads[slot] = PRNL_TIMER_NONE;
+
+	while (index != PRNL_TIMER_NONE) {
+		next = wheel->timers[index].next;
+		prnl_wheel_link(wheel, index, 1);
+		index = next;
+	}
+}
+
+/* {{{ proto resource prnl_timer_wheel_create(float resolution, float now)
+   Create a timer wheel with ticks of resolution seconds */
+PHP_FUNCTION(prnl_timer_wheel_create)
+{
+	double resolution, now;
+	prnl_wheel *wheel;
+	uint32_t i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "dd", &resolution, &now) == FAILURE) {
+		return;
+	}
+
+	if (resolution <= 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Resolution must be positive");
+		RETURN_FALSE;
+	}
+
+	wheel = (prnl_wheel *) ecalloc(1, sizeof(prnl_wheel));
+	memset(wheel->heads, 0xFF, sizeof(wheel->heads));
+
+	wheel->size = 64;
+	wheel->timers = (prnl_timer *) ecalloc(wheel->size, sizeof(prnl_timer));
+	for (i = 0; i < wheel->size; i++) {
+		wheel->timers[i].slot = PRNL_TIMER_NONE;
+		wheel->timers[i].next = i + 1 < wheel->size ? i + 1 : PRNL_TIMER_NONE;
+	}
+
+	wheel->resolution = resolution;
+	wheel->current = prnl_wheel_tick(wheel, now);
+
+	ZEND_REGISTER_RESOURCE(return_value, wheel, le_prnl_wheel);
+}
+/* }}} */
+
+/* {{{ proto int prnl_timer_add(resource wheel, float expires, mixed data)
+   Add a timer, returns its id */
+PHP_FUNCTION(prnl_timer_add)
+{
+	zval *zwheel, *zdata;
+	double expires;
+	prnl_wheel *wheel;
+	prnl_timer *timer;
+	uint32_t index, i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rdz", &zwheel, &expires, &zdata) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(wheel, prnl_wheel *, &zwheel, -1, PRNL_WHEEL_RES_NAME, le_prnl_wheel);
+
+	if (wheel->free == PRNL_TIMER_NONE) {
+		if (wheel->size >= 0x80000000) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Too many timers");
+			RETURN_FALSE;
+		}
+
+		wheel->timers = (prnl_timer *) erealloc(wheel->timers, wheel->size * 2 * sizeof(prnl_timer));
+		memset(wheel->timers + wheel->size, 0, wheel->size * sizeof(prnl_timer));
+		for (i = wheel->size; i < wheel->size * 2; i++) {
+			wheel->timers[i].slot = PRNL_TIMER_NONE;
+			wheel->timers[i].next = i + 1 < wheel->size * 2 ? i + 1 : PRNL_TIMER_NONE;
+		}
+
+		wheel->free = wheel->size;
+		wheel->size *= 2;
+	}
+
+	index = wheel->free;
+	timer = &wheel->timers[index];
+	wheel->free = timer->next;
+	wheel->count++;
+
+	//keep a copy, the caller may change its variable afterwards
+	MAKE_STD_ZVAL(timer->data);
+	*timer->data = *zdata;
+	zval_copy_ctor(timer->data);
+	INIT_PZVAL(timer->data);
+
+	timer->expires = prnl_wheel_tick(wheel, expires);
+	prnl_wheel_link(wheel, index, 0);
+
+	RETURN_LONG((long) (((uint64_t) timer->generation << 32) | index));
+}
+/* }}} */
+
+/* {{{ proto bool prnl_timer_cancel(resource wheel, int id)
+   Cancel a timer */
+PHP_FUNCTION(prnl_timer_cancel)
+{
+	zval *zwheel;
+	long id;
+	prnl_wheel *wheel;
+	prnl_timer *timer;
+	uint32_t index;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rl", &zwheel, &id) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(wheel, prnl_wheel *, &zwheel, -1, PRNL_WHEEL_RES_NAME, le_prnl_wheel);
+
+	if ((timer = prnl_wheel_find(wheel, id, &index)) == NULL) {
+		RETURN_FALSE;
+	}
+
+	prnl_wheel_unlink(wheel, index);
+	zval_ptr_dtor(&timer->data);
+	prnl_wheel_release(wheel, index);
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto bool prnl_timer_reschedule(resource wheel, int id, float expires)
+   Move a timer to a new expiry time */
+PHP_FUNCTION(prnl_timer_reschedule)
+{
+	zval *zwheel;
+	long id;
+	double expires;
+	prnl_wheel *wheel;
+	prnl_timer *timer;
+	uint32_t index;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rld", &zwheel, &id, &expires) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(wheel, prnl_wheel *, &zwheel, -1, PRNL_WHEEL_RES_NAME, le_prnl_wheel);
+
+	if ((timer = prnl_wheel_find(wheel, id, &index)) == NULL) {
+		RETURN_FALSE;
+	}
+
+	prnl_wheel_unlink(wheel, index);
+	timer->expires = prnl_wheel_tick(wheel, expires);
+	prnl_wheel_link(wheel, index, 0);
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto array prnl_timer_advance(resource wheel, float now)
+   Advance the wheel to now and return the expired timers as id => data */
+PHP_FUNCTION(prnl_timer_advance)
+{
+	zval *zwheel;
+	double now;
+	prnl_wheel *wheel;
+	prnl_timer *timer;
+	uint64_t target;
+	uint32_t index, next, level, slot;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rd", &zwheel, &now) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(wheel, prnl_wheel *, &zwheel, -1, PRNL_WHEEL_RES_NAME, le_prnl_wheel);
+
+	array_init(return_value);
+	target = prnl_wheel_tick(wheel, now);
+
+	while (wheel->current < target) {
+		//nothing to expire, jump ahead
+		if (wheel->count == 0) {
+			wheel->current = target;
+			break;
+		}
+
+		wheel->current++;
+		slot = (uint32_t) (wheel->current & (PRNL_WHEEL_SIZE0 - 1));
+
+		//level 0 wrapped, pull the next slot of the levels above down
+		for (level = 1; slot == 0 && level < PRNL_WHEEL_LEVELS; level++) {
+			slot = (uint32_t) ((wheel->current >> (PRNL_WHEEL_BITS0 + (level - 1) * PRNL_WHEEL_BITSN)) & (PRNL_WHEEL_SIZEN - 1));
+			prnl_wheel_cascade(wheel, PRNL_WHEEL_SIZE0 + (level - 1) * PRNL_WHEEL_SIZEN + slot);
+		}
+
+		slot = (uint32_t) (wheel->current & (PRNL_WHEEL_SIZE0 - 1));
+		index = wheel->heads[slot];
+		wheel->heads[slot] = PRNL_TIMER_NONE;
+
+		while (index != PRNL_TIMER_NONE) {
+			timer = &wheel->timers[index];
+			next = timer->next;
+
+			//ownership of the data moves to the result array
+			add_index_zval(return_value, (ulong) (((uint64_t) timer->generation << 32) | index), timer->data);
+			timer->data = NULL;
+			prnl_wheel_release(wheel, index);
+
+			index = next;
+		}
+	}
+}
+/* }}} */
+
+/* {{{ proto array prnl_timer_info(resource wheel)
+   Return the number of timers and the ticks until the next slot with timers */
+PHP_FUNCTION(prnl_timer_info)
+{
+	zval *zwheel;
+	prnl_wheel *wheel;
+	uint64_t tick;
+	long next = -1;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zwheel) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(wheel, prnl_wheel *, &zwheel, -1, PRNL_WHEEL_RES_NAME, le_prnl_wheel);
+
+	if (wheel->count > 0) {
+		//scan level 0 up to the next cascade, timers above it can't expire earlier
+		for (tick = wheel->current + 1; ; tick++) {
+			if (wheel->heads[tick & (PRNL_WHEEL_SIZE0 - 1)] != PRNL_TIMER_NONE || (tick & (PRNL_WHEEL_SIZE0 - 1)) == 0) {
+				next = (long) (tick - wheel->current);
+				break;
+			}
+		}
+	}
+
+	array_init(return_value);
+	add_assoc_long(return_value, "count", (long) wheel->count);
+	add_assoc_long(return_value, "next", next);
+	add_assoc_double(return_value, "now", (double) wheel->current * wheel->resolution);
+}
+/* }}} */
@@ -0,0 +1,103 @@
+<?php
+
+/**
+ * Batch Decoder Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * Decode header fields of many raw packets at once into columns
+ * 
+ * decode() returns an array with one array per requested field, row $i of
+ * every column belongs to packet $i. Addresses are integers (see long2ip),
+ * fields a packet doesn't have are 0. With the native extension the whole
+ * batch is decoded in one call (prnl_decode_batch).
+ */
+class BatchDecoder {
+	const SRC    = 0x01;
+	const DST    = 0x02;
+	const PROTO  = 0x04;
+	const SPORT  = 0x08;
+	const DPORT  = 0x10;
+	const LENGTH = 0x20;
+	const TTL    = 0x40;
+	const FLAGS  = 0x80; // TCP flags
+	const ALL    = 0xFF;
+	
+	private static $_columns = array(
+		self::SRC    => 'src',
+		self::DST    => 'dst',
+		self::PROTO  => 'proto',
+		self::SPORT  => 'sport',
+		self::DPORT  => 'dport',
+		self::LENGTH => 'length',
+		self::TTL    => 'ttl',
+		self::FLAGS  => 'flags',
+	);
+	
+	/**
+	 * @param array $rawPackets raw IPv4 packets (strings)
+	 * @param int $fields combination of the field constants
+	 * @return array field name => array of values
+	 */
+	public static function decode(array $rawPackets, $fields = self::ALL) {
+		if (PRNL_NATIVE)
+			return prnl_decode_batch($rawPackets, $fields);
+		
+		$result = array();
+		foreach (self::$_columns as $field => $name) {
+			if ($fields & $field)
+				$result[$name] = array();
+		}
+		
+		$names = array_keys($result);
+		
+		foreach ($rawPackets as $raw) {
+			$row = array_fill_keys(self::$_columns, 0);
+			
+			if (is_string($raw) && strlen($raw) >= IIPv4::HEADER_SIZE && (ord($raw[IIPv4::VERSION_LENGTH]) >> 4) == 4) {
+				$header = unpack('Cvl/Ctos/nlength/nid/noffset/Cttl/Cproto/nsum/Nsrc/Ndst', $raw);
+				$ipLength = ($header['vl'] & 0x0F) * 4;
+				
+				$row['src'] = $header['src'];
+				$row['dst'] = $header['dst'];
+				$row['proto'] = $header['proto'];
+				$row['length'] = $header['length'];
+				$row['ttl'] = $header['ttl'];
+				
+				//the ports are only in the first fragment
+				if (($header['offset'] & IIPv4::OFFSET_MASK) == 0) {
+					if (($header['proto'] == PROT_TCP || $header['proto'] == PROT_UDP) && strlen($raw) >= $ipLength + 4) {
+						list(, $row['sport'], $row['dport']) = unpack('n2', substr($raw, $ipLength, 4));
+					}
+					
+					if ($header['proto'] == PROT_TCP && strlen($raw) > $ipLength + ITCP::FLAGS) {
+						$row['flags'] = ord($raw[$ipLength + ITCP::FLAGS]);
+					}
+				}
+			}
+			
+			foreach ($names as $name) {
+				$result[$name][] = $row[$name];
+			}
+		}
+		
+		return $result;
+	}
+}
@@ -0,0 +1,263 @@
+<?php
+
+/**
+ * ICMP echo sweep
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/**
+ * Liveness check of large target lists with ICMP echo
+ * 
+ * One echo request is built with ICMPProtocolPacket and used as a template,
+ * per target only the destination, the ICMP id/sequence (the target index) and
+ * the payload (the send time) are patched in, and the requests go out with
+ * sendmmsg in batches. The replies are read in batches (recvmmsg) between the
+ * send batches and set a bit in the reply bitmap; the RTT is the receive time
+ * minus the send time the reply echoes, so nothing is stored per request.
+ * With the native extension the kernel receive timestamps are used.
+ */
+class EchoSweep {
+	private $_network;
+	private $_srcIP;
+	private $_timeout;
+	private $_rate;
+	private $_batchSize;
+	private $_id;
+	
+	private $_targets = array();
+	private $_bitmap = '';
+	private $_rtts = array();
+	
+	private $_stats = array(
+		'sent' => 0,
+		'alive' => 0,
+		'duplicates' => 0,
+		'invalid' => 0,
+	);
+	
+	/**
+	 * @param string $srcIP
+	 * @param float $timeout seconds to wait for replies after the last request
+	 * @param int $rate requests per second
+	 * @param int $batchSize requests per sendmmsg call
+	 */
+	public function __construct($srcIP, $timeout = 1, $rate = 100000, $batchSize = 256) {
+		$this->_srcIP = $srcIP;
+		$this->_timeout = $timeout;
+		$this->_rate = max(1, $rate);
+		$this->_batchSize = max(1, $batchSize);
+		
+		//ICMP id of this sweep, targets beyond 65536 count up from it
+		$this->_id = getmypid() & 0xFFFF;
+		
+		$this->_network = new RawIPNetwork();
+		$this->_network->createIPSocket(PROT_IPv4, PROT_ICMP);
+		
+		if (PRNL_NATIVE)
+			$this->_network->enableTimestamps();
+	}
+	
+	/**
+	 * Send an echo request to every target and collect the replies
+	 *
+	 * @param array $targets ip addresses
+	 * @return int number of targets that replied
+	 */
+	public function sweep(array $targets) {
+		$this->_targets = array_values($targets);
+		$this->_bitmap = str_repeat("\0", (count($this->_targets) + 7) >> 3);
+		$this->_rtts = array();
+		
+		foreach (array_keys($this->_stats) as $name) {
+			$this->_stats[$name] = 0;
+		}
+		
+		$template = $this->buildTemplate();
+		$icmpOffset = IIPv4::HEADER_SIZE;
+		
+		$packets = array();
+		$addrs = array();
+		$start = microtime(true);
+		$now = $this->now();
+		
+		foreach ($this->_targets as $index => $ip) {
+			$packet = substr_replace($template, pack('N', ip2long($ip)), IIPv4::IP_DST, 4);
+			
+			$message = pack('CCnnnNN', IICMP::TYPE_ECHO_REQUEST, 0, 0, ($this->_id + ($index >> 16)) & 0xFFFF, $index & 0xFFFF,
+				$now >> 32, $now & 0xFFFFFFFF);
+			$message = substr_replace($message, pack('n', PRNL_NATIVE ? prnl_checksum($message) : Checksum::finish(Checksum::partial($message))), IICMP::CHECKSUM, 2);
+			
+			$packets[] = substr_replace($packet, $message, $icmpOffset, strlen($message));
+			$addrs[] = $ip;
+			
+			if (count($packets) >= $this->_batchSize) {
+				$this->_stats['sent'] += $this->_network->sendPacketsTo($packets, $addrs);
+				$packets = array();
+				$addrs = array();
+				
+				$this->receive(0);
+				
+				//pacing: wait until the requests sent so far are within the rate
+				$ahead = ($index + 1) / $this->_rate - (microtime(true) - $start);
+				
+				if ($ahead > 0)
+					usleep((int)($ahead * 1000000));
+				
+				$now = $this->now();
+			}
+		}
+		
+		if (count($packets) > 0)
+			$this->_stats['sent'] += $this->_network->sendPacketsTo($packets, $addrs);
+		
+		$deadline = microtime(true) + $this->_timeout;
+		
+		while ($this->_stats['alive'] < count($this->_targets) && ($left = $deadline - microtime(true)) > 0) {
+			$this->receive($left);
+		}
+		
+		return $this->_stats['alive'];
+	}
+	
+	/**
+	 * @param int $index index of the target in the list given to sweep()
+	 * @return bool
+	 */
+	public function isAlive($index) {
+		return (ord($this->_bitmap[$index >> 3]) & (1 << ($index & 7))) != 0;
+	}
+	
+	/**
+	 * One bit per target, bit (index & 7) of byte (index >> 3)
+	 *
+	 * @return string
+	 */
+	public function getBitmap() {
+		return $this->_bitmap;
+	}
+	
+	/**
+	 * @return array target index => RTT in nanoseconds, only targets that replied
+	 */
+	public function getRTTs() {
+		return $this->_rtts;
+	}
+	
+	/**
+	 * @return array ip => RTT in nanoseconds
+	 */
+	public function getAlive() {
+		$alive = array();
+		
+		foreach ($this->_rtts as $index => $rtt) {
+			$alive[$this->_targets[$index]] = $rtt;
+		}
+		
+		return $alive;
+	}
+	
+	public function getStats() {
+		return $this->_stats;
+	}
+	
+	/**
+	 * A complete echo request with 8 bytes of payload, the IP checksum left to the kernel
+	 *
+	 * @return string
+	 */
+	private function buildTemplate() {
+		$icmp = new ICMPProtocolPacket();
+		$icmp->setType(IICMP::TYPE_ECHO_REQUEST);
+		$icmp->setCode(0);
+		$icmp->setData(str_repeat("\0", 8));
+		
+		$ip = new IPv4ProtocolPacket();
+		$ip->setProtocol(PROT_ICMP);
+		$ip->setSrcIP($this->_srcIP);
+		$ip->setDstIP('0.0.0.0');
+		$ip->setData($icmp);
+		$ip->completePacket();
+		
+		//the kernel always fills in the IP checksum of IP_HDRINCL packets
+		return substr_replace($ip->getRawPacket(), "\0\0", IIPv4::CHECKSUM, 2);
+	}
+	
+	/**
+	 * Match the echo replies that arrive within $seconds
+	 *
+	 * @param float $seconds 0 to only read what is queued
+	 */
+	private function receive($seconds) {
+		$read = array($this->_network->getSocket());
+		$write = null;
+		$except = null;
+		
+		if (!@socket_select($read, $write, $except, (int)$seconds, (int)(($seconds - (int)$seconds) * 1000000)))
+			return;
+		
+		foreach ($this->_network->readPackets($this->_batchSize) as $packet) {
+			if ($packet->getProtocol() != PROT_ICMP)
+				continue;
+			
+			$icmp = $packet->getDataObject();
+			
+			//our own requests show up as well on loopback
+			if ($icmp->getType() != IICMP::TYPE_ECHO_REPLY)
+				continue;
+			
+			$index = (($icmp->getId() - $this->_id) & 0xFFFF) << 16 | $icmp->getSequence();
+			$data = $icmp->getData();
+			
+			if ($index >= count($this->_targets) || $this->_targets[$index] != $packet->getSrcIP() || strlen($data) < 8) {
+				$this->_stats['invalid']++;
+				continue;
+			}
+			
+			if ($this->isAlive($index)) {
+				$this->_stats['duplicates']++;
+				continue;
+			}
+			
+			$byte = $index >> 3;
+			$this->_bitmap[$byte] = chr(ord($this->_bitmap[$byte]) | (1 << ($index & 7)));
+			
+			$received = $packet->getReceiveInfo('timestamp');
+			
+			if ($received === null)
+				$received = $this->now();
+			
+			$sent = unpack('Nhigh/Nlow', $data);
+			$this->_rtts[$index] = $received - ($sent['high'] << 32 | $sent['low']);
+			$this->_stats['alive']++;
+		}
+	}
+	
+	/**
+	 * Current time on the clock of the kernel receive timestamps
+	 *
+	 * @return int nanoseconds
+	 */
+	private function now() {
+		if (PRNL_NATIVE)
+			return prnl_clock_gettime(RawNetwork::CLOCK_REALTIME);
+		
+		return (int)(microtime(true) * 1000000000);
+	}
+}
@@ -0,0 +1,354 @@
+<?php
+
+/**
+ * Flow Table Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * Per flow packet, byte and time counters with a hard memory cap
+ * 
+ * Flows are keyed on a 13 byte binary 5-tuple (see makeKey). The table keeps
+ * its flows in least recently seen order: idle flows expire from the old end
+ * and when the memory budget is used up the oldest flow is evicted. A flow
+ * that lives longer than the active timeout is exported and restarted on its
+ * next packet. All operations are O(1).
+ * 
+ * With the native extension the flows live in an open addressing hash of
+ * fixed size entries, about 72 bytes per flow. The PHP fallback uses an
+ * array and budgets FLOW_COST_PHP bytes per flow.
+ * 
+ * Evicted and restarted flows wait in a queue of one record per
+ * PENDING_SHARE flows until expire() collects them. The queue is part of the
+ * budget: when it is full further records are dropped and counted.
+ */
+class FlowTable implements Countable, IteratorAggregate {
+	const KEY_SIZE       = 13;
+	
+	const EXPIRE_IDLE    = 1;
+	const EXPIRE_ACTIVE  = 2;
+	const EXPIRE_EVICTED = 3;
+	
+	const FLOW_COST_PHP  = 512;
+	const PENDING_SHARE  = 8;
+	
+	//flow fields in the PHP fallback
+	const F_PACKETS      = 0;
+	const F_BYTES        = 1;
+	const F_FIRST        = 2;
+	const F_LAST         = 3;
+	
+	private $_table;
+	private $_native;
+	
+	private $_flows = array();
+	private $_pending = array();
+	private $_maxPending;
+	private $_dropped = 0;
+	private $_maxFlows;
+	
+	private $_idleTimeout;
+	private $_activeTimeout;
+	private $_bidirectional;
+	
+	/**
+	 * @param int $memoryBudget max bytes used by the flows
+	 * @param float $idleTimeout seconds without packets before a flow expires
+	 * @param float $activeTimeout seconds before a long living flow is exported and restarted, 0 to disable
+	 * @param bool $bidirectional count both directions of a connection as one flow
+	 */
+	public function __construct($memoryBudget = 67108864, $idleTimeout = 30, $activeTimeout = 300, $bidirectional = false) {
+		$this->_idleTimeout = $idleTimeout;
+		$this->_activeTimeout = $activeTimeout;
+		$this->_bidirectional = $bidirectional;
+		$this->_native = PRNL_NATIVE;
+		
+		if ($this->_native) {
+			$this->_table = prnl_flow_table_create($memoryBudget, $idleTimeout, $activeTimeout);
+			
+			if (!$this->_table)
+				throw new Exception('Unable to create the flow table!');
+			
+			$info = prnl_flow_table_info($this->_table);
+			$this->_maxFlows = $info['max'];
+		}
+		else {
+			$this->_maxFlows = (int)($memoryBudget / (self::FLOW_COST_PHP + self::FLOW_COST_PHP / self::PENDING_SHARE));
+			
+			if ($this->_maxFlows < 1)
+				throw new Exception('Memory budget too small!');
+			
+			$this->_maxPending = max(1, (int)($this->_maxFlows / self::PENDING_SHARE));
+		}
+	}
+	
+	/**
+	 * Build a flow key
+	 *
+	 * @param int $src source IP as integer
+	 * @param int $dst destination IP as integer
+	 * @param int $srcPort
+	 * @param int $dstPort
+	 * @param int $protocol
+	 * @return string
+	 */
+	public static function makeKey($src, $dst, $srcPort, $dstPort, $protocol) {
+		return pack('NNnnC', $src, $dst, $srcPort, $dstPort, $protocol);
+	}
+	
+	/**
+	 * Split a flow key into its fields
+	 *
+	 * @param string $key
+	 * @return array src, dst (dotted), src_port, dst_port, protocol
+	 */
+	public static function parseKey($key) {
+		$fields = unpack('Nsrc/Ndst/nsrc_port/ndst_port/Cprotocol', $key);
+		
+		$fields['src'] = long2ip($fields['src']);
+		$fields['dst'] = long2ip($fields['dst']);
+		
+		return $fields;
+	}
+	
+	/**
+	 * The flow key of a packet, read straight from the raw header bytes
+	 * 
+	 * Packets other than TCP and UDP and non-first fragments get port 0.
+	 *
+	 * @param IPv4ProtocolPacket $packet
+	 * @param bool $bidirectional order the endpoints so both directions share a key
+	 * @return string
+	 */
+	public static function packetKey(IPv4ProtocolPacket $packet, $bidirectional = false) {
+		$raw = $packet->getRawPacket();
+		$protocol = ord($raw[IIPv4::PROTOCOL]);
+		$headerLength = (ord($raw[IIPv4::VERSION_LENGTH]) & 0x0F) * 4;
+		
+		$fragmentOffset = ((ord($raw[IIPv4::OFFSET]) << 8) | ord($raw[IIPv4::OFFSET + 1])) & 0x1FFF;
+		
+		if (($protocol == PROT_TCP || $protocol == PROT_UDP) && $fragmentOffset == 0 && strlen($raw) >= $headerLength + 4) {
+			$src = substr($raw, IIPv4::IP_SRC, 4) . substr($raw, $headerLength, 2);
+			$dst = substr($raw, IIPv4::IP_DST, 4) . substr($raw, $headerLength + 2, 2);
+		}
+		else {
+			$src = substr($raw, IIPv4::IP_SRC, 4) . "\0\0";
+			$dst = substr($raw, IIPv4::IP_DST, 4) . "\0\0";
+		}
+		
+		if ($bidirectional && strcmp($src, $dst) > 0) {
+			list($src, $dst) = array($dst, $src);
+		}
+		
+		return substr($src, 0, 4) . substr($dst, 0, 4) . substr($src, 4) . substr($dst, 4) . chr($protocol);
+	}
+	
+	/**
+	 * Account a packet to its flow
+	 *
+	 * @param IPv4ProtocolPacket $packet
+	 * @param float $now packet time, defaults to the current time
+	 * @return string the flow key
+	 */
+	public function update(IPv4ProtocolPacket $packet, $now = null) {
+		$key = self::packetKey($packet, $this->_bidirectional);
+		
+		$this->updateKey($key, $packet->getPacketLength(), $now);
+		
+		return $key;
+	}
+	
+	/**
+	 * Account $bytes to a flow
+	 *
+	 * @param string $key
+	 * @param int $bytes
+	 * @param float $now
+	 * @return bool true when the flow is new
+	 */
+	public function updateKey($key, $bytes, $now = null) {
+		if ($now === null)
+			$now = microtime(true);
+		
+		if ($this->_native)
+			return prnl_flow_update($this->_table, $key, $bytes, $now);
+		
+		if (isset($this->_flows[$key])) {
+			$flow = $this->_flows[$key];
+			
+			//re-insert to move the flow to the recently seen end
+			unset($this->_flows[$key]);
+			
+			if ($this->_activeTimeout > 0 && $now - $flow[self::F_FIRST] >= $this->_activeTimeout) {
+				$this->queue($key, $flow, self::EXPIRE_ACTIVE);
+				$flow = array(0, 0, $now, $now);
+			}
+			
+			$created = false;
+		}
+		else {
+			if (count($this->_flows) >= $this->_maxFlows) {
+				reset($this->_flows);
+				$oldest = key($this->_flows);
+				
+				$this->queue($oldest, $this->_flows[$oldest], self::EXPIRE_EVICTED);
+				unset($this->_flows[$oldest]);
+			}
+			
+			$flow = array(0, 0, $now, $now);
+			$created = true;
+		}
+		
+		$flow[self::F_PACKETS]++;
+		$flow[self::F_BYTES] += $bytes;
+		$flow[self::F_LAST] = $now;
+		
+		$this->_flows[$key] = $flow;
+		
+		return $created;
+	}
+	
+	/**
+	 * The counters of a flow
+	 *
+	 * @param string $key
+	 * @return array key, packets, bytes, first, last or null when the flow isn't tracked
+	 */
+	public function get($key) {
+		if ($this->_native)
+			return prnl_flow_get($this->_table, $key);
+		
+		return isset($this->_flows[$key]) ? $this->toRecord($key, $this->_flows[$key]) : null;
+	}
+	
+	public function remove($key) {
+		if ($this->_native)
+			return prnl_flow_remove($this->_table, $key);
+		
+		if (!isset($this->_flows[$key]))
+			return false;
+		
+		unset($this->_flows[$key]);
+		
+		return true;
+	}
+	
+	/**
+	 * Remove and return the flows that expired
+	 * 
+	 * Returns the idle flows and the flows evicted or restarted by the active
+	 * timeout since the previous call, as far as they fit in the pending
+	 * queue (see getDropped). Each record has a 'reason' (EXPIRE_*).
+	 *
+	 * @param float $now
+	 * @return array
+	 */
+	public function expire($now = null) {
+		if ($now === null)
+			$now = microtime(true);
+		
+		if ($this->_native)
+			return prnl_flow_expire($this->_table, $now);
+		
+		$expired = $this->_pending;
+		$this->_pending = array();
+		
+		//least recently seen first, stop at the first flow that is still active
+		while (($flow = reset($this->_flows)) !== false && $now - $flow[self::F_LAST] >= $this->_idleTimeout) {
+			$key = key($this->_flows);
+			
+			$expired[] = $this->toRecord($key, $flow, self::EXPIRE_IDLE);
+			unset($this->_flows[$key]);
+		}
+		
+		return $expired;
+	}
+	
+	/**
+	 * All tracked flows, most recently seen first
+	 *
+	 * @return array
+	 */
+	public function export() {
+		if ($this->_native)
+			return prnl_flow_export($this->_table);
+		
+		$flows = array();
+		foreach (array_reverse($this->_flows, true) as $key => $flow) {
+			$flows[] = $this->toRecord($key, $flow);
+		}
+		
+		return $flows;
+	}
+	
+	public function getIterator() {
+		return new ArrayIterator($this->export());
+	}
+	
+	public function count() {
+		if ($this->_native) {
+			$info = prnl_flow_table_info($this->_table);
+			return $info['count'];
+		}
+		
+		return count($this->_flows);
+	}
+	
+	public function getMaxFlows() {
+		return $this->_maxFlows;
+	}
+	
+	/**
+	 * Number of expired records lost because the pending queue was full
+	 *
+	 * @return int
+	 */
+	public function getDropped() {
+		if ($this->_native) {
+			$info = prnl_flow_table_info($this->_table);
+			return $info['dropped'];
+		}
+		
+		return $this->_dropped;
+	}
+	
+	private function queue($key, array $flow, $reason) {
+		if (count($this->_pending) >= $this->_maxPending) {
+			$this->_dropped++;
+			return;
+		}
+		
+		$this->_pending[] = $this->toRecord($key, $flow, $reason);
+	}
+	
+	private function toRecord($key, array $flow, $reason = null) {
+		$record = array(
+			'key'     => $key,
+			'packets' => $flow[self::F_PACKETS],
+			'bytes'   => $flow[self::F_BYTES],
+			'first'   => $flow[self::F_FIRST],
+			'last'    => $flow[self::F_LAST],
+		);
+		
+		if ($reason !== null)
+			$record['reason'] = $reason;
+		
+		return $record;
+	}
+}
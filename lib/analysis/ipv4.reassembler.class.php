@@ -0,0 +1,244 @@
+<?php
+
+/**
+ * IPv4 Reassembler Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * IPv4 fragment reassembly with bounded memory
+ * 
+ * Fragments are collected per (src, dst, id, protocol) as payload strings
+ * keyed by offset and joined once when the datagram is complete, so the cost
+ * is linear in the datagram size. Memory is bounded by a per datagram limit,
+ * a maximum number of datagrams in progress and a global byte budget; when
+ * the budget or the datagram slots run out the oldest datagram is dropped.
+ * Datagrams are kept in arrival order, so timeouts expire from the front.
+ */
+class IPv4Reassembler {
+	const MAX_DATAGRAM = 65535;
+	
+	//datagram fields
+	const D_HEADER    = 0;
+	const D_FRAGMENTS = 1;
+	const D_BYTES     = 2;
+	const D_TOTAL     = 3;
+	const D_FIRST     = 4;
+	
+	private $_datagrams = array();
+	private $_bytes = 0;
+	
+	private $_maxBytes;
+	private $_maxDatagrams;
+	private $_maxDatagramBytes;
+	private $_timeout;
+	
+	private $_stats = array(
+		'fragments'   => 0,
+		'reassembled' => 0,
+		'timeouts'    => 0,
+		'evicted'     => 0,
+		'invalid'     => 0,
+	);
+	
+	/**
+	 * @param int $maxBytes global budget of buffered fragment bytes
+	 * @param int $maxDatagrams datagrams in progress at the same time
+	 * @param float $timeout seconds to wait for the missing fragments
+	 * @param int $maxDatagramBytes largest datagram accepted
+	 */
+	public function __construct($maxBytes = 4194304, $maxDatagrams = 1024, $timeout = 30, $maxDatagramBytes = self::MAX_DATAGRAM) {
+		$this->_maxBytes = $maxBytes;
+		$this->_maxDatagrams = $maxDatagrams;
+		$this->_timeout = $timeout;
+		$this->_maxDatagramBytes = min($maxDatagramBytes, self::MAX_DATAGRAM);
+	}
+	
+	/**
+	 * Feed a received packet
+	 * 
+	 * Returns the packet itself when it isn't a fragment, the reassembled
+	 * packet when this fragment completed its datagram and null otherwise.
+	 *
+	 * @param IPv4ProtocolPacket $packet
+	 * @param float $now defaults to the current time
+	 * @return IPv4ProtocolPacket
+	 */
+	public function add(IPv4ProtocolPacket $packet, $now = null) {
+		$raw = $packet->getRawPacket();
+		$offset = (ord($raw[IIPv4::OFFSET]) << 8) | ord($raw[IIPv4::OFFSET + 1]);
+		
+		if (($offset & (IIPv4::FLAG_MF | IIPv4::OFFSET_MASK)) == 0)
+			return $packet;
+		
+		if ($now === null)
+			$now = microtime(true);
+		
+		$this->_stats['fragments']++;
+		
+		$headerLength = (ord($raw[IIPv4::VERSION_LENGTH]) & 0x0F) * 4;
+		$length = (ord($raw[IIPv4::LENGTH]) << 8) | ord($raw[IIPv4::LENGTH + 1]);
+		if ($length < $headerLength || $length > strlen($raw))
+			$length = strlen($raw);
+		
+		$payload = (string)substr($raw, $headerLength, $length - $headerLength);
+		$start = ($offset & IIPv4::OFFSET_MASK) * 8;
+		$end = $start + strlen($payload);
+		
+		$key = substr($raw, IIPv4::IP_SRC, 8) . substr($raw, IIPv4::ID_SEQ, 2) . $raw[IIPv4::PROTOCOL];
+		
+		if ($end + $headerLength > $this->_maxDatagramBytes || ($end == $start && ($offset & IIPv4::FLAG_MF))) {
+			$this->_stats['invalid']++;
+			$this->drop($key);
+			return null;
+		}
+		
+		if (!isset($this->_datagrams[$key])) {
+			if (count($this->_datagrams) >= $this->_maxDatagrams)
+				$this->evictOldest();
+			
+			$this->_datagrams[$key] = array(null, array(), 0, null, $now);
+		}
+		
+		$datagram =& $this->_datagrams[$key];
+		
+		if (isset($datagram[self::D_FRAGMENTS][$start]) && strlen($datagram[self::D_FRAGMENTS][$start]) >= strlen($payload)) {
+			//retransmitted fragment
+			return null;
+		}
+		
+		if ($start == 0)
+			$datagram[self::D_HEADER] = substr($raw, 0, $headerLength);
+		
+		if (($offset & IIPv4::FLAG_MF) == 0)
+			$datagram[self::D_TOTAL] = $end;
+		
+		if (isset($datagram[self::D_FRAGMENTS][$start])) {
+			$datagram[self::D_BYTES] -= strlen($datagram[self::D_FRAGMENTS][$start]);
+			$this->_bytes -= strlen($datagram[self::D_FRAGMENTS][$start]);
+		}
+		
+		$datagram[self::D_FRAGMENTS][$start] = $payload;
+		$datagram[self::D_BYTES] += strlen($payload);
+		$this->_bytes += strlen($payload);
+		
+		$complete = $datagram[self::D_HEADER] !== null && $datagram[self::D_TOTAL] !== null
+			&& $datagram[self::D_BYTES] >= $datagram[self::D_TOTAL];
+		
+		unset($datagram);
+		
+		while ($this->_bytes > $this->_maxBytes && count($this->_datagrams) > 1) {
+			$this->evictOldest($key);
+		}
+		
+		return $complete ? $this->complete($key) : null;
+	}
+	
+	/**
+	 * Drop the datagrams that didn't complete within the timeout
+	 *
+	 * @param float $now
+	 * @return int number of datagrams dropped
+	 */
+	public function expire($now = null) {
+		if ($now === null)
+			$now = microtime(true);
+		
+		$dropped = 0;
+		foreach ($this->_datagrams as $key => $datagram) {
+			if ($now - $datagram[self::D_FIRST] < $this->_timeout)
+				break;
+			
+			$this->drop($key);
+			$dropped++;
+		}
+		
+		$this->_stats['timeouts'] += $dropped;
+		
+		return $dropped;
+	}
+	
+	/**
+	 * @return array fragments, reassembled, timeouts, evicted, invalid, pending and bytes
+	 */
+	public function getStats() {
+		$stats = $this->_stats;
+		$stats['pending'] = count($this->_datagrams);
+		$stats['bytes'] = $this->_bytes;
+		
+		return $stats;
+	}
+	
+	/**
+	 * Join the fragments, overlapping bytes are taken from the fragment with the lowest offset
+	 */
+	private function complete($key) {
+		$datagram = $this->_datagrams[$key];
+		$fragments = $datagram[self::D_FRAGMENTS];
+		ksort($fragments);
+		
+		$parts = array();
+		$covered = 0;
+		foreach ($fragments as $start => $payload) {
+			if ($start > $covered)
+				return null; //there is still a hole
+			
+			$end = $start + strlen($payload);
+			if ($end > $covered) {
+				$parts[] = $start == $covered ? $payload : substr($payload, $covered - $start);
+				$covered = $end;
+			}
+		}
+		
+		if ($covered < $datagram[self::D_TOTAL])
+			return null;
+		
+		$this->drop($key);
+		$this->_stats['reassembled']++;
+		
+		$payload = substr(implode('', $parts), 0, $datagram[self::D_TOTAL]);
+		$header = $datagram[self::D_HEADER];
+		
+		$packet = new IPv4ProtocolPacket($header . $payload);
+		$packet->setOffset($packet->getOffset() & IIPv4::FLAG_DF);
+		$packet->setLength(strlen($header) + strlen($payload));
+		$packet->resetChecksum();
+		$packet->calculateChecksum();
+		
+		return $packet;
+	}
+	
+	private function drop($key) {
+		if (isset($this->_datagrams[$key])) {
+			$this->_bytes -= $this->_datagrams[$key][self::D_BYTES];
+			unset($this->_datagrams[$key]);
+		}
+	}
+	
+	private function evictOldest($keep = null) {
+		foreach ($this->_datagrams as $key => $datagram) {
+			if ($key === $keep)
+				continue;
+			
+			$this->drop($key);
+			$this->_stats['evicted']++;
+			return;
+		}
+	}
+}
@@ -0,0 +1,518 @@
+<?php
+
+/**
+ * RTT prober
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/**
+ * Active RTT measurement with TCP SYN and UDP probes
+ * 
+ * Every probe carries an identifier the reply echoes: the sequence number of a
+ * TCP SYN comes back as ack - 1 in the SYN-ACK or RST, the source port of a UDP
+ * probe as the destination port of the reply, or as the quoted source port of
+ * the ICMP port unreachable of a closed port (read from a raw ICMP socket).
+ * Outstanding probes are kept in a hash per protocol keyed on that identifier,
+ * so matching a reply is one lookup whatever the number of targets. With the
+ * native extension the RTT is the kernel receive timestamp minus the send
+ * time, so time spent in PHP before a reply is read doesn't count. RTTs go
+ * into a LatencyHistogram per target.
+ * 
+ * Only probe hosts you operate, the SYN probes are answered by the local
+ * kernel with a RST and never open a connection.
+ */
+class RTTProber {
+	const TCP_SYN = PROT_TCP;
+	const UDP     = PROT_UDP;
+	
+	//target fields
+	const T_IP       = 0;
+	const T_PORT     = 1;
+	const T_PROTOCOL = 2;
+	const T_SENT     = 3;
+	const T_RECEIVED = 4;
+	const T_LOST     = 5;
+	
+	private $_srcIP;
+	private $_srcPort;
+	private $_timeout;
+	private $_batchSize;
+	private $_rate = 0;
+	private $_precision = 7;
+	
+	private $_networks = array();
+	private $_targets = array();
+	private $_histograms = array();
+	
+	//outstanding probes in send order, per protocol: identifier => array(target key, send time)
+	private $_pending = array(PROT_TCP => array(), PROT_UDP => array());
+	
+	private $_sequence;
+	private $_udpPort;
+	private $_udpPortFirst;
+	private $_udpPortLast;
+	
+	private $_stats = array(
+		'sent' => 0,
+		'received' => 0,
+		'lost' => 0,
+		'failed' => 0,
+		'unmatched' => 0,
+	);
+	
+	/**
+	 * @param string $srcIP address the probes are sent from
+	 * @param float $timeout seconds after which a probe counts as lost
+	 * @param int $srcPort source port of the TCP probes
+	 * @param array $udpPorts first and last source port of the UDP probes, one port per outstanding probe
+	 * @param int $batchSize probes per sendPackets call
+	 */
+	public function __construct($srcIP, $timeout = 1, $srcPort = 40000, array $udpPorts = array(40001, 60000), $batchSize = 64) {
+		if ($udpPorts[0] > $udpPorts[1] || ($srcPort >= $udpPorts[0] && $srcPort <= $udpPorts[1]))
+			throw new Exception('Invalid UDP port range!');
+		
+		$this->_srcIP = $srcIP;
+		$this->_timeout = $timeout;
+		$this->_srcPort = $srcPort;
+		$this->_udpPortFirst = $udpPorts[0];
+		$this->_udpPortLast = $udpPorts[1];
+		$this->_udpPort = $udpPorts[0];
+		$this->_batchSize = max(1, $batchSize);
+		$this->_sequence = mt_rand() & 0x7FFFFFFF;
+	}
+	
+	/**
+	 * Limit the probe rate, replies queue up in the socket while sending is paced
+	 *
+	 * @param int $pps 0 for no limit
+	 */
+	public function setRate($pps) {
+		$this->_rate = max(0, $pps);
+	}
+	
+	/**
+	 * @param int $precision see LatencyHistogram
+	 */
+	public function setPrecision($precision) {
+		$this->_precision = $precision;
+	}
+	
+	/**
+	 * Add a target, probed by every probe() call
+	 *
+	 * @param string $ip
+	 * @param int $port
+	 * @param int $protocol TCP_SYN or UDP
+	 * @return string key of the target in getResults()
+	 */
+	public function addTarget($ip, $port, $protocol = self::TCP_SYN) {
+		if ($protocol != self::TCP_SYN && $protocol != self::UDP)
+			throw new Exception('Unknown probe protocol!');
+		
+		$key = $ip . ':' . $port . ($protocol == self::TCP_SYN ? '/tcp' : '/udp');
+		
+		if (!isset($this->_targets[$key])) {
+			$this->_targets[$key] = array($ip, (int)$port, $protocol, 0, 0, 0);
+			$this->_histograms[$key] = new LatencyHistogram($this->_precision);
+		}
+		
+		if (!isset($this->_networks[$protocol])) {
+			$network = new RawIPNetwork();
+			$network->createIPSocket(PROT_IPv4, $protocol);
+			
+			if (PRNL_NATIVE)
+				$network->enableTimestamps();
+			
+			$this->_networks[$protocol] = $network;
+		}
+		
+		//closed UDP ports answer with an ICMP port unreachable, the UDP socket never sees it
+		if ($protocol == self::UDP && !isset($this->_networks[PROT_ICMP])) {
+			$network = new RawIPNetwork();
+			$network->createIPSocket(PROT_IPv4, PROT_ICMP);
+			
+			if (PRNL_NATIVE)
+				$network->enableTimestamps();
+			
+			$this->_networks[PROT_ICMP] = $network;
+		}
+		
+		return $key;
+	}
+	
+	/**
+	 * Send one probe to every target
+	 * 
+	 * @return int number of probes sent
+	 */
+	public function probe() {
+		$batches = array(PROT_TCP => array(), PROT_UDP => array());
+		$sent = 0;
+		$start = microtime(true);
+		
+		foreach ($this->_targets as $key => $target) {
+			$protocol = $target[self::T_PROTOCOL];
+			$batches[$protocol][$key] = $this->buildProbe($target);
+			
+			if (count($batches[$protocol]) >= $this->_batchSize) {
+				$sent += $this->flush($protocol, $batches[$protocol]);
+				$batches[$protocol] = array();
+				
+				//pacing: wait until the probes sent so far are within the rate
+				if ($this->_rate > 0) {
+					$ahead = $sent / $this->_rate - (microtime(true) - $start);
+					
+					if ($ahead > 0)
+						usleep((int)($ahead * 1000000));
+				}
+			}
+		}
+		
+		foreach ($batches as $protocol => $batch) {
+			if (count($batch) > 0)
+				$sent += $this->flush($protocol, $batch);
+		}
+		
+		return $sent;
+	}
+	
+	/**
+	 * Read and match replies for up to $seconds, then expire the probes that timed out
+	 *
+	 * @param float $seconds
+	 * @return int number of matched replies
+	 */
+	public function poll($seconds) {
+		$deadline = microtime(true) + $seconds;
+		$matched = 0;
+		
+		$sockets = array();
+		foreach ($this->_networks as $protocol => $network) {
+			$sockets[$protocol] = $network->getSocket();
+		}
+		
+		while (count($sockets) > 0 && ($left = $deadline - microtime(true)) > 0) {
+			$read = $sockets;
+			$write = null;
+			$except = null;
+			
+			if (!@socket_select($read, $write, $except, (int)$left, (int)(($left - (int)$left) * 1000000)))
+				continue;
+			
+			foreach ($read as $socket) {
+				$protocol = array_search($socket, $sockets, true);
+				
+				foreach ($this->_networks[$protocol]->readPackets($this->_batchSize) as $packet) {
+					if ($this->match($packet))
+						$matched++;
+				}
+			}
+		}
+		
+		$this->expire($this->now());
+		
+		return $matched;
+	}
+	
+	/**
+	 * Probe all targets $rounds times, $interval seconds apart, and wait for the last replies
+	 *
+	 * @param int $rounds
+	 * @param float $interval
+	 */
+	public function run($rounds, $interval = 1) {
+		for ($i = 0; $i < $rounds; $i++) {
+			$start = microtime(true);
+			$this->probe();
+			
+			if ($i < $rounds - 1)
+				$this->poll(max(0, $interval - (microtime(true) - $start)));
+		}
+		
+		$this->poll($this->_timeout);
+		
+		//whatever is still outstanding now is lost
+		$this->expire(PHP_INT_MAX);
+	}
+	
+	/**
+	 * Per target counts and RTT percentiles (nanoseconds)
+	 *
+	 * @return array key => array(ip, port, protocol, sent, received, lost, count, min, mean, p50, p99, p999, max)
+	 */
+	public function getResults() {
+		$results = array();
+		
+		foreach ($this->_targets as $key => $target) {
+			$results[$key] = array_merge(array(
+				'ip' => $target[self::T_IP],
+				'port' => $target[self::T_PORT],
+				'protocol' => $target[self::T_PROTOCOL] == self::TCP_SYN ? 'tcp' : 'udp',
+				'sent' => $target[self::T_SENT],
+				'received' => $target[self::T_RECEIVED],
+				'lost' => $target[self::T_LOST],
+			), $this->_histograms[$key]->getSummary());
+		}
+		
+		return $results;
+	}
+	
+	/**
+	 * @param string $key
+	 * @return LatencyHistogram
+	 */
+	public function getHistogram($key) {
+		return isset($this->_histograms[$key]) ? $this->_histograms[$key] : null;
+	}
+	
+	public function getStats() {
+		$stats = $this->_stats;
+		$stats['targets'] = count($this->_targets);
+		$stats['pending'] = count($this->_pending[PROT_TCP]) + count($this->_pending[PROT_UDP]);
+		
+		return $stats;
+	}
+	
+	/**
+	 * Build the probe of a target with the next identifier
+	 *
+	 * @param array $target
+	 * @return array identifier, packet
+	 */
+	private function buildProbe(array $target) {
+		$ip = new IPv4ProtocolPacket();
+		$ip->setIdSequence(mt_rand(0, 0xFFFF));
+		$ip->setProtocol($target[self::T_PROTOCOL]);
+		$ip->setSrcIP($this->_srcIP);
+		$ip->setDstIP($target[self::T_IP]);
+		
+		if ($target[self::T_PROTOCOL] == self::TCP_SYN) {
+			$id = $this->_sequence;
+			$this->_sequence = ($this->_sequence + 1) & 0xFFFFFFFF;
+			
+			$content = new TCPProtocolPacket();
+			$content->setSrcPort($this->_srcPort);
+			$content->setIdSequence($id);
+			$content->setFlags(ITCP::FLAG_SYN);
+			$content->setWindowSize(1024);
+		}
+		else {
+			$id = $this->_udpPort;
+			$this->_udpPort = $this->_udpPort == $this->_udpPortLast ? $this->_udpPortFirst : $this->_udpPort + 1;
+			
+			$content = new UDPProtocolPacket();
+			$content->setSrcPort($id);
+			$content->setData('');
+		}
+		
+		$content->setDstPort($target[self::T_PORT]);
+		$ip->setData($content);
+		
+		return array($id, $ip);
+	}
+	
+	/**
+	 * Send a batch of probes and register the ones that went out as outstanding,
+	 * the rest counts as failed
+	 *
+	 * @param int $protocol
+	 * @param array $batch target key => array(identifier, packet)
+	 * @return int
+	 */
+	private function flush($protocol, array $batch) {
+		$packets = array();
+		foreach ($batch as $probe) {
+			$packets[] = $probe[1];
+		}
+		
+		$now = $this->now();
+		
+		try {
+			$sent = $this->_networks[$protocol]->sendPackets($packets);
+		}
+		catch (Exception $e) {
+			$sent = 0;
+		}
+		
+		$pending =& $this->_pending[$protocol];
+		
+		foreach (array_slice($batch, 0, $sent, true) as $key => $probe) {
+			$id = $probe[0];
+			
+			//an identifier still in use (udp ports wrapped around) can't be matched anymore
+			if (isset($pending[$id])) {
+				$this->lost($pending[$id][0]);
+				unset($pending[$id]);
+			}
+			
+			$pending[$id] = array($key, $now);
+			$this->_targets[$key][self::T_SENT]++;
+		}
+		
+		$this->_stats['sent'] += $sent;
+		$this->_stats['failed'] += count($batch) - $sent;
+		
+		return $sent;
+	}
+	
+	/**
+	 * Match a reply with its probe
+	 *
+	 * @param IPv4ProtocolPacket $packet
+	 * @return bool
+	 */
+	private function match(IPv4ProtocolPacket $packet) {
+		$protocol = $packet->getProtocol();
+		
+		if ($protocol == PROT_ICMP)
+			return $this->matchUnreachable($packet);
+		
+		if (!isset($this->_pending[$protocol]))
+			return false;
+		
+		$content = $packet->getDataObject(true);
+		
+		if ($protocol == PROT_TCP) {
+			//SYN-ACK (open) and RST-ACK (closed) both acknowledge the SYN
+			if ($content->getDstPort() != $this->_srcPort || !($content->getFlags() & ITCP::FLAG_ACK))
+				return false;
+			
+			$id = ($content->getAckIdSequence() - 1) & 0xFFFFFFFF;
+		}
+		else {
+			$id = $content->getDstPort();
+			
+			if ($id < $this->_udpPortFirst || $id > $this->_udpPortLast)
+				return false;
+		}
+		
+		return $this->reply($protocol, $id, $packet->getSrcIP(), $content->getSrcPort(), $packet);
+	}
+	
+	/**
+	 * Match the ICMP port unreachable of a UDP probe, it quotes the IP header
+	 * and the first 8 bytes of the probe
+	 *
+	 * @param IPv4ProtocolPacket $packet
+	 * @return bool
+	 */
+	private function matchUnreachable(IPv4ProtocolPacket $packet) {
+		$icmp = $packet->getDataObject();
+		
+		if ($icmp->getType() != IICMP::TYPE_DEST_UNREACH || $icmp->getCode() != IICMP::CODE_PORT_UNREACH)
+			return false;
+		
+		$quoted = $icmp->getData();
+		
+		if (strlen($quoted) < IIPv4::HEADER_SIZE + IUDP::HEADER_SIZE)
+			return false;
+		
+		$headerLength = (ord($quoted[0]) & 0x0F) * 4;
+		
+		if (ord($quoted[IIPv4::PROTOCOL]) != PROT_UDP || strlen($quoted) < $headerLength + IUDP::HEADER_SIZE)
+			return false;
+		
+		$ports = unpack('nsrc/ndst', substr($quoted, $headerLength, 4));
+		
+		if ($ports['src'] < $this->_udpPortFirst || $ports['src'] > $this->_udpPortLast)
+			return false;
+		
+		//the quoted destination is the target, whoever sent the error
+		$dst = long2ip(current(unpack('N', substr($quoted, IIPv4::IP_DST, 4))));
+		
+		return $this->reply(PROT_UDP, $ports['src'], $dst, $ports['dst'], $packet);
+	}
+	
+	/**
+	 * Record the RTT of an outstanding probe
+	 *
+	 * @param int $protocol
+	 * @param int $id
+	 * @param string $ip address the probe was sent to
+	 * @param int $port port the probe was sent to
+	 * @param IPv4ProtocolPacket $packet reply
+	 * @return bool
+	 */
+	private function reply($protocol, $id, $ip, $port, IPv4ProtocolPacket $packet) {
+		if (!isset($this->_pending[$protocol][$id])) {
+			$this->_stats['unmatched']++;
+			return false;
+		}
+		
+		list($key, $sent) = $this->_pending[$protocol][$id];
+		$target = $this->_targets[$key];
+		
+		if ($ip != $target[self::T_IP] || $port != $target[self::T_PORT]) {
+			$this->_stats['unmatched']++;
+			return false;
+		}
+		
+		unset($this->_pending[$protocol][$id]);
+		
+		$received = $packet->getReceiveInfo('timestamp');
+		
+		if ($received === null)
+			$received = $this->now();
+		
+		$this->_histograms[$key]->record($received - $sent);
+		$this->_targets[$key][self::T_RECEIVED]++;
+		$this->_stats['received']++;
+		
+		return true;
+	}
+	
+	/**
+	 * Count the probes sent before $now - timeout as lost
+	 *
+	 * @param int $now nanoseconds
+	 */
+	private function expire($now) {
+		$deadline = $now - $this->_timeout * 1000000000;
+		
+		foreach (array_keys($this->_pending) as $protocol) {
+			$pending =& $this->_pending[$protocol];
+			
+			//send order, the oldest probe is first
+			while (($probe = reset($pending)) !== false && $probe[1] <= $deadline) {
+				unset($pending[key($pending)]);
+				$this->lost($probe[0]);
+			}
+			
+			unset($pending);
+		}
+	}
+	
+	private function lost($key) {
+		$this->_targets[$key][self::T_LOST]++;
+		$this->_stats['lost']++;
+	}
+	
+	/**
+	 * Current time on the clock of the kernel receive timestamps
+	 *
+	 * @return int nanoseconds
+	 */
+	private function now() {
+		if (PRNL_NATIVE)
+			return prnl_clock_gettime(RawNetwork::CLOCK_REALTIME);
+		
+		return (int)(microtime(true) * 1000000000);
+	}
+}
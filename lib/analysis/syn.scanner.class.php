@@ -0,0 +1,290 @@
+<?php
+
+/**
+ * Stateless SYN scanner
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/**
+ * Stateless TCP SYN sweep of owned address ranges
+ * 
+ * The sequence number of every SYN is a keyed hash of its 4-tuple, a SYN-ACK
+ * (open) or RST (closed) is valid when its ack - 1 equals the hash of the
+ * reversed tuple, so no state is kept per target and memory is constant
+ * whatever the size of the sweep. The address x port space is walked in the
+ * order of a keyed permutation (a Feistel network with cycle walking), which
+ * spreads the load over hosts and ports, and sending is paced to a rate.
+ * 
+ * Every scanned range must lie inside the allow-list given to the
+ * constructor: this is for inventorying your own infrastructure. Replies
+ * from outside the allow-list are ignored. A host answering twice is
+ * reported twice, deduplicating would need state.
+ */
+class SYNScanner {
+	const FEISTEL_ROUNDS = 4;
+	
+	private $_network;
+	private $_srcIP;
+	private $_srcPort;
+	private $_key;
+	private $_allowed = array();
+	private $_batchSize;
+	
+	private $_stats = array(
+		'sent' => 0,
+		'open' => 0,
+		'closed' => 0,
+		'invalid' => 0,
+	);
+	
+	/**
+	 * @param string $srcIP
+	 * @param array $allowList CIDR ranges (10.0.0.0/16) that may be scanned
+	 * @param string $key secret of the sequence numbers and the permutation, random when null
+	 * @param int $srcPort
+	 * @param int $batchSize SYNs per sendPackets call
+	 */
+	public function __construct($srcIP, array $allowList, $key = null, $srcPort = 40000, $batchSize = 64) {
+		if (count($allowList) == 0)
+			throw new Exception('Empty allow-list!');
+		
+		foreach ($allowList as $cidr) {
+			$this->_allowed[] = self::parseRange($cidr);
+		}
+		
+		$this->_srcIP = $srcIP;
+		$this->_srcPort = $srcPort;
+		$this->_key = $key === null ? uniqid(mt_rand(), true) : $key;
+		$this->_batchSize = max(1, $batchSize);
+		
+		$this->_network = new RawIPNetwork();
+		$this->_network->createIPSocket(PROT_IPv4, PROT_TCP);
+	}
+	
+	/**
+	 * Sweep ranges x ports
+	 *
+	 * @param array $ranges CIDR ranges, each inside the allow-list
+	 * @param array $ports
+	 * @param callback $handler called as handler($ip, $port, $open) for every valid reply
+	 * @param int $rate SYNs per second
+	 * @param float $wait seconds to wait for replies after the last SYN
+	 * @return array stats
+	 */
+	public function scan(array $ranges, array $ports, $handler, $rate = 10000, $wait = 2) {
+		$rate = max(1, $rate);
+		
+		//cumulative offsets of the ranges in the address space
+		$blocks = array();
+		$addresses = 0;
+		
+		foreach ($ranges as $cidr) {
+			list($start, $count) = self::parseRange($cidr);
+			
+			if (!$this->isAllowed($start, $count))
+				throw new Exception($cidr . ' is not inside the allow-list!');
+			
+			$blocks[] = array($addresses, $start, $count);
+			$addresses += $count;
+		}
+		
+		$ports = array_values(array_unique(array_map('intval', $ports)));
+		$total = $addresses * count($ports);
+		
+		if ($total == 0)
+			return $this->getStats();
+		
+		//smallest even number of bits covering the space, cycle walking skips what's above $total
+		$bits = 2;
+		while ((1 << $bits) < $total)
+			$bits += 2;
+		
+		$start = microtime(true);
+		$batch = array();
+		
+		for ($i = 0; $i < $total; $i++) {
+			$index = $i;
+			
+			do {
+				$index = $this->permute($index, $bits);
+			} while ($index >= $total);
+			
+			$port = $ports[(int)($index / $addresses)];
+			$address = $index % $addresses;
+			
+			//few ranges, a linear search is fine
+			foreach ($blocks as $block) {
+				if ($address < $block[0] + $block[2]) {
+					$address = $block[1] + $address - $block[0];
+					break;
+				}
+			}
+			
+			$batch[] = $this->buildSYN(long2ip($address), $port);
+			
+			if (count($batch) >= $this->_batchSize) {
+				$this->_stats['sent'] += $this->_network->sendPackets($batch);
+				$batch = array();
+				
+				$this->receive($handler, 0);
+				
+				//pacing: wait until the SYNs sent so far are within the rate
+				$ahead = ($i + 1) / $rate - (microtime(true) - $start);
+				
+				if ($ahead > 0)
+					usleep((int)($ahead * 1000000));
+			}
+		}
+		
+		if (count($batch) > 0)
+			$this->_stats['sent'] += $this->_network->sendPackets($batch);
+		
+		$deadline = microtime(true) + $wait;
+		
+		while (($left = $deadline - microtime(true)) > 0) {
+			$this->receive($handler, $left);
+		}
+		
+		return $this->getStats();
+	}
+	
+	public function getStats() {
+		return $this->_stats;
+	}
+	
+	/**
+	 * Sequence number of a SYN from us to $dstIP:$dstPort
+	 *
+	 * @param string $dstIP
+	 * @param int $dstPort
+	 * @return int
+	 */
+	public function cookie($dstIP, $dstPort) {
+		$hash = unpack('N', hash_hmac('md5', pack('NNnn', ip2long($this->_srcIP), ip2long($dstIP), $this->_srcPort, $dstPort), $this->_key, true));
+		
+		return $hash[1] & 0xFFFFFFFF;
+	}
+	
+	private function buildSYN($dstIP, $dstPort) {
+		$ip = new IPv4ProtocolPacket();
+		$ip->setIdSequence(mt_rand(0, 0xFFFF));
+		$ip->setProtocol(PROT_TCP);
+		$ip->setSrcIP($this->_srcIP);
+		$ip->setDstIP($dstIP);
+		
+		$tcp = new TCPProtocolPacket();
+		$tcp->setSrcPort($this->_srcPort);
+		$tcp->setDstPort($dstPort);
+		$tcp->setIdSequence($this->cookie($dstIP, $dstPort));
+		$tcp->setFlags(ITCP::FLAG_SYN);
+		$tcp->setWindowSize(1024);
+		
+		$ip->setData($tcp);
+		
+		return $ip;
+	}
+	
+	/**
+	 * Validate the replies that arrive within $seconds
+	 *
+	 * @param callback $handler
+	 * @param float $seconds 0 to only read what is queued
+	 */
+	private function receive($handler, $seconds) {
+		$read = array($this->_network->getSocket());
+		$write = null;
+		$except = null;
+		
+		if (!@socket_select($read, $write, $except, (int)$seconds, (int)(($seconds - (int)$seconds) * 1000000)))
+			return;
+		
+		foreach ($this->_network->readPackets($this->_batchSize) as $packet) {
+			if ($packet->getProtocol() != PROT_TCP)
+				continue;
+			
+			$tcp = $packet->getDataObject(true);
+			
+			if ($tcp->getDstPort() != $this->_srcPort || !($tcp->getFlags() & ITCP::FLAG_ACK))
+				continue;
+			
+			$srcIP = $packet->getSrcIP();
+			$srcPort = $tcp->getSrcPort();
+			
+			if (!$this->isAllowed(ip2long($srcIP), 1) || (($tcp->getAckIdSequence() - 1) & 0xFFFFFFFF) != $this->cookie($srcIP, $srcPort)) {
+				$this->_stats['invalid']++;
+				continue;
+			}
+			
+			$open = ($tcp->getFlags() & ITCP::FLAG_SYN) != 0;
+			$this->_stats[$open ? 'open' : 'closed']++;
+			
+			call_user_func($handler, $srcIP, $srcPort, $open);
+		}
+	}
+	
+	/**
+	 * One step of the keyed permutation of [0, 2^bits)
+	 *
+	 * @param int $value
+	 * @param int $bits even
+	 * @return int
+	 */
+	private function permute($value, $bits) {
+		$half = $bits >> 1;
+		$mask = (1 << $half) - 1;
+		
+		$left = $value >> $half;
+		$right = $value & $mask;
+		
+		for ($round = 0; $round < self::FEISTEL_ROUNDS; $round++) {
+			$next = $left ^ (crc32($this->_key . $round . $right) & $mask);
+			$left = $right;
+			$right = $next;
+		}
+		
+		return ($left << $half) | $right;
+	}
+	
+	private function isAllowed($start, $count) {
+		foreach ($this->_allowed as $range) {
+			if ($start >= $range[0] && $start + $count <= $range[0] + $range[1])
+				return true;
+		}
+		
+		return false;
+	}
+	
+	/**
+	 * @param string $cidr 10.0.0.0/16 or a single address
+	 * @return array first address (int), number of addresses
+	 */
+	private static function parseRange($cidr) {
+		$parts = explode('/', $cidr);
+		$bits = isset($parts[1]) ? (int)$parts[1] : 32;
+		$ip = ip2long($parts[0]);
+		
+		if ($ip === false || $bits < 0 || $bits > 32)
+			throw new Exception('Invalid range ' . $cidr . '!');
+		
+		$count = 1 << (32 - $bits);
+		
+		return array($ip & ~($count - 1) & 0xFFFFFFFF, $count);
+	}
+}
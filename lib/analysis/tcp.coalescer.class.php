@@ -0,0 +1,258 @@
+<?php
+
+/**
+ * TCP Coalescer Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * Receive side coalescing of TCP segments (like the kernel's GRO)
+ * 
+ * In-order segments of the same flow with compatible headers are merged
+ * into one IPv4ProtocolPacket, so bulk transfers cost one object and one
+ * handler call per up to 64 KB instead of per segment. The headers are
+ * those of the first segment with the total length, IP checksum, window
+ * and PSH flag updated; the TCP checksum is not recalculated. The receive
+ * info of a merged packet holds 'segments' (number of segments) and
+ * 'gso_size' (payload size of the first segment), so together with the
+ * sequence number of the header no sequence information is lost.
+ * 
+ * A flow is flushed on a gap, a change of flags or headers, a segment
+ * larger than the first, PSH, when the next segment would make the packet
+ * exceed 65535 bytes or after the timeout.
+ * Everything that can't be merged is passed through unchanged.
+ */
+class TCPCoalescer {
+	//flow fields
+	const F_HEADER   = 0; // IP and TCP header of the first segment
+	const F_PAYLOAD  = 1; // payloads
+	const F_NEXT     = 2; // next expected sequence number
+	const F_BYTES    = 3;
+	const F_SIZE     = 4; // payload size of the first segment
+	const F_MATCH    = 5; // header bytes every next segment must equal
+	const F_WINDOW   = 6; // window of the last segment
+	const F_FIRST    = 7; // time the first segment was added
+	const F_INFO     = 8; // receive info of the first segment
+	
+	const MAX_LENGTH = 65535; // IPv4 total length of a merged packet, headers included
+	
+	private $_handler;
+	private $_timeout;
+	private $_maxFlows;
+	
+	private $_flows = array();
+	
+	private $_stats = array(
+		'packets'   => 0,
+		'merged'    => 0,
+		'delivered' => 0,
+	);
+	
+	/**
+	 * @param callback $handler called as handler(IPv4ProtocolPacket $packet)
+	 * @param float $timeout seconds a segment may wait for the next one
+	 * @param int $maxFlows flows held at the same time
+	 */
+	public function __construct($handler, $timeout = 0.001, $maxFlows = 1024) {
+		if (!is_callable($handler))
+			throw new Exception('Invalid handler!');
+		
+		$this->_handler = $handler;
+		$this->_timeout = $timeout;
+		$this->_maxFlows = $maxFlows;
+	}
+	
+	/**
+	 * Add a received IPv4 packet
+	 *
+	 * @param RawPacket $packet
+	 * @param float $now defaults to the current time
+	 */
+	public function add(RawPacket $packet, $now = null) {
+		if ($now === null)
+			$now = microtime(true);
+		
+		$this->_stats['packets']++;
+		
+		if (count($this->_flows) > 0) {
+			$first = reset($this->_flows);
+			
+			if ($now - $first[self::F_FIRST] >= $this->_timeout)
+				$this->flush($now);
+		}
+		
+		$raw = $packet->getRawPacket();
+		$ipLength = strlen($raw) > 0 ? (ord($raw[IIPv4::VERSION_LENGTH]) & 0x0F) * 4 : 0;
+		
+		if ($ipLength < IIPv4::HEADER_SIZE || strlen($raw) < $ipLength + ITCP::HEADER_SIZE || ord($raw[IIPv4::PROTOCOL]) != PROT_TCP
+			|| (((ord($raw[IIPv4::OFFSET]) << 8) | ord($raw[IIPv4::OFFSET + 1])) & (IIPv4::FLAG_MF | IIPv4::OFFSET_MASK)) != 0) {
+			$this->deliver($packet);
+			return;
+		}
+		
+		$totalLength = (ord($raw[IIPv4::LENGTH]) << 8) | ord($raw[IIPv4::LENGTH + 1]);
+		$tcpLength = (ord($raw[$ipLength + ITCP::SEG_OFF]) >> 4) * 4;
+		$headerLength = $ipLength + $tcpLength;
+		
+		if ($totalLength > strlen($raw) || $totalLength < $headerLength) {
+			$this->deliver($packet);
+			return;
+		}
+		
+		//same layout as FlowTable::packetKey
+		$key = substr($raw, IIPv4::IP_SRC, 8) . substr($raw, $ipLength, 4) . chr(PROT_TCP);
+		$flags = ord($raw[$ipLength + ITCP::FLAGS]);
+		$payloadLength = $totalLength - $headerLength;
+		list(, $seq) = unpack('N', substr($raw, $ipLength + ITCP::ID_SEQ, 4));
+		
+		//only plain ACK segments with data are merged
+		if ($payloadLength == 0 || ($flags & ~(ITCP::FLAG_ACK | ITCP::FLAG_PUSH)) != 0) {
+			$this->flushFlow($key);
+			$this->deliver($packet);
+			return;
+		}
+		
+		//everything but length, ID, checksums, sequence number and window has to be equal
+		$match = substr($raw, 0, IIPv4::LENGTH) . substr($raw, IIPv4::OFFSET, 4) . substr($raw, IIPv4::IP_SRC, $ipLength - IIPv4::IP_SRC)
+			. substr($raw, $ipLength + ITCP::ACK_ID_SEQ, 5) . chr($flags & ~ITCP::FLAG_PUSH) . substr($raw, $ipLength + ITCP::DATA, $tcpLength - ITCP::DATA);
+		
+		if (isset($this->_flows[$key])) {
+			$flow = $this->_flows[$key];
+			
+			if ($flow[self::F_NEXT] == $seq && $flow[self::F_MATCH] === $match && $payloadLength <= $flow[self::F_SIZE]
+				&& strlen($flow[self::F_HEADER]) + $flow[self::F_BYTES] + $payloadLength <= self::MAX_LENGTH) {
+				$this->_flows[$key][self::F_PAYLOAD][] = substr($raw, $headerLength, $payloadLength);
+				$this->_flows[$key][self::F_NEXT] = ($seq + $payloadLength) & 0xFFFFFFFF;
+				$this->_flows[$key][self::F_BYTES] += $payloadLength;
+				$this->_flows[$key][self::F_WINDOW] = substr($raw, $ipLength + ITCP::WINDOW, 2);
+				$this->_stats['merged']++;
+				
+				//a smaller segment ends a burst, like PSH
+				if (($flags & ITCP::FLAG_PUSH) || $payloadLength < $flow[self::F_SIZE])
+					$this->flushFlow($key, ITCP::FLAG_PUSH & $flags);
+				
+				return;
+			}
+			
+			$this->flushFlow($key);
+		}
+		
+		if ($flags & ITCP::FLAG_PUSH) {
+			$this->deliver($packet);
+			return;
+		}
+		
+		if (count($this->_flows) >= $this->_maxFlows) {
+			reset($this->_flows);
+			$this->flushFlow(key($this->_flows));
+		}
+		
+		$this->_flows[$key] = array(
+			substr($raw, 0, $headerLength),
+			array(substr($raw, $headerLength, $payloadLength)),
+			($seq + $payloadLength) & 0xFFFFFFFF,
+			$payloadLength,
+			$payloadLength,
+			$match,
+			substr($raw, $ipLength + ITCP::WINDOW, 2),
+			$now,
+			$packet->getReceiveInfo(),
+		);
+	}
+	
+	/**
+	 * Flush the flows that waited longer than the timeout, call this regularly
+	 * (e.g. from a TimerWheel or after every read timeout)
+	 *
+	 * @param float $now
+	 */
+	public function flush($now = null) {
+		if ($now === null)
+			$now = microtime(true);
+		
+		//flows are kept in order of their first segment
+		while (($flow = reset($this->_flows)) !== false && $now - $flow[self::F_FIRST] >= $this->_timeout) {
+			$this->flushFlow(key($this->_flows));
+		}
+	}
+	
+	/**
+	 * Flush all flows
+	 */
+	public function flushAll() {
+		foreach (array_keys($this->_flows) as $key) {
+			$this->flushFlow($key);
+		}
+	}
+	
+	/**
+	 * @return array packets (added), merged (segments merged into a previous one), delivered and held flows
+	 */
+	public function getStats() {
+		$stats = $this->_stats;
+		$stats['flows'] = count($this->_flows);
+		
+		return $stats;
+	}
+	
+	private function flushFlow($key, $push = 0) {
+		if (!isset($this->_flows[$key]))
+			return;
+		
+		$flow = $this->_flows[$key];
+		unset($this->_flows[$key]);
+		
+		$header = $flow[self::F_HEADER];
+		$ipLength = (ord($header[IIPv4::VERSION_LENGTH]) & 0x0F) * 4;
+		$count = count($flow[self::F_PAYLOAD]);
+		
+		if ($count > 1) {
+			$total = strlen($header) + $flow[self::F_BYTES];
+			
+			$ip = substr($header, 0, IIPv4::LENGTH) . pack('n', $total) . substr($header, IIPv4::ID_SEQ, 6) . "\0\0" . substr($header, IIPv4::IP_SRC, $ipLength - IIPv4::IP_SRC);
+			$ip = substr($ip, 0, IIPv4::CHECKSUM) . pack('n', Checksum::finish(Checksum::partial($ip))) . substr($ip, IIPv4::IP_SRC);
+			
+			$tcp = substr($header, $ipLength, ITCP::FLAGS) . chr(ord($header[$ipLength + ITCP::FLAGS]) | $push)
+				. $flow[self::F_WINDOW] . substr($header, $ipLength + ITCP::CHECKSUM);
+			
+			$header = $ip . $tcp;
+		}
+		
+		$packet = new IPv4ProtocolPacket($header . implode('', $flow[self::F_PAYLOAD]));
+		
+		$info = is_array($flow[self::F_INFO]) ? $flow[self::F_INFO] : array();
+		$info['segments'] = $count;
+		$info['gso_size'] = $flow[self::F_SIZE];
+		$packet->setReceiveInfo($info);
+		
+		$this->_stats['delivered']++;
+		call_user_func($this->_handler, $packet);
+	}
+	
+	private function deliver(RawPacket $packet) {
+		if (!$packet instanceof IPv4ProtocolPacket) {
+			$info = $packet->getReceiveInfo();
+			$packet = new IPv4ProtocolPacket($packet->getRawPacket());
+			$packet->setReceiveInfo($info);
+		}
+		
+		$this->_stats['delivered']++;
+		call_user_func($this->_handler, $packet);
+	}
+}
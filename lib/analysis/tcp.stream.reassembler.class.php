@@ -0,0 +1,357 @@
+<?php
+
+/**
+ * TCP Stream Reassembler Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * Ordered TCP byte streams from captured segments
+ * 
+ * Every direction of a connection is a stream. In-order payload is handed to
+ * the data handler right away, out-of-order segments are kept as they are,
+ * with a min-heap of their stream offsets, and handed out once the hole
+ * before them is filled. Payloads are never concatenated: the handler gets every contiguous
+ * chunk separately as handler($key, $chunk, $offset), where $offset counts
+ * bytes since the start of the stream (sequence numbers are unwrapped, so
+ * wrap-around is no issue).
+ * 
+ * Retransmitted bytes are dropped and overlaps keep the bytes that arrived
+ * first. When a stream buffers more than its limit, or all streams together
+ * more than the global limit, the stream skips the hole; the handler sees a
+ * jump in $offset.
+ */
+class TCPStreamReassembler {
+	const CLOSE_FIN     = 1;
+	const CLOSE_RST     = 2;
+	const CLOSE_IDLE    = 3;
+	const CLOSE_EVICTED = 4;
+	
+	//stream fields
+	const S_BASE     = 0; // sequence number of stream offset 0
+	const S_NEXT     = 1; // next expected stream offset
+	const S_SEGMENTS = 2; // stream offset => payload
+	const S_BYTES    = 3; // buffered bytes
+	const S_FIN      = 4; // stream offset of the FIN, null until seen
+	const S_LAST     = 5; // last activity
+	const S_OFFSETS  = 6; // SplMinHeap of the buffered offsets, null until something is buffered
+	
+	private $_dataHandler;
+	private $_closeHandler = null;
+	
+	private $_streams = array();
+	private $_buffered = array();
+	private $_bytes = 0;
+	
+	private $_maxStreamBytes;
+	private $_maxBytes;
+	private $_maxStreams;
+	private $_idleTimeout;
+	
+	private $_stats = array(
+		'segments'        => 0,
+		'delivered'       => 0,
+		'out_of_order'    => 0,
+		'retransmissions' => 0,
+		'gaps'            => 0,
+	);
+	
+	/**
+	 * @param callback $dataHandler called as handler($key, $chunk, $offset)
+	 * @param int $maxStreamBytes out-of-order bytes a stream may buffer
+	 * @param int $maxBytes out-of-order bytes all streams together may buffer
+	 * @param float $idleTimeout seconds before an idle stream is closed
+	 * @param int $maxStreams
+	 */
+	public function __construct($dataHandler, $maxStreamBytes = 1048576, $maxBytes = 67108864, $idleTimeout = 120, $maxStreams = 65536) {
+		if (!is_callable($dataHandler))
+			throw new Exception('Invalid data handler!');
+		
+		$this->_dataHandler = $dataHandler;
+		$this->_maxStreamBytes = $maxStreamBytes;
+		$this->_maxBytes = $maxBytes;
+		$this->_idleTimeout = $idleTimeout;
+		$this->_maxStreams = $maxStreams;
+	}
+	
+	/**
+	 * @param callback $closeHandler called as handler($key, $reason) with a CLOSE_* reason
+	 */
+	public function setCloseHandler($closeHandler) {
+		$this->_closeHandler = $closeHandler;
+	}
+	
+	/**
+	 * Feed a captured packet, other packets than TCP are ignored
+	 *
+	 * @param IPv4ProtocolPacket $packet
+	 * @param float $now defaults to the current time
+	 * @return string the stream key (see FlowTable::packetKey), null when ignored
+	 */
+	public function add(IPv4ProtocolPacket $packet, $now = null) {
+		$raw = $packet->getRawPacket();
+		
+		if (ord($raw[IIPv4::PROTOCOL]) != PROT_TCP || $packet->isFragment())
+			return null;
+		
+		$ipLength = (ord($raw[IIPv4::VERSION_LENGTH]) & 0x0F) * 4;
+		$totalLength = (ord($raw[IIPv4::LENGTH]) << 8) | ord($raw[IIPv4::LENGTH + 1]);
+		if ($totalLength < $ipLength || $totalLength > strlen($raw))
+			$totalLength = strlen($raw);
+		
+		if ($totalLength < $ipLength + ITCP::HEADER_SIZE)
+			return null;
+		
+		$tcpLength = (ord($raw[$ipLength + ITCP::SEG_OFF]) >> 4) * 4;
+		list(, $seq) = unpack('N', substr($raw, $ipLength + ITCP::ID_SEQ, 4));
+		$flags = ord($raw[$ipLength + ITCP::FLAGS]);
+		$payload = (string)substr($raw, $ipLength + $tcpLength, $totalLength - $ipLength - $tcpLength);
+		
+		$key = FlowTable::packetKey($packet);
+		
+		$this->addSegment($key, $seq & 0xFFFFFFFF, $flags, $payload, $now === null ? microtime(true) : $now);
+		
+		return $key;
+	}
+	
+	/**
+	 * Feed a segment of a stream
+	 *
+	 * @param string $key stream key
+	 * @param int $seq sequence number
+	 * @param int $flags TCP flags
+	 * @param string $payload
+	 * @param float $now
+	 */
+	public function addSegment($key, $seq, $flags, $payload, $now) {
+		$this->_stats['segments']++;
+		
+		if (isset($this->_streams[$key])) {
+			$stream = $this->_streams[$key];
+			
+			//re-insert, the streams are kept in order of last activity
+			unset($this->_streams[$key]);
+		}
+		else {
+			//nothing to reassemble, also keeps trailing ACKs from reopening closed streams
+			if (($flags & ITCP::FLAG_RST) || (!($flags & ITCP::FLAG_SYN) && strlen($payload) == 0))
+				return;
+			
+			if (count($this->_streams) >= $this->_maxStreams) {
+				reset($this->_streams);
+				$this->close(key($this->_streams), self::CLOSE_EVICTED);
+			}
+			
+			//a SYN occupies one sequence number, without it we joined mid-stream
+			$stream = array(($flags & ITCP::FLAG_SYN) ? ($seq + 1) & 0xFFFFFFFF : $seq, 0, array(), 0, null, $now, null);
+		}
+		
+		$stream[self::S_LAST] = $now;
+		$this->_streams[$key] = $stream;
+		
+		if ($flags & ITCP::FLAG_RST) {
+			$this->close($key, self::CLOSE_RST);
+			return;
+		}
+		
+		if ($flags & ITCP::FLAG_SYN)
+			$seq = ($seq + 1) & 0xFFFFFFFF;
+		
+		$offset = $this->toOffset($this->_streams[$key], $seq);
+		$length = strlen($payload);
+		
+		if ($flags & ITCP::FLAG_FIN)
+			$this->_streams[$key][self::S_FIN] = $offset + $length;
+		
+		if ($length > 0) {
+			$next = $this->_streams[$key][self::S_NEXT];
+			
+			if ($offset + $length <= $next) {
+				$this->_stats['retransmissions']++;
+			}
+			else if ($offset <= $next) {
+				$this->deliver($key, $offset == $next ? $payload : substr($payload, $next - $offset), $next);
+				$this->drain($key);
+			}
+			else {
+				$this->buffer($key, $offset, $payload);
+			}
+		}
+		
+		$this->checkFin($key);
+	}
+	
+	/**
+	 * Close the streams without activity for longer than the idle timeout
+	 *
+	 * @param float $now
+	 * @return int number of streams closed
+	 */
+	public function expire($now = null) {
+		if ($now === null)
+			$now = microtime(true);
+		
+		//least recently active first, stop at the first stream that is still active
+		$closed = 0;
+		while (($stream = reset($this->_streams)) !== false && $now - $stream[self::S_LAST] >= $this->_idleTimeout) {
+			$this->close(key($this->_streams), self::CLOSE_IDLE);
+			$closed++;
+		}
+		
+		return $closed;
+	}
+	
+	/**
+	 * @return array segments, delivered, out_of_order, retransmissions, gaps, streams and buffered bytes
+	 */
+	public function getStats() {
+		$stats = $this->_stats;
+		$stats['streams'] = count($this->_streams);
+		$stats['bytes'] = $this->_bytes;
+		
+		return $stats;
+	}
+	
+	/**
+	 * Stream offset of a sequence number, relative to the next expected byte so wrapping works
+	 */
+	private function toOffset(array $stream, $seq) {
+		$diff = ($seq - (($stream[self::S_BASE] + $stream[self::S_NEXT]) & 0xFFFFFFFF)) & 0xFFFFFFFF;
+		
+		if ($diff >= 0x80000000)
+			$diff -= 0x100000000;
+		
+		return $stream[self::S_NEXT] + $diff;
+	}
+	
+	private function deliver($key, $chunk, $offset) {
+		$this->_streams[$key][self::S_NEXT] = $offset + strlen($chunk);
+		$this->_stats['delivered'] += strlen($chunk);
+		
+		call_user_func($this->_dataHandler, $key, $chunk, $offset);
+	}
+	
+	private function buffer($key, $offset, $payload) {
+		$this->_stats['out_of_order']++;
+		
+		$segments =& $this->_streams[$key][self::S_SEGMENTS];
+		
+		if (isset($segments[$offset])) {
+			if (strlen($segments[$offset]) >= strlen($payload)) {
+				$this->_stats['retransmissions']++;
+				return;
+			}
+			
+			$this->_streams[$key][self::S_BYTES] -= strlen($segments[$offset]);
+			$this->_bytes -= strlen($segments[$offset]);
+		}
+		else {
+			if ($this->_streams[$key][self::S_OFFSETS] === null)
+				$this->_streams[$key][self::S_OFFSETS] = new SplMinHeap();
+			
+			$this->_streams[$key][self::S_OFFSETS]->insert($offset);
+		}
+		
+		$segments[$offset] = $payload;
+		unset($segments);
+		
+		$this->_streams[$key][self::S_BYTES] += strlen($payload);
+		$this->_bytes += strlen($payload);
+		
+		unset($this->_buffered[$key]);
+		$this->_buffered[$key] = true;
+		
+		if ($this->_streams[$key][self::S_BYTES] > $this->_maxStreamBytes)
+			$this->skipGap($key);
+		
+		//over the global budget, skip the hole of the stream that buffered longest ago
+		while ($this->_bytes > $this->_maxBytes && count($this->_buffered) > 0) {
+			reset($this->_buffered);
+			$this->skipGap(key($this->_buffered));
+		}
+	}
+	
+	/**
+	 * Hand out the buffered segments that became contiguous
+	 */
+	private function drain($key) {
+		$offsets = $this->_streams[$key][self::S_OFFSETS];
+		
+		if ($offsets === null)
+			return;
+		
+		while (!$offsets->isEmpty() && ($offset = $offsets->top()) <= $this->_streams[$key][self::S_NEXT]) {
+			$offsets->extract();
+			
+			$next = $this->_streams[$key][self::S_NEXT];
+			$payload = $this->_streams[$key][self::S_SEGMENTS][$offset];
+			
+			unset($this->_streams[$key][self::S_SEGMENTS][$offset]);
+			$this->_streams[$key][self::S_BYTES] -= strlen($payload);
+			$this->_bytes -= strlen($payload);
+			
+			if ($offset + strlen($payload) > $next) {
+				$this->deliver($key, $offset == $next ? $payload : substr($payload, $next - $offset), $next);
+			}
+			else {
+				$this->_stats['retransmissions']++;
+			}
+		}
+		
+		if ($offsets->isEmpty())
+			unset($this->_buffered[$key]);
+	}
+	
+	/**
+	 * Give up on the missing bytes and continue at the first buffered segment
+	 */
+	private function skipGap($key) {
+		$offsets = $this->_streams[$key][self::S_OFFSETS];
+		
+		if ($offsets === null || $offsets->isEmpty()) {
+			unset($this->_buffered[$key]);
+			return;
+		}
+		
+		$this->_streams[$key][self::S_NEXT] = $offsets->top();
+		$this->_stats['gaps']++;
+		
+		$this->drain($key);
+		$this->checkFin($key);
+	}
+	
+	private function checkFin($key) {
+		if (isset($this->_streams[$key]) && $this->_streams[$key][self::S_FIN] !== null
+			&& $this->_streams[$key][self::S_NEXT] >= $this->_streams[$key][self::S_FIN]) {
+			$this->close($key, self::CLOSE_FIN);
+		}
+	}
+	
+	private function close($key, $reason) {
+		if (!isset($this->_streams[$key]))
+			return;
+		
+		$this->_bytes -= $this->_streams[$key][self::S_BYTES];
+		unset($this->_streams[$key]);
+		unset($this->_buffered[$key]);
+		
+		if ($this->_closeHandler !== null)
+			call_user_func($this->_closeHandler, $key, $reason);
+	}
+}
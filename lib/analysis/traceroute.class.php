@@ -0,0 +1,328 @@
+<?php
+
+/**
+ * Parallel traceroute
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/**
+ * Traceroute to many targets at once
+ * 
+ * UDP probes for every TTL of every target are sent in paced batches without
+ * waiting for replies. The probe id is carried in the IP ID (low 16 bits) and
+ * the UDP source port (high bits), both of which come back in the header that
+ * an ICMP time exceeded or port unreachable quotes
+ * (ICMPProtocolPacket::getData), so a reply is matched with one hash lookup.
+ * Port unreachable from the target itself ends its path. With the native
+ * extension the RTTs use the kernel receive timestamps.
+ */
+class Traceroute {
+	const BASE_PORT = 33434;
+	const SRC_PORT  = 32768; // source ports from here carry the high bits of the probe id
+	
+	private $_srcIP;
+	private $_maxTTL;
+	private $_probes;
+	private $_timeout;
+	private $_rate;
+	private $_batchSize;
+	
+	private $_send;
+	private $_receive;
+	
+	private $_targets = array();
+	private $_id = 1;
+	
+	//outstanding probes: id => array(target, ttl, send time)
+	private $_pending = array();
+	
+	//target => ttl => array of array(ip, rtt)
+	private $_hops = array();
+	
+	//target => ttl at which it answered itself
+	private $_reached = array();
+	
+	private $_stats = array(
+		'sent' => 0,
+		'failed' => 0,
+	);
+	
+	/**
+	 * @param string $srcIP
+	 * @param int $maxTTL
+	 * @param int $probes probes per hop
+	 * @param float $timeout seconds to wait for replies after the last probe
+	 * @param int $rate probes per second
+	 * @param int $batchSize probes per sendPackets call
+	 */
+	public function __construct($srcIP, $maxTTL = 30, $probes = 1, $timeout = 2, $rate = 10000, $batchSize = 64) {
+		if ($maxTTL < 1 || $maxTTL > 255)
+			throw new Exception('Invalid max TTL!');
+		
+		$this->_srcIP = $srcIP;
+		$this->_maxTTL = $maxTTL;
+		$this->_probes = max(1, $probes);
+		$this->_timeout = $timeout;
+		$this->_rate = max(1, $rate);
+		$this->_batchSize = max(1, $batchSize);
+		
+		$this->_send = new RawIPNetwork();
+		$this->_send->createIPSocket(PROT_IPv4, PROT_UDP);
+		
+		$this->_receive = new RawIPNetwork();
+		$this->_receive->createIPSocket(PROT_IPv4, PROT_ICMP);
+		
+		if (PRNL_NATIVE)
+			$this->_receive->enableTimestamps();
+	}
+	
+	public function addTarget($ip) {
+		$this->_targets[] = $ip;
+		$this->_hops[] = array();
+	}
+	
+	/**
+	 * Trace all targets
+	 *
+	 * @return array see getResults()
+	 */
+	public function run() {
+		$batch = array();
+		$ids = array();
+		$sent = 0;
+		$start = microtime(true);
+		
+		foreach (array_keys($this->_stats) as $name) {
+			$this->_stats[$name] = 0;
+		}
+		
+		//ttl first, so consecutive probes go to different routers
+		for ($ttl = 1; $ttl <= $this->_maxTTL; $ttl++) {
+			foreach ($this->_targets as $target => $ip) {
+				//a shorter path is already known
+				if (isset($this->_reached[$target]) && $this->_reached[$target] < $ttl)
+					continue;
+				
+				for ($probe = 0; $probe < $this->_probes; $probe++) {
+					//the kernel gives a packet with IP ID 0 an ID of its own, its reply couldn't be matched
+					if (($this->_id & 0xFFFF) == 0)
+						$this->_id++;
+					
+					$id = $this->_id++;
+					$ids[$id] = array($target, $ttl);
+					$batch[] = $this->buildProbe($ip, $ttl, $id);
+					
+					if (count($batch) >= $this->_batchSize) {
+						$sent += $this->flush($batch, $ids);
+						$batch = array();
+						$ids = array();
+						
+						$this->receive(0);
+						
+						//pacing: wait until the probes sent so far are within the rate
+						$ahead = $sent / $this->_rate - (microtime(true) - $start);
+						
+						if ($ahead > 0)
+							usleep((int)($ahead * 1000000));
+					}
+				}
+			}
+		}
+		
+		if (count($batch) > 0)
+			$this->flush($batch, $ids);
+		
+		$deadline = microtime(true) + $this->_timeout;
+		
+		while (count($this->_pending) > 0 && ($left = $deadline - microtime(true)) > 0) {
+			$this->receive($left);
+		}
+		
+		$this->_pending = array();
+		
+		return $this->getResults();
+	}
+	
+	/**
+	 * Hops per target, up to the target itself when it was reached
+	 *
+	 * @return array ip => array('reached' => bool, 'hops' => array(ttl => array(array('ip' => hop, 'rtt' => ns), ...)))
+	 */
+	public function getResults() {
+		$results = array();
+		
+		foreach ($this->_targets as $target => $ip) {
+			$hops = $this->_hops[$target];
+			ksort($hops);
+			
+			if (isset($this->_reached[$target])) {
+				foreach (array_keys($hops) as $ttl) {
+					if ($ttl > $this->_reached[$target])
+						unset($hops[$ttl]);
+				}
+			}
+			
+			$results[$ip] = array(
+				'reached' => isset($this->_reached[$target]),
+				'hops' => $hops,
+			);
+		}
+		
+		return $results;
+	}
+	
+	public function getStats() {
+		return $this->_stats;
+	}
+	
+	private function buildProbe($dstIP, $ttl, $id) {
+		$ip = new IPv4ProtocolPacket();
+		$ip->setIdSequence($id & 0xFFFF);
+		$ip->setTTL($ttl);
+		$ip->setProtocol(PROT_UDP);
+		$ip->setSrcIP($this->_srcIP);
+		$ip->setDstIP($dstIP);
+		
+		$udp = new UDPProtocolPacket();
+		$udp->setSrcPort(self::SRC_PORT + ($id >> 16));
+		$udp->setDstPort(self::BASE_PORT + $ttl);
+		$udp->setData('');
+		
+		$ip->setData($udp);
+		
+		return $ip;
+	}
+	
+	/**
+	 * Send a batch of probes and register the ones that went out as outstanding,
+	 * the rest counts as failed
+	 *
+	 * @param array $batch IPv4ProtocolPacket objects
+	 * @param array $ids probe id => array(target, ttl), in the order of $batch
+	 * @return int
+	 */
+	private function flush(array $batch, array $ids) {
+		$now = $this->now();
+		
+		try {
+			$sent = $this->_send->sendPackets($batch);
+		}
+		catch (Exception $e) {
+			$sent = 0;
+		}
+		
+		foreach (array_slice($ids, 0, $sent, true) as $id => $probe) {
+			$probe[] = $now;
+			$this->_pending[$id] = $probe;
+		}
+		
+		$this->_stats['sent'] += $sent;
+		$this->_stats['failed'] += count($batch) - $sent;
+		
+		return $sent;
+	}
+	
+	/**
+	 * Match the ICMP errors that arrive within $seconds
+	 *
+	 * @param float $seconds 0 to only read what is queued
+	 */
+	private function receive($seconds) {
+		$read = array($this->_receive->getSocket());
+		$write = null;
+		$except = null;
+		
+		if (!@socket_select($read, $write, $except, (int)$seconds, (int)(($seconds - (int)$seconds) * 1000000)))
+			return;
+		
+		foreach ($this->_receive->readPackets($this->_batchSize) as $packet) {
+			$this->match($packet);
+		}
+	}
+	
+	/**
+	 * The ICMP error quotes the IP header and the first 8 bytes of our UDP probe
+	 *
+	 * @param IPv4ProtocolPacket $packet
+	 */
+	private function match(IPv4ProtocolPacket $packet) {
+		if ($packet->getProtocol() != PROT_ICMP)
+			return;
+		
+		$icmp = $packet->getDataObject();
+		$type = $icmp->getType();
+		
+		if ($type != IICMP::TYPE_TIME_EXCEEDED && !($type == IICMP::TYPE_DEST_UNREACH && $icmp->getCode() == IICMP::CODE_PORT_UNREACH))
+			return;
+		
+		$quoted = $icmp->getData();
+		
+		if (strlen($quoted) < IIPv4::HEADER_SIZE + IUDP::HEADER_SIZE)
+			return;
+		
+		$headerLength = (ord($quoted[0]) & 0x0F) * 4;
+		
+		if (ord($quoted[IIPv4::PROTOCOL]) != PROT_UDP || strlen($quoted) < $headerLength + IUDP::HEADER_SIZE)
+			return;
+		
+		$fields = unpack('nipid', substr($quoted, IIPv4::ID_SEQ, 2));
+		$ports = unpack('nsrc/ndst', substr($quoted, $headerLength, 4));
+		
+		if ($ports['src'] < self::SRC_PORT)
+			return;
+		
+		$id = ($ports['src'] - self::SRC_PORT) << 16 | $fields['ipid'];
+		
+		if (!isset($this->_pending[$id]))
+			return;
+		
+		list($target, $ttl, $sent) = $this->_pending[$id];
+		
+		//the quoted destination must be the target of the probe
+		if (long2ip(current(unpack('N', substr($quoted, IIPv4::IP_DST, 4)))) != $this->_targets[$target])
+			return;
+		
+		unset($this->_pending[$id]);
+		
+		$received = $packet->getReceiveInfo('timestamp');
+		
+		if ($received === null)
+			$received = $this->now();
+		
+		$this->_hops[$target][$ttl][] = array('ip' => $packet->getSrcIP(), 'rtt' => $received - $sent);
+		
+		if ($type == IICMP::TYPE_DEST_UNREACH && $packet->getSrcIP() == $this->_targets[$target]) {
+			if (!isset($this->_reached[$target]) || $ttl < $this->_reached[$target])
+				$this->_reached[$target] = $ttl;
+		}
+	}
+	
+	/**
+	 * Current time on the clock of the kernel receive timestamps
+	 *
+	 * @return int nanoseconds
+	 */
+	private function now() {
+		if (PRNL_NATIVE)
+			return prnl_clock_gettime(RawNetwork::CLOCK_REALTIME);
+		
+		return (int)(microtime(true) * 1000000000);
+	}
+}
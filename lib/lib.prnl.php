@@ -29,12 +29,20 @@ define('__PRNL_ROOT', dirname(__FILE__));
 define('__PRNL_ROOT_NETWORK', __PRNL_ROOT . DIR_SEP . 'network');
 define('__PRNL_ROOT_PROT', __PRNL_ROOT . DIR_SEP . 'protocols');
 define('__PRNL_ROOT_TOOLS', __PRNL_ROOT . DIR_SEP . 'tools');
+define('__PRNL_ROOT_ANALYSIS', __PRNL_ROOT . DIR_SEP . 'analysis');
+
+//use the native extension when it is loaded, unless it is disabled
+if (!defined('__PRNL_NO_EXTERNAL_MODULES'))
+	define('__PRNL_NO_EXTERNAL_MODULES', false);
+
+define('PRNL_NATIVE', !__PRNL_NO_EXTERNAL_MODULES && extension_loaded('prnlnative'));
 
 //ip protocols
 define('PROT_IPv4', 0);
 define('PROT_IPv6', 41);
 
 //content protocols
+define('PROT_ICMP', 1);
 define('PROT_TCP', 6);
 define('PROT_UDP', 17);
 
@@ -47,19 +55,50 @@ require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'ubyte.class.php');
 require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'ushort.class.php');
 require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'endian.class.php');
 require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'memory.class.php');
+require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'checksum.class.php');
+require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'shared.ring.class.php');
+require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'live.counters.class.php');
+require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'profiler.class.php');
+require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'latency.histogram.class.php');
+require_once(__PRNL_ROOT_TOOLS . DIR_SEP . 'timer.wheel.class.php');
 
 require_once(__PRNL_ROOT_NETWORK . DIR_SEP . 'raw.network.class.php');
 require_once(__PRNL_ROOT_NETWORK . DIR_SEP . 'raw.ip.network.class.php');
+require_once(__PRNL_ROOT_NETWORK . DIR_SEP . 'capture.supervisor.class.php');
 
-require_once(__PRNL_ROOT_NETWORK . DIR_SEP . 'raw.packet.class.php');
+//with prnlnative.classes=1 the native extension provides the packet classes itself, they can't be declared twice
+if (!class_exists('RawPacket', false))
+	require_once(__PRNL_ROOT_NETWORK . DIR_SEP . 'raw.packet.class.php');
 
-require_once(__PRNL_ROOT_PROT . DIR_SEP . 'completeable.protocol.interface.php');
+if (!interface_exists('ICompleteableProtocolPacket', false))
+	require_once(__PRNL_ROOT_PROT . DIR_SEP . 'completeable.protocol.interface.php');
 
 require_once(__PRNL_ROOT_PROT . DIR_SEP . 'ipv4.interface.php');
-require_once(__PRNL_ROOT_PROT . DIR_SEP . 'ipv4.protocol.class.php');
+if (!class_exists('IPv4ProtocolPacket', false))
+	require_once(__PRNL_ROOT_PROT . DIR_SEP . 'ipv4.protocol.class.php');
 
 require_once(__PRNL_ROOT_PROT . DIR_SEP . 'tcp.interface.php');
-require_once(__PRNL_ROOT_PROT . DIR_SEP . 'tcp.protocol.class.php');
+if (!class_exists('TCPProtocolPacket', false))
+	require_once(__PRNL_ROOT_PROT . DIR_SEP . 'tcp.protocol.class.php');
 
 require_once(__PRNL_ROOT_PROT . DIR_SEP . 'udp.interface.php');
-require_once(__PRNL_ROOT_PROT . DIR_SEP . 'udp.protocol.class.php');
\ No newline at end of file
+if (!class_exists('UDPProtocolPacket', false))
+	require_once(__PRNL_ROOT_PROT . DIR_SEP . 'udp.protocol.class.php');
+
+require_once(__PRNL_ROOT_PROT . DIR_SEP . 'icmp.interface.php');
+require_once(__PRNL_ROOT_PROT . DIR_SEP . 'icmp.protocol.class.php');
+
+require_once(__PRNL_ROOT_PROT . DIR_SEP . 'protocol.registry.class.php');
+ProtocolRegistry::register(PROT_ICMP, 'ICMPProtocolPacket', IICMP::HEADER_SIZE);
+ProtocolRegistry::register(PROT_TCP, 'TCPProtocolPacket', ITCP::HEADER_SIZE);
+ProtocolRegistry::register(PROT_UDP, 'UDPProtocolPacket', IUDP::HEADER_SIZE);
+
+require_once(__PRNL_ROOT_ANALYSIS . DIR_SEP . 'flow.table.class.php');
+require_once(__PRNL_ROOT_ANALYSIS . DIR_SEP . 'ipv4.reassembler.class.php');
+require_once(__PRNL_ROOT_ANALYSIS . DIR_SEP . 'tcp.stream.reassembler.class.php');
+require_once(__PRNL_ROOT_ANALYSIS . DIR_SEP . 'tcp.coalescer.class.php');
+require_once(__PRNL_ROOT_ANALYSIS . DIR_SEP . 'batch.decoder.class.php');
+require_once(__PRNL_ROOT_ANALYSIS . DIR_SEP . 'rtt.prober.class.php');
+require_once(__PRNL_ROOT_ANALYSIS . DIR_SEP . 'syn.scanner.class.php');
+require_once(__PRNL_ROOT_ANALYSIS . DIR_SEP . 'traceroute.class.php');
+require_once(__PRNL_ROOT_ANALYSIS . DIR_SEP . 'echo.sweep.class.php');
\ No newline at end of file
@@ -0,0 +1,273 @@
+<?php
+
+/**
+ * Capture Supervisor Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+class CaptureSupervisor {
+	private $_workers;
+	private $_fanoutMode;
+	private $_interface;
+	private $_groupId;
+	
+	private $_reportInterval = 1;
+	private $_statsKey = null;
+	
+	private $_children = array();
+	private $_channels = array();
+	private $_counters = array();
+	
+	private $_running = false;
+	private $_stopping = false;
+	
+	/**
+	 * @param int $workers number of capture processes
+	 * @param int $fanoutMode RawNetwork::FANOUT_* mode, FANOUT_HASH keeps a flow on one worker
+	 * @param string $interface only capture on this interface
+	 */
+	public function __construct($workers, $fanoutMode = RawNetwork::FANOUT_HASH, $interface = null) {
+		if ($workers < 1)
+			throw new Exception('At least one capture worker is required!');
+		
+		$this->_workers = $workers;
+		$this->_fanoutMode = $fanoutMode;
+		$this->_interface = $interface;
+		$this->_groupId = getmypid() & 0xFFFF;
+	}
+	
+	public function setReportInterval($seconds) {
+		$this->_reportInterval = max(1, (int)$seconds);
+	}
+	
+	/**
+	 * Let every worker publish live counters in its own slot of this counter block
+	 *
+	 * @param int $key SysV IPC key, read it with bin/prnl-stats
+	 */
+	public function setStatsKey($key) {
+		$this->_statsKey = $key;
+	}
+	
+	/**
+	 * Fork the workers and capture until all of them are stopped
+	 * 
+	 * Every worker calls $handler(IPv4ProtocolPacket $packet, int $workerId) for each
+	 * packet it receives, a handler returning false stops its worker. SIGINT or SIGTERM
+	 * to the supervisor stops all workers.
+	 *
+	 * @param callback $handler
+	 * @return array the counters, see getCounters()
+	 */
+	public function run($handler) {
+		if (!function_exists('pcntl_fork') || !function_exists('posix_kill')) {
+			throw new Exception('The capture supervisor requires the pcntl and posix extensions!');
+		}
+		
+		if (!is_callable($handler)) {
+			throw new Exception('Invalid packet handler!');
+		}
+		
+		for ($workerId = 0; $workerId < $this->_workers; $workerId++) {
+			$pair = array();
+			if (!socket_create_pair(AF_UNIX, SOCK_STREAM, 0, $pair)) {
+				$this->stop();
+				throw new Exception(socket_strerror(socket_last_error()));
+			}
+			
+			$pid = pcntl_fork();
+			
+			if ($pid == -1) {
+				$this->stop();
+				throw new Exception('Unable to fork a capture worker!');
+			}
+			else if ($pid == 0) {
+				socket_close($pair[0]);
+				foreach ($this->_channels as $channel) {
+					socket_close($channel);
+				}
+				
+				//never return into the caller's code from a worker
+				try {
+					$this->runWorker($workerId, $handler, $pair[1]);
+				}
+				catch (Exception $e) {
+					fwrite(STDERR, 'Capture worker ' . $workerId . ': ' . $e->getMessage() . PHP_EOL);
+					exit(1);
+				}
+				exit(0);
+			}
+			
+			socket_close($pair[1]);
+			
+			$this->_children[$pid] = $workerId;
+			$this->_channels[$workerId] = $pair[0];
+			$this->_counters[$workerId] = array('packets' => 0, 'bytes' => 0, 'errors' => 0);
+		}
+		
+		$this->supervise();
+		
+		return $this->getCounters();
+	}
+	
+	/**
+	 * Ask all workers to stop
+	 */
+	public function stop() {
+		if ($this->_stopping)
+			return;
+		
+		$this->_stopping = true;
+		foreach (array_keys($this->_children) as $pid) {
+			posix_kill($pid, SIGTERM);
+		}
+	}
+	
+	/**
+	 * The last reported counters of every worker and their totals
+	 *
+	 * @return array
+	 */
+	public function getCounters() {
+		$totals = array('packets' => 0, 'bytes' => 0, 'errors' => 0);
+		
+		foreach ($this->_counters as $counters) {
+			foreach ($counters as $name => $value) {
+				$totals[$name] += $value;
+			}
+		}
+		
+		$totals['workers'] = $this->_counters;
+		
+		return $totals;
+	}
+	
+	public function handleSignal($signal) {
+		$this->_running = false;
+	}
+	
+	private function supervise() {
+		$this->_running = true;
+		
+		pcntl_signal(SIGTERM, array($this, 'handleSignal'));
+		pcntl_signal(SIGINT, array($this, 'handleSignal'));
+		
+		$buffers = array_fill_keys(array_keys($this->_channels), '');
+		
+		while (count($this->_children) > 0) {
+			$read = array_values($this->_channels);
+			$write = null;
+			$except = null;
+			
+			if (count($read) == 0) {
+				usleep(100000);
+			}
+			else if (@socket_select($read, $write, $except, 1) > 0) {
+				foreach ($read as $channel) {
+					$workerId = array_search($channel, $this->_channels, true);
+					$data = socket_read($channel, 8192);
+					
+					if ($data === false || $data === '') {
+						socket_close($channel);
+						unset($this->_channels[$workerId]);
+						continue;
+					}
+					
+					$buffers[$workerId] .= $data;
+					while (($pos = strpos($buffers[$workerId], "\n")) !== false) {
+						$report = unserialize(substr($buffers[$workerId], 0, $pos));
+						$buffers[$workerId] = substr($buffers[$workerId], $pos + 1);
+						
+						if (is_array($report)) {
+							$this->_counters[$workerId] = $report;
+						}
+					}
+				}
+			}
+			
+			pcntl_signal_dispatch();
+			if (!$this->_running) {
+				$this->stop();
+			}
+			
+			while (($pid = pcntl_waitpid(-1, $status, WNOHANG)) > 0) {
+				unset($this->_children[$pid]);
+			}
+		}
+		
+		foreach ($this->_channels as $channel) {
+			socket_close($channel);
+		}
+		$this->_channels = array();
+		
+		pcntl_signal(SIGTERM, SIG_DFL);
+		pcntl_signal(SIGINT, SIG_DFL);
+	}
+	
+	private function runWorker($workerId, $handler, $channel) {
+		$this->_running = true;
+		$this->_children = array();
+		
+		pcntl_signal(SIGTERM, array($this, 'handleSignal'));
+		pcntl_signal(SIGINT, SIG_IGN); //the supervisor forwards it as SIGTERM
+		
+		if ($this->_statsKey !== null) {
+			LiveCounters::enable($this->_statsKey, $workerId);
+		}
+		
+		$network = new RawIPNetwork();
+		$network->createPacketSocket(RawNetwork::ETH_P_IP, $this->_interface);
+		$network->joinFanout($this->_groupId, $this->_fanoutMode);
+		$network->setReceiveTimeout($this->_reportInterval);
+		
+		$counters = array('packets' => 0, 'bytes' => 0, 'errors' => 0);
+		$nextReport = time() + $this->_reportInterval;
+		
+		while ($this->_running) {
+			$packet = $network->readPacket();
+			
+			if ($packet) {
+				$counters['packets']++;
+				$counters['bytes'] += $packet->getPacketLength();
+				
+				try {
+					if (call_user_func($handler, $packet, $workerId) === false) {
+						$this->_running = false;
+					}
+				}
+				catch (Exception $e) {
+					$counters['errors']++;
+				}
+			}
+			
+			pcntl_signal_dispatch();
+			
+			if (time() >= $nextReport) {
+				socket_write($channel, serialize($counters) . "\n");
+				$nextReport = time() + $this->_reportInterval;
+			}
+		}
+		
+		socket_write($channel, serialize($counters) . "\n");
+		socket_close($channel);
+		
+		$network->closeSocket();
+		LiveCounters::disable();
+	}
+}
@@ -24,6 +24,7 @@
 class RawIPNetwork extends RawNetwork  {
 	private $_ipProtocol;
 	private $_contentProtocol;
+	private $_mtu = null;
 	
 	public function createIPSocket($ipProtocol, $contentProtocol) {
 		if ($ipProtocol == PROT_IPv4)
@@ -42,6 +43,36 @@ class RawIPNetwork extends RawNetwork  {
 		$this->_contentProtocol = $contentProtocol;
 	}
 	
+	/**
+	 * Capture IPv4 packets of all content protocols with a packet socket
+	 *
+	 * @param int $protocol
+	 * @param string $interface
+	 */
+	public function createPacketSocket($protocol = self::ETH_P_IP, $interface = null) {
+		parent::createPacketSocket($protocol, $interface);
+		
+		$this->_ipProtocol = PROT_IPv4;
+		$this->_contentProtocol = null;
+	}
+	
+	/**
+	 * Fragment IPv4 packets larger than the MTU on send, instead of the
+	 * kernel rejecting them with EMSGSIZE
+	 *
+	 * @param int $mtu null to disable
+	 */
+	public function setMTU($mtu) {
+		if ($mtu !== null && $mtu < IIPv4::HEADER_SIZE + 8)
+			throw new Exception('Invalid MTU!');
+		
+		$this->_mtu = $mtu;
+	}
+	
+	public function getMTU() {
+		return $this->_mtu;
+	}
+	
 	/**
 	 * Read a IP packet
 	 *
@@ -49,12 +80,52 @@ class RawIPNetwork extends RawNetwork  {
 	 * @return IPv4ProtocolPacket
 	 */
 	public function readPacket($length = 16384) {
+		$profile = Profiler::$enabled ? Profiler::now() : 0;
+		
 		$pData = parent::readPacket($length);
 		
 		if (!$pData)
 			return false;
+		
+		$decodeStart = $this->_sampled ? Profiler::now() : 0;
+		
+		$packet = new IPv4ProtocolPacket($pData->getRawPacket());
+		$packet->setReceiveInfo($pData->getReceiveInfo());
+		
+		if ($decodeStart)
+			$this->_latency[self::LATENCY_DECODE]->record(Profiler::now() - $decodeStart);
+		
+		if ($profile)
+			Profiler::record('RawIPNetwork::readPacket', $profile);
+		
+		return $packet;
+	}
+	
+	/**
+	 * Read up to $max IP packets in one go
+	 *
+	 * @param int $max
+	 * @param int $length
+	 * @return array IPv4ProtocolPacket objects, empty on timeout
+	 * @see RawNetwork::readPackets
+	 */
+	public function readPackets($max = 64, $length = 16384) {
+		$packets = array();
+		
+		foreach (parent::readPackets($max, $length) as $pData) {
+			//the read of the first packet is sampled, so is its decode
+			$decodeStart = $this->_sampled && !$packets ? Profiler::now() : 0;
+			
+			$packet = new IPv4ProtocolPacket($pData->getRawPacket());
+			$packet->setReceiveInfo($pData->getReceiveInfo());
 			
-		return new IPv4ProtocolPacket($pData->getRawPacket());
+			if ($decodeStart)
+				$this->_latency[self::LATENCY_DECODE]->record(Profiler::now() - $decodeStart);
+			
+			$packets[] = $packet;
+		}
+		
+		return $packets;
 	}
 	
 	/**
@@ -63,7 +134,68 @@ class RawIPNetwork extends RawNetwork  {
 	 * @param IPv4ProtocolPacket $packet
 	 */
 	public function sendPacket(IPv4ProtocolPacket $packet) {
+		$profile = Profiler::$enabled ? Profiler::now() : 0;
+		
 		$packet->completePacket();
-		parent::sendPacketTo($packet, $packet->getDstIP());
+		
+		if ($this->_mtu !== null && $packet->getPacketLength() > $this->_mtu) {
+			parent::sendPacketsTo($packet->fragment($this->_mtu), $packet->getDstIP());
+		}
+		else {
+			parent::sendPacketTo($packet, $packet->getDstIP());
+		}
+		
+		if ($profile)
+			Profiler::record('RawIPNetwork::sendPacket', $profile);
+	}
+	
+	/**
+	 * Send a batch of IP packets through the socket
+	 *
+	 * @param array $packets IPv4ProtocolPacket objects
+	 * @param array $launchTimes optional SO_TXTIME launch time per packet
+	 * @return int number of packets sent, fragments count separately
+	 */
+	public function sendPackets(array $packets, array $launchTimes = null) {
+		$addrs = array();
+		
+		if ($this->_mtu === null) {
+			foreach ($packets as $packet) {
+				$packet->completePacket();
+				$addrs[] = $packet->getDstIP();
+			}
+			
+			return parent::sendPacketsTo($packets, $addrs, $launchTimes);
+		}
+		
+		//oversized packets are replaced by their fragments, which share the launch time
+		$batch = array();
+		$times = $launchTimes === null ? null : array();
+		foreach (array_values($packets) as $i => $packet) {
+			$packet->completePacket();
+			
+			$parts = $packet->getPacketLength() > $this->_mtu ? $packet->fragment($this->_mtu) : array($packet);
+			foreach ($parts as $part) {
+				$batch[] = $part;
+				$addrs[] = $packet->getDstIP();
+				
+				if ($times !== null)
+					$times[] = $launchTimes[$i];
+			}
+		}
+		
+		return parent::sendPacketsTo($batch, $addrs, $times);
+	}
+	
+	/**
+	 * Send a large TCP/UDP packet as segments of at most $mss payload bytes
+	 *
+	 * @param IPv4ProtocolPacket $packet
+	 * @param int $mss
+	 * @return int number of segments sent
+	 * @see IPv4ProtocolPacket::segment
+	 */
+	public function sendSegmented(IPv4ProtocolPacket $packet, $mss) {
+		return parent::sendPacketsTo($packet->segment($mss), $packet->getDstIP());
 	}
 }
\ No newline at end of file
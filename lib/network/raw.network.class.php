@@ -22,7 +22,62 @@
  */
 
 class RawNetwork {
+	const CLOCK_REALTIME  = 0;
+	const CLOCK_MONOTONIC = 1;
+	const CLOCK_TAI       = 11;
+	
+	const TXTIME_DEADLINE_MODE = 0x01;
+	const TXTIME_REPORT_ERRORS = 0x02;
+	
+	const ETH_P_ALL = 0x0003;
+	const ETH_P_IP  = 0x0800;
+	
+	const FANOUT_HASH          = 0;
+	const FANOUT_LB            = 1;
+	const FANOUT_CPU           = 2;
+	const FANOUT_ROLLOVER      = 3;
+	const FANOUT_RND           = 4;
+	const FANOUT_QM            = 5;
+	const FANOUT_FLAG_ROLLOVER = 0x1000;
+	const FANOUT_FLAG_DEFRAG   = 0x8000;
+	
+	const SO_SNDBUFFORCE = 32;
+	const SO_RCVBUFFORCE = 33;
+	const SO_RXQ_OVFL    = 40;
+	const SO_BUSY_POLL   = 46;
+	const SO_TIMESTAMPNS = 35;
+	
+	const SOL_IP         = 0;
+	const IP_PKTINFO     = 8;
+	
+	//latency stages, see enableLatency()
+	const LATENCY_QUEUE   = 'queue';
+	const LATENCY_READ    = 'read';
+	const LATENCY_DECODE  = 'decode';
+	const LATENCY_HANDLER = 'handler';
+	const LATENCY_TOTAL   = 'total';
+	
 	protected $_socket;
+	protected $_packetSocket = false;
+	protected $_txTimeClock = false;
+	
+	protected $_running = false;
+	
+	protected $_receiveControl = false;
+	protected $_dropCounter = false;
+	protected $_timestamps = false;
+	protected $_packetInfo = false;
+	
+	protected $_latency = null;
+	protected $_sampled = false;
+	private $_sampleStart = 0;
+	private $_sampleEvery = 1;
+	private $_sampleCountdown = 1;
+	
+	private $_received = 0;
+	private $_drops = 0;
+	private $_kernelReceived = 0;
+	private $_kernelDrops = 0;
 	
 	public function createRawSocket($family, $type, $protocol) {
 		$this->_socket = socket_create($family, $type, $protocol);
@@ -32,6 +87,59 @@ class RawNetwork {
 		}
 	}
 	
+	/**
+	 * Open a cooked AF_PACKET socket, which receives packets without the link layer header
+	 *
+	 * @param int $protocol ethernet protocol (ETH_P_*)
+	 * @param string $interface only capture on this interface
+	 */
+	public function createPacketSocket($protocol = self::ETH_P_IP, $interface = null) {
+		if (!PRNL_NATIVE) {
+			throw new Exception('Packet sockets require the prnl-native extension!');
+		}
+		
+		$this->_socket = prnl_packet_socket($protocol, $interface);
+		
+		if (!$this->_socket) {
+			throw new Exception('Unable to open packet socket!');
+		}
+		
+		$this->_packetSocket = true;
+	}
+	
+	/**
+	 * Join a PACKET_FANOUT group, the kernel spreads the received packets over all sockets in it
+	 *
+	 * @param int $groupId
+	 * @param int $mode FANOUT_* mode, optionally or'ed with FANOUT_FLAG_* flags
+	 */
+	public function joinFanout($groupId, $mode = self::FANOUT_HASH) {
+		if (!$this->_socket) {
+			throw new Exception('Socket not yet opened!');
+		}
+		
+		if (!prnl_packet_fanout($this->_socket, $groupId, $mode)) {
+			throw new Exception(socket_strerror(socket_last_error($this->_socket)));
+		}
+	}
+	
+	/**
+	 * Let readPacket return false when no packet arrived within the timeout
+	 *
+	 * @param float $seconds
+	 */
+	public function setReceiveTimeout($seconds) {
+		if (!$this->_socket) {
+			throw new Exception('Socket not yet opened!');
+		}
+		
+		$timeout = array('sec' => (int)$seconds, 'usec' => (int)(($seconds - (int)$seconds) * 1000000));
+		
+		if (!socket_set_option($this->_socket, SOL_SOCKET, SO_RCVTIMEO, $timeout)) {
+			throw new Exception(socket_strerror(socket_last_error($this->_socket)));
+		}
+	}
+	
 	/**
 	 * Read a raw packet of the socket
 	 *
@@ -43,27 +151,231 @@ class RawNetwork {
 			throw new Exception('Socket not yet opened!');
 		}
 		
-		$buffer = '';
-		$readBytes = socket_recv($this->_socket, $buffer, $length, 0);
+		$info = null;
+		
+		$this->_sampled = $this->_latency !== null && $this->sample();
+		
+		if ($this->_receiveControl) {
+			$info = prnl_recvmsg($this->_socket, $length);
+			$buffer = $info ? $info['data'] : '';
+			$readBytes = strlen($buffer);
+		}
+		else {
+			$buffer = '';
+			$readBytes = socket_recv($this->_socket, $buffer, $length, 0);
+		}
 		
 		if ($readBytes > 0) {
-			$packet = new RawPacket();
-			$packet->setRawPacket($buffer);
+			$packet = $this->receivedPacket($buffer, $info);
+			
+			if ($this->_sampled) {
+				$this->recordRead($info);
+			}
 			
 			return $packet;
 		}
-		else {
-			throw new Exception(socket_strerror(socket_last_error()));
+		
+		return $this->receiveFailed();
+	}
+	
+	/**
+	 * Read up to $max packets in one go
+	 * 
+	 * Blocks (up to the receive timeout) for the first packet and returns what
+	 * is queued after it. With the native extension this is one recvmmsg call,
+	 * the packets carry the same receive info as with readPacket.
+	 *
+	 * @param int $max
+	 * @param int $length
+	 * @return array RawPacket objects, empty on timeout
+	 */
+	public function readPackets($max = 64, $length = 16384) {
+		if (!$this->_socket) {
+			throw new Exception('Socket not yet opened!');
+		}
+		
+		$packets = array();
+		
+		if (!PRNL_NATIVE) {
+			//not $this->readPacket, a subclass would decode the packet before it decodes the batch
+			$packet = self::readPacket($length);
+			
+			if (!$packet)
+				return $packets;
+			
+			$packets[] = $packet;
+			
+			while (count($packets) < $max) {
+				$buffer = '';
+				
+				if (socket_recv($this->_socket, $buffer, $length, MSG_DONTWAIT) <= 0) {
+					socket_clear_error($this->_socket);
+					break;
+				}
+				
+				$packets[] = $this->receivedPacket($buffer, null);
+			}
+			
+			return $packets;
+		}
+		
+		$this->_sampled = $this->_latency !== null && $this->sample();
+		
+		$infos = prnl_recvmmsg($this->_socket, $length, $max);
+		
+		if ($infos === false) {
+			$this->receiveFailed();
+			return $packets;
+		}
+		
+		foreach ($infos as $info) {
+			$packets[] = $this->receivedPacket($info['data'], $info);
+		}
+		
+		if ($this->_sampled && count($infos) > 0) {
+			$this->recordRead($infos[0]);
+		}
+		
+		return $packets;
+	}
+	
+	/**
+	 * Count a received packet and wrap it in a RawPacket with its receive info
+	 *
+	 * @param string $buffer
+	 * @param array $info control messages of prnl_recvmsg/prnl_recvmmsg, or null
+	 * @return RawPacket
+	 */
+	private function receivedPacket($buffer, $info) {
+		$this->_received++;
+		
+		if (LiveCounters::$enabled) {
+			LiveCounters::count(LiveCounters::PACKETS_IN);
+			LiveCounters::count(LiveCounters::BYTES_IN, strlen($buffer));
+		}
+		
+		$packet = new RawPacket();
+		$packet->setRawPacket($buffer);
+		
+		if ($info !== null) {
+			unset($info['data']);
+			
+			//SO_RXQ_OVFL is a running total and only present once something was dropped
+			if ($this->_dropCounter) {
+				$drops = isset($info['drops']) ? $info['drops'] : 0;
+				$info['drops'] = ($drops - $this->_drops) & 0xFFFFFFFF;
+				$this->_drops = $drops;
+			}
+			
+			$packet->setReceiveInfo($info);
+		}
+		
+		return $packet;
+	}
+	
+	/**
+	 * @return bool false on a receive timeout or signal
+	 */
+	private function receiveFailed() {
+		$error = socket_last_error($this->_socket);
+		
+		//receive timeout or interrupted by a signal
+		if ($error == SOCKET_EAGAIN || $error == SOCKET_EINTR) {
+			socket_clear_error($this->_socket);
+			return false;
+		}
+		
+		throw new Exception(socket_strerror($error));
+	}
+	
+	/**
+	 * Event loop: call $handler for every received packet and run the timers when they are due
+	 * 
+	 * The loop waits in select() for at most the time until the next timer, so
+	 * idle timeouts and pacing deadlines cost nothing while no timer is due.
+	 * It ends when the handler returns false or stop() is called.
+	 *
+	 * @param callback $handler called as handler($packet, $network)
+	 * @param TimerWheel $timers
+	 */
+	public function run($handler, TimerWheel $timers = null) {
+		if (!$this->_socket) {
+			throw new Exception('Socket not yet opened!');
+		}
+		
+		$this->_running = true;
+		
+		while ($this->_running) {
+			$timeout = $timers ? $timers->getTimeout() : null;
+			
+			//wake up at least once a second to keep the live counter slot fresh
+			if (LiveCounters::$enabled && ($timeout === null || $timeout > 1)) {
+				$timeout = 1;
+			}
+			
+			$read = array($this->_socket);
+			$write = null;
+			$except = null;
+			
+			if ($timeout === null) {
+				$ready = @socket_select($read, $write, $except, null);
+			}
+			else {
+				$ready = @socket_select($read, $write, $except, (int)$timeout, (int)(($timeout - (int)$timeout) * 1000000));
+			}
+			
+			if ($ready === false) {
+				$error = socket_last_error();
+				
+				if ($error != SOCKET_EINTR) {
+					throw new Exception(socket_strerror($error));
+				}
+			}
+			else if ($ready > 0) {
+				$packet = $this->readPacket();
+				
+				if ($packet) {
+					$handlerStart = $this->_sampled ? Profiler::now() : 0;
+					
+					if (call_user_func($handler, $packet, $this) === false) {
+						$this->_running = false;
+					}
+					
+					if ($handlerStart) {
+						$this->recordHandler($packet, $handlerStart);
+					}
+				}
+			}
+			
+			if ($timers) {
+				$timers->advance();
+			}
+			
+			if (LiveCounters::$enabled) {
+				LiveCounters::tick();
+			}
 		}
 	}
 	
+	/**
+	 * Let run() return after the current packet or timer batch
+	 */
+	public function stop() {
+		$this->_running = false;
+	}
+	
 	public function sendPacket(RawPacket $packet) {
 		if (!$this->_socket) {
 			throw new Exception('Socket not yet opened!');
 		}
 		
 		if (!socket_send($this->_socket, $packet->getRawPacket(), $packet->getPacketLength(), 0)) {
-			throw new Exception(socket_strerror(socket_last_error()));
+			$this->sendFailed();
+		}
+		
+		if (LiveCounters::$enabled) {
+			LiveCounters::count(LiveCounters::PACKETS_OUT);
+			LiveCounters::count(LiveCounters::BYTES_OUT, $packet->getPacketLength());
 		}
 	}
 	
@@ -73,20 +385,425 @@ class RawNetwork {
 	 * @param RawPacket $packet
 	 */
 	public function sendPacketTo(RawPacket $packet, $addr, $port = 0) {
+		$this->sendRawTo($packet->getRawPacket(), $addr, $port);
+	}
+	
+	/**
+	 * Send a packet that is already serialized
+	 *
+	 * @param string $data
+	 * @param string $addr
+	 * @param int $port
+	 */
+	protected function sendRawTo($data, $addr, $port = 0) {
 		if (!$this->_socket) {
 			throw new Exception('Socket not yet opened!');
 		}
 		
-		if (!socket_sendto($this->_socket, $packet->getRawPacket(), $packet->getPacketLength(), 0, $addr, $port)) {
-			throw new Exception(socket_strerror(socket_last_error()));
+		if (!socket_sendto($this->_socket, $data, strlen($data), 0, $addr, $port)) {
+			$this->sendFailed();
+		}
+		
+		if (LiveCounters::$enabled) {
+			LiveCounters::count(LiveCounters::PACKETS_OUT);
+			LiveCounters::count(LiveCounters::BYTES_OUT, strlen($data));
 		}
 	}
 	
+	/**
+	 * Send a batch of raw packets through the socket
+	 * 
+	 * With the native extension the whole batch is handed to the kernel with
+	 * sendmmsg. The optional launch times (nanoseconds on the clock passed to
+	 * enableTxTime) are attached to every packet as a SCM_TXTIME message.
+	 *
+	 * @param array $packets RawPacket objects or raw packets (strings)
+	 * @param mixed $addrs one address for all packets or an address per packet
+	 * @param array $launchTimes
+	 * @return int number of packets sent
+	 */
+	public function sendPacketsTo(array $packets, $addrs, array $launchTimes = null) {
+		if (!$this->_socket) {
+			throw new Exception('Socket not yet opened!');
+		}
+		
+		if ($launchTimes !== null && $this->_txTimeClock === false) {
+			throw new Exception('Launch times require enableTxTime()!');
+		}
+		
+		if (!is_array($addrs)) {
+			$addrs = array_fill(0, count($packets), $addrs);
+		}
+		
+		if (LiveCounters::$enabled) {
+			LiveCounters::countBatch(count($packets));
+		}
+		
+		if (PRNL_NATIVE) {
+			$rawPackets = array();
+			foreach ($packets as $packet) {
+				$rawPackets[] = is_string($packet) ? $packet : $packet->getRawPacket();
+			}
+			
+			$sent = prnl_sendmmsg($this->_socket, $rawPackets, array_values($addrs), $launchTimes === null ? null : array_values($launchTimes));
+			
+			if ($sent === false) {
+				$this->sendFailed();
+			}
+			
+			if (LiveCounters::$enabled) {
+				if ($sent < count($rawPackets)) {
+					LiveCounters::countSendFailure(socket_last_error($this->_socket));
+				}
+				
+				$bytes = 0;
+				for ($i = 0; $i < $sent; $i++) {
+					$bytes += strlen($rawPackets[$i]);
+				}
+				
+				LiveCounters::count(LiveCounters::PACKETS_OUT, $sent);
+				LiveCounters::count(LiveCounters::BYTES_OUT, $bytes);
+			}
+			
+			return $sent;
+		}
+		
+		$addrs = array_values($addrs);
+		$sent = 0;
+		foreach ($packets as $packet) {
+			$this->sendRawTo(is_string($packet) ? $packet : $packet->getRawPacket(), $addrs[$sent]);
+			$sent++;
+		}
+		
+		return $sent;
+	}
+	
+	/**
+	 * Enable kernel paced transmission (SO_TXTIME)
+	 * 
+	 * Packets sent with a launch time are released by the fq or etf qdisc at
+	 * that time instead of when they are written to the socket.
+	 *
+	 * @param int $clockId CLOCK_TAI for etf, CLOCK_MONOTONIC for fq
+	 * @param int $flags TXTIME_* flags
+	 */
+	public function enableTxTime($clockId = self::CLOCK_TAI, $flags = 0) {
+		if (!$this->_socket) {
+			throw new Exception('Socket not yet opened!');
+		}
+		
+		if (!PRNL_NATIVE) {
+			throw new Exception('SO_TXTIME requires the prnl-native extension!');
+		}
+		
+		if (!prnl_socket_set_txtime($this->_socket, $clockId, $flags)) {
+			throw new Exception(socket_strerror(socket_last_error($this->_socket)));
+		}
+		
+		$this->_txTimeClock = $clockId;
+	}
+	
+	/**
+	 * Current time in nanoseconds on the SO_TXTIME clock, the base for launch times
+	 *
+	 * @return int
+	 */
+	public function getTxTime() {
+		if ($this->_txTimeClock === false) {
+			throw new Exception('SO_TXTIME not enabled!');
+		}
+		
+		return prnl_clock_gettime($this->_txTimeClock);
+	}
+	
+	/**
+	 * The socket resource, to wait on several networks with socket_select
+	 *
+	 * @return resource
+	 */
+	public function getSocket() {
+		return $this->_socket;
+	}
+	
+	/**
+	 * Set the size of the kernel receive buffer
+	 *
+	 * @param int $bytes
+	 * @param bool $force go beyond net.core.rmem_max (requires CAP_NET_ADMIN)
+	 */
+	public function setReceiveBuffer($bytes, $force = false) {
+		$this->setSocketOption(SOL_SOCKET, $force ? self::SO_RCVBUFFORCE : SO_RCVBUF, $bytes);
+	}
+	
+	/**
+	 * Set the size of the kernel send buffer
+	 *
+	 * @param int $bytes
+	 * @param bool $force go beyond net.core.wmem_max (requires CAP_NET_ADMIN)
+	 */
+	public function setSendBuffer($bytes, $force = false) {
+		$this->setSocketOption(SOL_SOCKET, $force ? self::SO_SNDBUFFORCE : SO_SNDBUF, $bytes);
+	}
+	
+	/**
+	 * Busy poll the device queue for up to $microseconds on a blocking receive
+	 *
+	 * @param int $microseconds
+	 */
+	public function setBusyPoll($microseconds) {
+		$this->setSocketOption(SOL_SOCKET, self::SO_BUSY_POLL, $microseconds);
+	}
+	
+	/**
+	 * Report the number of packets the kernel dropped before each received packet
+	 * 
+	 * The count is available as getReceiveInfo('drops') of the packets returned
+	 * by readPacket.
+	 */
+	public function enableDropCounter() {
+		if (!PRNL_NATIVE) {
+			throw new Exception('Per packet drop counts require the prnl-native extension!');
+		}
+		
+		$this->setSocketOption(SOL_SOCKET, self::SO_RXQ_OVFL, 1);
+		
+		$this->_dropCounter = true;
+		$this->_receiveControl = true;
+	}
+	
+	/**
+	 * Attach the kernel receive time to every received packet (SO_TIMESTAMPNS)
+	 * 
+	 * The time is available as getReceiveInfo('timestamp') of the packets returned
+	 * by readPacket, in nanoseconds on CLOCK_REALTIME.
+	 */
+	public function enableTimestamps() {
+		if (!PRNL_NATIVE) {
+			throw new Exception('Receive timestamps require the prnl-native extension!');
+		}
+		
+		$this->setSocketOption(SOL_SOCKET, self::SO_TIMESTAMPNS, 1);
+		
+		$this->_timestamps = true;
+		$this->_receiveControl = true;
+	}
+	
+	/**
+	 * Attach the interface and destination address to every received packet (IP_PKTINFO)
+	 * 
+	 * Available as getReceiveInfo('ifindex') and getReceiveInfo('dst') of the
+	 * packets returned by readPacket and readPackets. Packet sockets always
+	 * report the ifindex once the native receive path is used, the option is
+	 * only set on IP sockets.
+	 */
+	public function enablePacketInfo() {
+		if (!PRNL_NATIVE) {
+			throw new Exception('Packet info requires the prnl-native extension!');
+		}
+		
+		if (!$this->_packetSocket) {
+			$this->setSocketOption(self::SOL_IP, self::IP_PKTINFO, 1);
+		}
+		
+		$this->_packetInfo = true;
+		$this->_receiveControl = true;
+	}
+	
+	/**
+	 * Record the latency of the receive pipeline stages in histograms
+	 * 
+	 * queue   kernel receive time until readPacket returns (needs enableTimestamps)
+	 * read    the readPacket call, including the wait when the socket is empty outside run()
+	 * decode  turning the received data into an IPv4ProtocolPacket (RawIPNetwork)
+	 * handler the handler called by run()
+	 * total   kernel receive time, or the start of readPacket, until the handler returned
+	 * 
+	 * Only one in $sampleEvery packets is timed, the others cost one counter
+	 * decrement. GC pauses and slow handlers show up in the tail of total.
+	 *
+	 * @param int $sampleEvery
+	 * @param int $precision see LatencyHistogram
+	 */
+	public function enableLatency($sampleEvery = 1, $precision = 7) {
+		$this->_latency = array();
+		
+		foreach (array(self::LATENCY_QUEUE, self::LATENCY_READ, self::LATENCY_DECODE, self::LATENCY_HANDLER, self::LATENCY_TOTAL) as $stage) {
+			$this->_latency[$stage] = new LatencyHistogram($precision);
+		}
+		
+		$this->_sampleEvery = max(1, (int)$sampleEvery);
+		$this->_sampleCountdown = 1;
+	}
+	
+	public function disableLatency() {
+		$this->_latency = null;
+		$this->_sampled = false;
+	}
+	
+	/**
+	 * Latency histograms per stage, getSummary() gives the percentiles
+	 *
+	 * @return array stage => LatencyHistogram, null when not enabled
+	 */
+	public function getLatency() {
+		return $this->_latency;
+	}
+	
+	/**
+	 * Whether the packet that is read now is timed, starts its clock if so
+	 *
+	 * @return bool
+	 */
+	private function sample() {
+		if (--$this->_sampleCountdown > 0)
+			return false;
+		
+		$this->_sampleCountdown = $this->_sampleEvery;
+		$this->_sampleStart = Profiler::now();
+		
+		return true;
+	}
+	
+	private function recordRead($info) {
+		$this->_latency[self::LATENCY_READ]->record(Profiler::now() - $this->_sampleStart);
+		
+		if (isset($info['timestamp']))
+			$this->_latency[self::LATENCY_QUEUE]->record(prnl_clock_gettime(self::CLOCK_REALTIME) - $info['timestamp']);
+	}
+	
+	private function recordHandler(RawPacket $packet, $handlerStart) {
+		$now = Profiler::now();
+		$this->_latency[self::LATENCY_HANDLER]->record($now - $handlerStart);
+		
+		$timestamp = $packet->getReceiveInfo('timestamp');
+		
+		if ($timestamp !== null)
+			$this->_latency[self::LATENCY_TOTAL]->record(prnl_clock_gettime(self::CLOCK_REALTIME) - $timestamp);
+		else
+			$this->_latency[self::LATENCY_TOTAL]->record($now - $this->_sampleStart);
+	}
+	
+	/**
+	 * Receive statistics of the socket
+	 * 
+	 * received        packets returned by readPacket
+	 * kernel_received packets seen by the kernel (packet sockets only)
+	 * dropped         packets the kernel dropped because the receive buffer was full
+	 * queued          bytes waiting to be read
+	 * rcvbuf          size of the receive buffer
+	 * rmem            memory in use by the receive queue
+	 * occupancy       rmem / rcvbuf
+	 * 
+	 * Without the native extension only received and rcvbuf are known, the rest is null.
+	 *
+	 * @return array
+	 */
+	public function getSocketStats() {
+		if (!$this->_socket) {
+			throw new Exception('Socket not yet opened!');
+		}
+		
+		$stats = array(
+			'received'        => $this->_received,
+			'kernel_received' => null,
+			'dropped'         => $this->_dropCounter ? $this->_drops : null,
+			'queued'          => null,
+			'rcvbuf'          => socket_get_option($this->_socket, SOL_SOCKET, SO_RCVBUF),
+			'rmem'            => null,
+			'occupancy'       => null,
+		);
+		
+		if (PRNL_NATIVE) {
+			$kernel = prnl_socket_stats($this->_socket);
+			
+			if (isset($kernel['packets'])) {
+				//PACKET_STATISTICS is reset on every read
+				$this->_kernelReceived += $kernel['packets'];
+				$this->_kernelDrops += $kernel['drops'];
+				
+				$stats['kernel_received'] = $this->_kernelReceived;
+				$stats['dropped'] = $this->_kernelDrops;
+			}
+			else if (isset($kernel['inode'])) {
+				$drops = $this->readProcDrops($kernel['inode']);
+				
+				if ($drops !== null)
+					$stats['dropped'] = $drops;
+			}
+			
+			if (isset($kernel['queued']))
+				$stats['queued'] = $kernel['queued'];
+			
+			if (isset($kernel['rmem'])) {
+				$stats['rmem'] = $kernel['rmem'];
+				$stats['occupancy'] = $stats['rcvbuf'] > 0 ? $kernel['rmem'] / $stats['rcvbuf'] : null;
+			}
+		}
+		
+		return $stats;
+	}
+	
+	protected function setSocketOption($level, $option, $value) {
+		if (!$this->_socket) {
+			throw new Exception('Socket not yet opened!');
+		}
+		
+		if (!socket_set_option($this->_socket, $level, $option, $value)) {
+			throw new Exception(socket_strerror(socket_last_error($this->_socket)));
+		}
+	}
+	
+	/**
+	 * Find the drops column of a raw socket in /proc/net/raw
+	 *
+	 * @param int $inode
+	 * @return int
+	 */
+	private function readProcDrops($inode) {
+		foreach (array('/proc/net/raw', '/proc/net/raw6') as $file) {
+			$lines = @file($file);
+			if (!$lines)
+				continue;
+			
+			//sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode ref pointer drops
+			foreach (array_slice($lines, 1) as $line) {
+				$columns = preg_split('/\s+/', trim($line));
+				
+				if (count($columns) >= 13 && $columns[9] == $inode)
+					return (int)$columns[12];
+			}
+		}
+		
+		return null;
+	}
+	
+	protected function sendFailed() {
+		$error = socket_last_error($this->_socket);
+		
+		if (LiveCounters::$enabled) {
+			LiveCounters::countSendFailure($error);
+		}
+		
+		throw new Exception(socket_strerror($error));
+	}
+	
 	public function closeSocket() {
 		if (is_resource($this->_socket)) {
 			socket_close($this->_socket);
 			
 			$this->_socket = null;
+			$this->_packetSocket = false;
+			$this->_txTimeClock = false;
+			$this->_receiveControl = false;
+			$this->_dropCounter = false;
+			$this->_timestamps = false;
+			$this->_packetInfo = false;
+			$this->_sampled = false;
+			
+			$this->_received = 0;
+			$this->_drops = 0;
+			$this->_kernelReceived = 0;
+			$this->_kernelDrops = 0;
 		}
 	}
 	
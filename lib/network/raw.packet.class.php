@@ -23,6 +23,7 @@
 
 class RawPacket {
 	protected $_buffer;
+	protected $_receiveInfo = array();
 	
 	public function __construct($packetSize = 0) {
 		$this->_buffer = new Memory($packetSize);
@@ -41,6 +42,23 @@ class RawPacket {
 		return $this->_buffer->getMemoryLength();
 	}
 	
+	/**
+	 * Metadata the kernel attached when the packet was received
+	 *
+	 * @param string $name e.g. 'drops', null for all
+	 * @return mixed null when not available
+	 */
+	public function getReceiveInfo($name = null) {
+		if ($name === null)
+			return $this->_receiveInfo;
+		
+		return isset($this->_receiveInfo[$name]) ? $this->_receiveInfo[$name] : null;
+	}
+	
+	public function setReceiveInfo(array $info) {
+		$this->_receiveInfo = $info;
+	}
+	
 	public function dumpPacket() {
 		$this->_buffer->dumpMemory();
 	}
@@ -0,0 +1,41 @@
+<?php
+
+/**
+ * ICMP interface
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+interface IICMP {
+	const HEADER_SIZE    = 0x08;
+	
+	const TYPE           = 0x00; //  8 bit
+	const CODE           = 0x01; //  8 bit
+	const CHECKSUM       = 0x02; // 16 bit
+	const ID             = 0x04; // 16 bit, echo
+	const SEQUENCE       = 0x06; // 16 bit, echo
+	const DATA           = 0x08;
+	
+	const TYPE_ECHO_REPLY    = 0;
+	const TYPE_DEST_UNREACH  = 3;
+	const TYPE_ECHO_REQUEST  = 8;
+	const TYPE_TIME_EXCEEDED = 11;
+	
+	const CODE_PORT_UNREACH  = 3;
+}
\ No newline at end of file
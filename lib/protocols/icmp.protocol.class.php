@@ -0,0 +1,128 @@
+<?php
+
+/**
+ * ICMP Protocol Packet Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+class ICMPProtocolPacket extends RawPacket implements ICompleteableProtocolPacket {
+	public function __construct($data = '') {
+		parent::__construct(IICMP::HEADER_SIZE);
+		
+		if (strlen($data) > 0) {
+			if (LiveCounters::$enabled && strlen($data) < IICMP::HEADER_SIZE) {
+				LiveCounters::count(LiveCounters::DECODE_ERRORS);
+			}
+			
+			$this->setRawPacket($data);
+		}
+	}
+	
+	//-- GETTERS
+	public function getType() {
+		return $this->_buffer->getByte(IICMP::TYPE);
+	}
+	
+	public function getCode() {
+		return $this->_buffer->getByte(IICMP::CODE);
+	}
+	
+	public function getChecksum() {
+		return $this->_buffer->getShort(IICMP::CHECKSUM);
+	}
+	
+	public function getId() {
+		return $this->_buffer->getShort(IICMP::ID);
+	}
+	
+	public function getSequence() {
+		return $this->_buffer->getShort(IICMP::SEQUENCE);
+	}
+	
+	public function getData() {
+		return $this->_buffer->getMemory(IICMP::DATA);
+	}
+	
+	/**
+	 * The packet an error message (destination unreachable, time exceeded) is about,
+	 * its IP header and at least the first 8 bytes of its content
+	 *
+	 * @return IPv4ProtocolPacket null when this is no error message
+	 */
+	public function getQuotedPacket() {
+		$type = $this->getType();
+		
+		if ($type != IICMP::TYPE_DEST_UNREACH && $type != IICMP::TYPE_TIME_EXCEEDED)
+			return null;
+		
+		return new IPv4ProtocolPacket($this->getData());
+	}
+	//-- GETTERS
+	
+	//-- SETTERS
+	public function setType($type) {
+		$this->_buffer->setByte(IICMP::TYPE, $type);
+	}
+	
+	public function setCode($code) {
+		$this->_buffer->setByte(IICMP::CODE, $code);
+	}
+	
+	public function setChecksum($checksum) {
+		$this->_buffer->setShort(IICMP::CHECKSUM, $checksum);
+	}
+	
+	public function setId($id) {
+		$this->_buffer->setShort(IICMP::ID, $id);
+	}
+	
+	public function setSequence($sequence) {
+		$this->_buffer->setShort(IICMP::SEQUENCE, $sequence);
+	}
+	
+	public function setData($data) {
+		$this->_buffer->setMemorySize(IICMP::HEADER_SIZE);
+		$this->_buffer->addString($data);
+	}
+	//-- SETTERS
+	
+	public function resetChecksum() {
+		$this->_buffer->setShort(IICMP::CHECKSUM, 0x0000);
+	}
+	
+	/**
+	 * Calculate the checksum of the packet, ICMP has no pseudo header
+	 */
+	public function calculateChecksum() {
+		$this->resetChecksum();
+		
+		$data = $this->_buffer->getMemory();
+		$this->_buffer->setShort(IICMP::CHECKSUM, PRNL_NATIVE ? prnl_checksum($data) : Checksum::finish(Checksum::partial($data)));
+		
+		if (LiveCounters::$enabled) {
+			LiveCounters::count(LiveCounters::CHECKSUMS);
+		}
+	}
+	
+	public function completePacket(Memory $ipPacketBuffer) {
+		if ($this->getChecksum() == 0)
+			$this->calculateChecksum();
+	}
+}
\ No newline at end of file
@@ -35,4 +35,8 @@ interface IIPv4 {
 	const IP_SRC         = 0x0C; // 32 bit
 	const IP_DST         = 0x10; // 32 bit
 	const DATA           = 0x14;
+	
+	const FLAG_DF        = 0x4000; // don't fragment
+	const FLAG_MF        = 0x2000; // more fragments
+	const OFFSET_MASK    = 0x1FFF; // fragment offset in 8 byte units
 }
\ No newline at end of file
@@ -23,11 +23,18 @@
 
 class IPv4ProtocolPacket extends RawPacket {
 	private $_data;
+	private $_header;
 	
 	public function __construct($data = '') {
+		$profile = Profiler::$enabled ? Profiler::now() : 0;
+		
 		parent::__construct(IIPv4::HEADER_SIZE);
 		
 		if (strlen($data) > 0) {
+			if (LiveCounters::$enabled && strlen($data) < IIPv4::HEADER_SIZE) {
+				LiveCounters::count(LiveCounters::DECODE_ERRORS);
+			}
+			
 			$this->setRawPacket($data);
 		}
 		else {
@@ -36,6 +43,9 @@ class IPv4ProtocolPacket extends RawPacket {
 		
 			$this->setTTL(64);
 		}
+		
+		if ($profile)
+			Profiler::record('IPv4ProtocolPacket::__construct', $profile);
 	}
 	
 	//-- GETTERS
@@ -76,25 +86,52 @@ class IPv4ProtocolPacket extends RawPacket {
 	}
 	
 	/**
-	 * Return the payload as a object
+	 * Offset of the payload in the original datagram in bytes
+	 *
+	 * @return int
+	 */
+	public function getFragmentOffset() {
+		return ($this->getOffset() & IIPv4::OFFSET_MASK) * 8;
+	}
+	
+	public function hasMoreFragments() {
+		return ($this->getOffset() & IIPv4::FLAG_MF) != 0;
+	}
+	
+	public function isFragment() {
+		return ($this->getOffset() & (IIPv4::FLAG_MF | IIPv4::OFFSET_MASK)) != 0;
+	}
+	
+	/**
+	 * Return the payload as a object, dissected by the class registered in ProtocolRegistry
 	 *
+	 * @param bool $headerOnly only dissect the content protocol header, not the payload
 	 * @return RawPacket
 	 */
-	public function getDataObject() {
-		if (!$this->_data) {
-			if ($this->getProtocol() == PROT_UDP) {
-				$this->_data = new UDPProtocolPacket($this->getRawData());
-			}
-			else if ($this->getProtocol() == PROT_TCP) {
-				$this->_data = new TCPProtocolPacket($this->getRawData());
-			}
-			else {
-				$this->_data = new RawPacket();
-				$this->_data->setRawPacket($this->getRawData());
-			}
+	public function getDataObject($headerOnly = false) {
+		if ($this->_data)
+			return $this->_data;
+		
+		if ($headerOnly && $this->_header)
+			return $this->_header;
+		
+		//only the first fragment starts with the content protocol header
+		if (($this->getOffset() & IIPv4::OFFSET_MASK) != 0) {
+			$data = new RawPacket();
+			
+			if (!$headerOnly)
+				$data->setRawPacket($this->getRawData());
+		}
+		else {
+			$data = ProtocolRegistry::create($this->getProtocol(), $this->_buffer, IIPv4::DATA, $headerOnly);
 		}
 		
-		return $this->_data;
+		if ($headerOnly)
+			$this->_header = $data;
+		else
+			$this->_data = $data;
+		
+		return $data;
 	}
 	//-- GETTERS
 	
@@ -147,6 +184,7 @@ class IPv4ProtocolPacket extends RawPacket {
 	
 	public function setData(RawPacket $data) {
 		$this->_data = $data;
+		$this->_header = null;
 		
 		$this->_buffer->setMemorySize(IIPv4::HEADER_SIZE);
 		$this->_buffer->addString($data->getRawPacket());
@@ -161,6 +199,8 @@ class IPv4ProtocolPacket extends RawPacket {
 	 * Calculate the checksum of the packet
 	 */
 	public function calculateChecksum() {
+		$profile = Profiler::$enabled ? Profiler::now() : 0;
+		
 		$sum = new UShort();
 
 		$length = IIPv4::HEADER_SIZE;
@@ -171,9 +211,224 @@ class IPv4ProtocolPacket extends RawPacket {
 		}
 		$sum->bitNot();
 		$this->_buffer->setShort(IIPv4::CHECKSUM, $sum->getValue());
+		
+		if (LiveCounters::$enabled) {
+			LiveCounters::count(LiveCounters::CHECKSUMS);
+		}
+		
+		if ($profile)
+			Profiler::record('IPv4ProtocolPacket::calculateChecksum', $profile);
+	}
+	
+	/**
+	 * Split a TCP or UDP packet in packets of at most $mss payload bytes
+	 * 
+	 * Every segment gets a copy of the headers with the IP ID incremented,
+	 * the lengths adjusted and for TCP the sequence number advanced. The
+	 * headers are summed once, only the differences and the payload are
+	 * added to the checksums per segment.
+	 *
+	 * @param int $mss
+	 * @return array raw packets, ready for RawNetwork::sendPacketsTo
+	 */
+	public function segment($mss) {
+		$ipLength = ($this->_buffer->getByte(IIPv4::VERSION_LENGTH) & 0x0F) * 4;
+		
+		$raw = $this->_data ? $this->_buffer->getMemory(0, $ipLength) . $this->_data->getRawPacket() : $this->getRawPacket();
+		
+		if (PRNL_NATIVE) {
+			$segments = prnl_gso_segment($raw, $mss);
+			
+			if ($segments === false)
+				throw new Exception('Packet can\'t be segmented!');
+			
+			return $segments;
+		}
+		
+		if ($mss < 1)
+			throw new Exception('MSS must be positive!');
+		
+		$protocol = ord($raw[IIPv4::PROTOCOL]);
+		if ($protocol == PROT_TCP && strlen($raw) >= $ipLength + ITCP::HEADER_SIZE) {
+			$l4Length = (ord($raw[$ipLength + ITCP::SEG_OFF]) >> 4) * 4;
+			list(, $seq) = unpack('N', substr($raw, $ipLength + ITCP::ID_SEQ, 4));
+		}
+		else if ($protocol == PROT_UDP) {
+			$l4Length = IUDP::HEADER_SIZE;
+		}
+		else {
+			throw new Exception('Only TCP and UDP packets can be segmented!');
+		}
+		
+		if (strlen($raw) < $ipLength + $l4Length)
+			throw new Exception('Packet can\'t be segmented!');
+		
+		$ipHeader = substr($raw, 0, $ipLength);
+		$l4Header = substr($raw, $ipLength, $l4Length);
+		$payloadLength = strlen($raw) - $ipLength - $l4Length;
+		list(, $id) = unpack('n', substr($raw, IIPv4::ID_SEQ, 2));
+		
+		//the header sums without the fields that differ per segment
+		$ipSum = Checksum::partial(substr($ipHeader, 0, IIPv4::LENGTH) . "\0\0\0\0" . substr($ipHeader, IIPv4::OFFSET, 4) . "\0\0" . substr($ipHeader, IIPv4::IP_SRC));
+		$pseudoSum = Checksum::partial(substr($raw, IIPv4::IP_SRC, 8), $protocol);
+		
+		if ($protocol == PROT_TCP) {
+			$flags = ord($l4Header[ITCP::FLAGS]);
+			
+			//without the sequence number, the offset/flags word and the checksum
+			$tcpSum = Checksum::partial(substr($l4Header, 0, ITCP::ID_SEQ) . "\0\0\0\0" . substr($l4Header, ITCP::ACK_ID_SEQ, 4)
+				. "\0\0" . substr($l4Header, ITCP::WINDOW, 2) . "\0\0" . substr($l4Header, ITCP::URGENT), $pseudoSum);
+		}
+		else {
+			$udpSum = Checksum::partial(substr($l4Header, 0, 4), $pseudoSum);
+		}
+		
+		$segments = array();
+		$offset = 0;
+		do {
+			$chunk = (string)substr($raw, $ipLength + $l4Length + $offset, $mss);
+			$l4Total = $l4Length + strlen($chunk);
+			$total = $ipLength + $l4Total;
+			
+			$ip = substr($ipHeader, 0, IIPv4::LENGTH) . pack('nn', $total, $id) . substr($ipHeader, IIPv4::OFFSET, 4)
+				. pack('n', Checksum::finish($ipSum + $total + $id)) . substr($ipHeader, IIPv4::IP_SRC);
+			
+			if ($protocol == PROT_TCP) {
+				//like the kernel: CWR only on the first, FIN and PSH only on the last segment
+				$segmentFlags = $flags;
+				if ($offset > 0)
+					$segmentFlags &= ~0x80;
+				if ($offset + strlen($chunk) < $payloadLength)
+					$segmentFlags &= ~(ITCP::FLAG_FIN | ITCP::FLAG_PUSH);
+				
+				$s = ($seq + $offset) & 0xFFFFFFFF;
+				$sum = $tcpSum + $l4Total + ($s >> 16) + ($s & 0xFFFF) + ((ord($l4Header[ITCP::SEG_OFF]) << 8) | $segmentFlags);
+				$checksum = Checksum::finish(Checksum::partial($chunk, $sum));
+				
+				$l4 = substr($l4Header, 0, ITCP::ID_SEQ) . pack('N', $s) . substr($l4Header, ITCP::ACK_ID_SEQ, 4)
+					. $l4Header[ITCP::SEG_OFF] . chr($segmentFlags) . substr($l4Header, ITCP::WINDOW, 2) . pack('n', $checksum) . substr($l4Header, ITCP::URGENT);
+			}
+			else {
+				$checksum = Checksum::finish(Checksum::partial($chunk, $udpSum + $l4Total + $l4Total));
+				
+				$l4 = substr($l4Header, 0, IUDP::LENGTH) . pack('nn', $l4Total, $checksum == 0 ? 0xFFFF : $checksum);
+			}
+			
+			$segments[] = $ip . $l4 . $chunk;
+			
+			$id = ($id + 1) & 0xFFFF;
+			$offset += strlen($chunk);
+		} while ($offset < $payloadLength);
+		
+		return $segments;
+	}
+	
+	/**
+	 * Split the packet in fragments of at most $mtu bytes
+	 * 
+	 * The header is copied to every fragment with only the offset, more
+	 * fragments flag, length and checksum patched; fragments after the first
+	 * keep only the options with the copy bit set. The header sums are taken
+	 * once, the payload is sliced per fragment. An ID of 0 is replaced by a
+	 * random one, the kernel would give every such fragment an ID of its own.
+	 * Call completePacket first.
+	 *
+	 * @param int $mtu
+	 * @return array raw packets, ready for RawNetwork::sendPacketsTo
+	 */
+	public function fragment($mtu) {
+		$raw = $this->getRawPacket();
+		
+		if ($this->getIdSequence() == 0)
+			$raw = substr_replace($raw, pack('n', mt_rand(1, 0xFFFF)), IIPv4::ID_SEQ, 2);
+		
+		if (PRNL_NATIVE) {
+			$fragments = prnl_ip_fragment($raw, $mtu);
+			
+			if ($fragments === false)
+				throw new Exception('Packet can\'t be fragmented!');
+			
+			return $fragments;
+		}
+		
+		$ipLength = (ord($raw[IIPv4::VERSION_LENGTH]) & 0x0F) * 4;
+		
+		//fragment offsets count in 8 byte units
+		$maxPayload = ($mtu - $ipLength) & ~7;
+		if ($maxPayload <= 0)
+			throw new Exception('MTU too small for the IP header!');
+		
+		$field = $this->getOffset();
+		if (($field & IIPv4::FLAG_DF) && strlen($raw) > $mtu)
+			throw new Exception('Packet exceeds the MTU and has the don\'t fragment flag set!');
+		
+		//a fragment can be fragmented again, keep its offset and more fragments flag
+		$base = $field & IIPv4::OFFSET_MASK;
+		$more = $field & IIPv4::FLAG_MF;
+		
+		//the fragments after the first only carry the options with the copy bit set (RFC 791)
+		$options = '';
+		for ($i = IIPv4::HEADER_SIZE; $i < $ipLength && $raw[$i] != "\0"; ) {
+			$type = ord($raw[$i]);
+			
+			if ($type == 1) {
+				$i++;
+				continue;
+			}
+			
+			$optionLength = $i + 1 < $ipLength ? ord($raw[$i + 1]) : 0;
+			if ($optionLength < 2 || $i + $optionLength > $ipLength)
+				break;
+			
+			if ($type & 0x80)
+				$options .= substr($raw, $i, $optionLength);
+			
+			$i += $optionLength;
+		}
+		
+		if (strlen($options) % 4)
+			$options .= str_repeat("\0", 4 - strlen($options) % 4);
+		
+		$headers = array(
+			substr($raw, 0, $ipLength),
+			chr((ord($raw[IIPv4::VERSION_LENGTH]) & 0xF0) | ((IIPv4::HEADER_SIZE + strlen($options)) >> 2))
+				. substr($raw, 1, IIPv4::HEADER_SIZE - 1) . $options,
+		);
+		
+		$sums = array();
+		foreach ($headers as $ipHeader) {
+			$sums[] = Checksum::partial(substr($ipHeader, 0, IIPv4::LENGTH) . "\0\0" . substr($ipHeader, IIPv4::ID_SEQ, 2)
+				. "\0\0" . substr($ipHeader, IIPv4::TTL, 2) . "\0\0" . substr($ipHeader, IIPv4::IP_SRC));
+		}
+		
+		$payloadLength = strlen($raw) - $ipLength;
+		
+		$fragments = array();
+		$offset = 0;
+		do {
+			$later = $offset == 0 ? 0 : 1;
+			$ipHeader = $headers[$later];
+			
+			$chunk = (string)substr($raw, $ipLength + $offset, ($mtu - strlen($ipHeader)) & ~7);
+			$total = strlen($ipHeader) + strlen($chunk);
+			
+			$field = ($base + ($offset >> 3)) & IIPv4::OFFSET_MASK;
+			if ($offset + strlen($chunk) < $payloadLength || $more)
+				$field |= IIPv4::FLAG_MF;
+			
+			$fragments[] = substr($ipHeader, 0, IIPv4::LENGTH) . pack('n', $total) . substr($ipHeader, IIPv4::ID_SEQ, 2)
+				. pack('n', $field) . substr($ipHeader, IIPv4::TTL, 2) . pack('n', Checksum::finish($sums[$later] + $total + $field))
+				. substr($ipHeader, IIPv4::IP_SRC) . $chunk;
+			
+			$offset += strlen($chunk);
+		} while ($offset < $payloadLength);
+		
+		return $fragments;
 	}
 	
 	public function completePacket() {
+		$profile = Profiler::$enabled ? Profiler::now() : 0;
+		
 		if ($this->getLength() == 0)
 			$this->setLength($this->getPacketLength());
 			
@@ -187,5 +442,8 @@ class IPv4ProtocolPacket extends RawPacket {
 		
 		$this->_buffer->setMemorySize(IIPv4::HEADER_SIZE);
 		$this->_buffer->addString($this->_data->getRawPacket());
+		
+		if ($profile)
+			Profiler::record('IPv4ProtocolPacket::completePacket', $profile);
 	}
 }
\ No newline at end of file
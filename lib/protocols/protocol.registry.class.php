@@ -0,0 +1,100 @@
+<?php
+
+/**
+ * Protocol Registry Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * Dissectors of content protocols, by IP protocol number
+ * 
+ * IPv4ProtocolPacket::getDataObject() looks the protocol up here, so a new
+ * protocol is added with one register() call instead of another branch.
+ * A dissector is a RawPacket class that takes the raw data in its
+ * constructor. Its file can be given to load the class only when a packet
+ * of the protocol is seen.
+ */
+class ProtocolRegistry {
+	/**
+	 * IP protocol number => array(class, header size, file), read directly by prnl-native; use register()
+	 */
+	public static $dissectors = array();
+	
+	/**
+	 * @param int $protocol IP protocol number
+	 * @param string $class RawPacket class
+	 * @param int $headerSize bytes kept in header only mode
+	 * @param string $file file to load the class from on first use
+	 */
+	public static function register($protocol, $class, $headerSize, $file = null) {
+		if ($protocol < 0 || $protocol > 255)
+			throw new Exception('Invalid protocol number!');
+		
+		self::$dissectors[$protocol] = array($class, $headerSize, $file);
+	}
+	
+	public static function unregister($protocol) {
+		unset(self::$dissectors[$protocol]);
+	}
+	
+	/**
+	 * @param int $protocol
+	 * @return array (class, header size) or null when unknown, the class is loaded
+	 */
+	public static function get($protocol) {
+		if (!isset(self::$dissectors[$protocol]))
+			return null;
+		
+		return self::load(self::$dissectors[$protocol]);
+	}
+	
+	/**
+	 * Dissect the content of a IP packet
+	 * 
+	 * In header only mode just the header bytes are copied out of the buffer,
+	 * the payload is never touched.
+	 *
+	 * @param int $protocol IP protocol number
+	 * @param Memory $buffer the IP packet
+	 * @param int $offset start of the content in the buffer
+	 * @param bool $headerOnly only pass the header to the dissector, not the payload
+	 * @return RawPacket
+	 */
+	public static function create($protocol, Memory $buffer, $offset, $headerOnly = false) {
+		if (!isset(self::$dissectors[$protocol])) {
+			$packet = new RawPacket();
+			
+			if (!$headerOnly)
+				$packet->setRawPacket($buffer->getMemory($offset));
+			
+			return $packet;
+		}
+		
+		list($class, $headerSize) = self::load(self::$dissectors[$protocol]);
+		
+		return new $class($headerOnly ? $buffer->getMemory($offset, $headerSize) : $buffer->getMemory($offset));
+	}
+	
+	private static function load(array $dissector) {
+		if ($dissector[2] !== null && !class_exists($dissector[0], false))
+			require_once($dissector[2]);
+		
+		return array($dissector[0], $dissector[1]);
+	}
+}
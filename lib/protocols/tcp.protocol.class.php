@@ -26,6 +26,10 @@ class TCPProtocolPacket extends RawPacket implements ICompleteableProtocolPacket
 		parent::__construct(ITCP::HEADER_SIZE);
 		
 		if (strlen($data) > 0) {
+			if (LiveCounters::$enabled && strlen($data) < ITCP::HEADER_SIZE) {
+				LiveCounters::count(LiveCounters::DECODE_ERRORS);
+			}
+			
 			$this->setRawPacket($data);
 		}
 		
@@ -125,6 +129,8 @@ class TCPProtocolPacket extends RawPacket implements ICompleteableProtocolPacket
 	 * Calculate the checksum of the packet
 	 */
 	public function calculateChecksum(Memory $ipPacketBuffer) {
+		$profile = Profiler::$enabled ? Profiler::now() : 0;
+		
 		$this->_buffer->resetReadPointer();
 		
 		$sum = new UShort();
@@ -141,7 +147,14 @@ class TCPProtocolPacket extends RawPacket implements ICompleteableProtocolPacket
 		$sum->add($this->getPacketLength());
 		
 		$sum->bitNot();
-		$this->_buffer->setShort(IUDP::CHECKSUM, $sum->getValue());
+		$this->_buffer->setShort(ITCP::CHECKSUM, $sum->getValue());
+		
+		if (LiveCounters::$enabled) {
+			LiveCounters::count(LiveCounters::CHECKSUMS);
+		}
+		
+		if ($profile)
+			Profiler::record('TCPProtocolPacket::calculateChecksum', $profile);
 	}
 	
 	public function completePacket(Memory $ipPacketBuffer) {
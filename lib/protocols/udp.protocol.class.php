@@ -26,6 +26,10 @@ class UDPProtocolPacket extends RawPacket implements ICompleteableProtocolPacket
 		parent::__construct(IUDP::HEADER_SIZE);
 		
 		if (strlen($data) > 0) {
+			if (LiveCounters::$enabled && strlen($data) < IUDP::HEADER_SIZE) {
+				LiveCounters::count(LiveCounters::DECODE_ERRORS);
+			}
+			
 			$this->setRawPacket($data);
 		}
 	}
@@ -83,6 +87,8 @@ class UDPProtocolPacket extends RawPacket implements ICompleteableProtocolPacket
 	 * Calculate the checksum of the packet
 	 */
 	public function calculateChecksum(Memory $ipPacketBuffer) {
+		$profile = Profiler::$enabled ? Profiler::now() : 0;
+		
 		$this->_buffer->resetReadPointer();
 		
 		$sum = new UShort();
@@ -100,6 +106,13 @@ class UDPProtocolPacket extends RawPacket implements ICompleteableProtocolPacket
 		
 		$sum->bitNot();
 		$this->_buffer->setShort(IUDP::CHECKSUM, $sum->getValue());
+		
+		if (LiveCounters::$enabled) {
+			LiveCounters::count(LiveCounters::CHECKSUMS);
+		}
+		
+		if ($profile)
+			Profiler::record('UDPProtocolPacket::calculateChecksum', $profile);
 	}
 	
 	public function completePacket(Memory $ipPacketBuffer) {
@@ -0,0 +1,62 @@
+<?php
+
+/**
+ * Checksum Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * Internet checksum (RFC 1071) on strings
+ * 
+ * partial() returns a sum that can be continued, so a header that is
+ * shared by many packets only has to be summed once.
+ */
+class Checksum {
+	/**
+	 * Add data to a ones' complement sum
+	 *
+	 * @param string $data
+	 * @param int $sum sum to continue
+	 * @return int folded, not inverted sum
+	 */
+	public static function partial($data, $sum = 0) {
+		if (strlen($data) % 2)
+			$data .= "\0";
+		
+		if (strlen($data) > 0)
+			$sum += array_sum(unpack('n*', $data));
+		
+		return self::fold($sum);
+	}
+	
+	/**
+	 * @param int $sum
+	 * @return int the checksum to put in a header
+	 */
+	public static function finish($sum) {
+		return ~self::fold($sum) & 0xFFFF;
+	}
+	
+	private static function fold($sum) {
+		while ($sum > 0xFFFF)
+			$sum = ($sum & 0xFFFF) + ($sum >> 16);
+		
+		return $sum;
+	}
+}
@@ -0,0 +1,178 @@
+<?php
+
+/**
+ * Latency histogram
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/**
+ * Log bucketed latency histogram, in the style of HdrHistogram
+ * 
+ * Values (nanoseconds) below 2^(precision+1) get a bucket of their own, above
+ * that every power of two is split in 2^precision buckets, so a percentile is
+ * never more than 1/2^precision off. Only buckets that were hit are stored,
+ * recording is a few integer operations and one array increment.
+ */
+class LatencyHistogram {
+	private $_precision;
+	private $_subBuckets;
+	
+	private $_buckets = array();
+	private $_count = 0;
+	private $_sum = 0;
+	private $_min = null;
+	private $_max = 0;
+	
+	/**
+	 * @param int $precision bits of sub buckets, 7 gives at most 0.8% error
+	 */
+	public function __construct($precision = 7) {
+		if ($precision < 1 || $precision > 16)
+			throw new Exception('Invalid precision!');
+		
+		$this->_precision = $precision;
+		$this->_subBuckets = 1 << $precision;
+	}
+	
+	/**
+	 * Record a value
+	 *
+	 * @param int $ns
+	 */
+	public function record($ns) {
+		$ns = $ns < 0 ? 0 : (int)$ns;
+		
+		//shift = bits above the precision of the highest set bit
+		$shift = $ns < $this->_subBuckets << 1 ? 0 : (int)log($ns, 2) - $this->_precision;
+		
+		//log() may be off by one next to a power of two
+		if ($shift > 0 && $ns >> $shift < $this->_subBuckets)
+			$shift--;
+		else if ($ns >> $shift >= $this->_subBuckets << 1)
+			$shift++;
+		
+		$index = $shift * $this->_subBuckets + ($ns >> $shift);
+		
+		if (isset($this->_buckets[$index]))
+			$this->_buckets[$index]++;
+		else
+			$this->_buckets[$index] = 1;
+		
+		$this->_count++;
+		$this->_sum += $ns;
+		
+		if ($this->_min === null || $ns < $this->_min)
+			$this->_min = $ns;
+		
+		if ($ns > $this->_max)
+			$this->_max = $ns;
+	}
+	
+	/**
+	 * Lowest value of a bucket
+	 *
+	 * @param int $index
+	 * @return int
+	 */
+	private function bucketValue($index) {
+		if ($index < $this->_subBuckets << 1)
+			return $index;
+		
+		$shift = (int)($index / $this->_subBuckets) - 1;
+		
+		return ($index - $shift * $this->_subBuckets) << $shift;
+	}
+	
+	/**
+	 * Value below which $percentile percent of the recorded values are
+	 *
+	 * @param float $percentile 0 - 100
+	 * @return int
+	 */
+	public function getPercentile($percentile) {
+		if ($this->_count == 0)
+			return 0;
+		
+		ksort($this->_buckets);
+		
+		$rank = max(1, (int)ceil($this->_count * $percentile / 100));
+		$seen = 0;
+		
+		foreach ($this->_buckets as $index => $count) {
+			$seen += $count;
+			
+			if ($seen >= $rank)
+				return min($this->_max, max($this->_min, $this->bucketValue($index)));
+		}
+		
+		return $this->_max;
+	}
+	
+	public function getCount() {
+		return $this->_count;
+	}
+	
+	/**
+	 * Add the values of another histogram of the same precision
+	 *
+	 * @param LatencyHistogram $histogram
+	 */
+	public function merge(LatencyHistogram $histogram) {
+		if ($histogram->_precision != $this->_precision)
+			throw new Exception('Histograms differ in precision!');
+		
+		foreach ($histogram->_buckets as $index => $count) {
+			if (isset($this->_buckets[$index]))
+				$this->_buckets[$index] += $count;
+			else
+				$this->_buckets[$index] = $count;
+		}
+		
+		$this->_count += $histogram->_count;
+		$this->_sum += $histogram->_sum;
+		$this->_max = max($this->_max, $histogram->_max);
+		
+		if ($histogram->_min !== null && ($this->_min === null || $histogram->_min < $this->_min))
+			$this->_min = $histogram->_min;
+	}
+	
+	public function reset() {
+		$this->_buckets = array();
+		$this->_count = 0;
+		$this->_sum = 0;
+		$this->_min = null;
+		$this->_max = 0;
+	}
+	
+	/**
+	 * @return array count, min, mean, p50, p99, p999 and max in nanoseconds
+	 */
+	public function getSummary() {
+		return array(
+			'count' => $this->_count,
+			'min' => $this->_min === null ? 0 : $this->_min,
+			'mean' => $this->_count > 0 ? $this->_sum / $this->_count : 0,
+			'p50' => $this->getPercentile(50),
+			'p99' => $this->getPercentile(99),
+			'p999' => $this->getPercentile(99.9),
+			'max' => $this->_max,
+		);
+	}
+}
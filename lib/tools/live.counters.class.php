@@ -0,0 +1,241 @@
+<?php
+
+/**
+ * Live Counters Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * Live counters of a running PRNL process, readable by bin/prnl-stats
+ * 
+ * Counting only touches a local array, the clock is read every CHECK_EVERY
+ * counts and the counters are copied to a shared memory slot at most once
+ * a second. Every process (or capture worker) owns
+ * its own 256 byte slot, so multi-process setups never share a cache line.
+ * A reader may see a slot while it is written, which is fine for statistics.
+ */
+class LiveCounters {
+	const PACKETS_IN    = 0;
+	const BYTES_IN      = 1;
+	const PACKETS_OUT   = 2;
+	const BYTES_OUT     = 3;
+	const DECODE_ERRORS = 4;
+	const SEND_FAILURES = 5;
+	const BATCHES       = 6;
+	const BATCH_PACKETS = 7;
+	const BATCH_MAX     = 8;
+	const CHECKSUMS     = 9;
+	
+	const COUNTERS      = 10;
+	const ERRNO_SLOTS   = 8;
+	
+	const MAGIC         = 0x534E5250;
+	const HEADER_SIZE   = 64;
+	const SLOT_SIZE     = 256;
+	const CHECK_EVERY   = 64;
+	
+	public static $enabled = false;
+	
+	private static $_counters = array();
+	private static $_errors = array();
+	
+	private static $_shm;
+	private static $_slot;
+	private static $_lastFlush = 0;
+	private static $_countdown = self::CHECK_EVERY;
+	
+	public static $names = array(
+		self::PACKETS_IN    => 'packets_in',
+		self::BYTES_IN      => 'bytes_in',
+		self::PACKETS_OUT   => 'packets_out',
+		self::BYTES_OUT     => 'bytes_out',
+		self::DECODE_ERRORS => 'decode_errors',
+		self::SEND_FAILURES => 'send_failures',
+		self::BATCHES       => 'batches',
+		self::BATCH_PACKETS => 'batch_packets',
+		self::BATCH_MAX     => 'batch_max',
+		self::CHECKSUMS     => 'checksums',
+	);
+	
+	/**
+	 * Start counting into a slot of the shared counter block
+	 *
+	 * @param int $key SysV IPC key of the block
+	 * @param int $slot slot of this process, e.g. the capture worker id
+	 * @param int $slots number of slots when the block is created
+	 */
+	public static function enable($key, $slot = 0, $slots = 64) {
+		if (!function_exists('shmop_open'))
+			throw new Exception('Live counters require shmop!');
+		
+		$shm = @shmop_open($key, 'c', 0600, self::HEADER_SIZE + $slots * self::SLOT_SIZE);
+		if (!$shm)
+			throw new Exception('Unable to open the counter block!');
+		
+		list(, $magic, $size) = unpack('V2', shmop_read($shm, 0, 8));
+		if ($magic != self::MAGIC) {
+			$size = $slots;
+			shmop_write($shm, pack('V3', self::MAGIC, $size, self::SLOT_SIZE), 0);
+		}
+		
+		if ($slot < 0 || $slot >= $size)
+			throw new Exception('Invalid counter slot!');
+		
+		self::$_shm = $shm;
+		self::$_slot = $slot;
+		self::reset();
+		self::$enabled = true;
+		
+		self::flush();
+	}
+	
+	public static function disable() {
+		if (self::$enabled) {
+			self::flush();
+			shmop_close(self::$_shm);
+		}
+		
+		self::$enabled = false;
+		self::$_shm = null;
+	}
+	
+	public static function reset() {
+		self::$_counters = array_fill(0, self::COUNTERS, 0);
+		self::$_errors = array();
+	}
+	
+	/**
+	 * Callers check LiveCounters::$enabled first, so counting costs nothing when disabled
+	 *
+	 * @param int $counter
+	 * @param int $value
+	 */
+	public static function count($counter, $value = 1) {
+		self::$_counters[$counter] += $value;
+		
+		if (--self::$_countdown <= 0)
+			self::tick();
+	}
+	
+	public static function countBatch($packets) {
+		self::$_counters[self::BATCHES]++;
+		self::$_counters[self::BATCH_PACKETS] += $packets;
+		
+		if ($packets > self::$_counters[self::BATCH_MAX])
+			self::$_counters[self::BATCH_MAX] = $packets;
+		
+		if (--self::$_countdown <= 0)
+			self::tick();
+	}
+	
+	public static function countSendFailure($errno) {
+		self::$_counters[self::SEND_FAILURES]++;
+		
+		if (!isset(self::$_errors[$errno]))
+			self::$_errors[$errno] = 0;
+		self::$_errors[$errno]++;
+		
+		if (--self::$_countdown <= 0)
+			self::tick();
+	}
+	
+	/**
+	 * Copy the counters to the shared slot when a second has passed,
+	 * event loops call this while idle so the slot never goes stale
+	 */
+	public static function tick() {
+		self::$_countdown = self::CHECK_EVERY;
+		
+		if (time() != self::$_lastFlush)
+			self::flush();
+	}
+	
+	public static function flush() {
+		if (!self::$_shm)
+			return;
+		
+		$values = array(getmypid(), time());
+		foreach (self::$_counters as $value) {
+			$values[] = $value;
+		}
+		
+		arsort(self::$_errors);
+		$errors = array_slice(self::$_errors, 0, self::ERRNO_SLOTS, true);
+		$slot = '';
+		foreach ($values as $value) {
+			$slot .= pack('VV', $value & 0xFFFFFFFF, $value >> 32);
+		}
+		
+		foreach ($errors as $errno => $count) {
+			$slot .= pack('VV', $errno, 0) . pack('VV', $count & 0xFFFFFFFF, $count >> 32);
+		}
+		
+		shmop_write(self::$_shm, str_pad($slot, self::SLOT_SIZE, "\0"), self::HEADER_SIZE + self::$_slot * self::SLOT_SIZE);
+		self::$_lastFlush = time();
+	}
+	
+	/**
+	 * Read all used slots of a counter block
+	 *
+	 * @param int $key
+	 * @return array slot => array('pid', 'updated', counter names..., 'errors' => array(errno => count))
+	 */
+	public static function read($key) {
+		$shm = @shmop_open($key, 'a', 0, 0);
+		if (!$shm)
+			throw new Exception('Unable to open the counter block!');
+		
+		list(, $magic, $slots) = unpack('V2', shmop_read($shm, 0, 8));
+		if ($magic != self::MAGIC) {
+			shmop_close($shm);
+			throw new Exception('Shared memory segment is not a counter block!');
+		}
+		
+		$data = shmop_read($shm, self::HEADER_SIZE, $slots * self::SLOT_SIZE);
+		shmop_close($shm);
+		
+		$result = array();
+		for ($slot = 0; $slot < $slots; $slot++) {
+			$words = array_values(unpack('V*', substr($data, $slot * self::SLOT_SIZE, self::SLOT_SIZE)));
+			
+			$values = array();
+			for ($i = 0; $i < count($words); $i += 2) {
+				$values[] = $words[$i] + ($words[$i + 1] << 32);
+			}
+			
+			if ($values[0] == 0)
+				continue;
+			
+			$counters = array('pid' => $values[0], 'updated' => $values[1]);
+			foreach (self::$names as $counter => $name) {
+				$counters[$name] = $values[2 + $counter];
+			}
+			
+			$counters['errors'] = array();
+			for ($i = 2 + self::COUNTERS; $i < 2 + self::COUNTERS + self::ERRNO_SLOTS * 2; $i += 2) {
+				if ($values[$i + 1] > 0)
+					$counters['errors'][$values[$i]] = $values[$i + 1];
+			}
+			
+			$result[$slot] = $counters;
+		}
+		
+		return $result;
+	}
+}
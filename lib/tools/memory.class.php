@@ -40,9 +40,14 @@ class Memory {
 	}
 	
 	public function addString($string) {
+		$profile = Profiler::$enabled ? Profiler::now() : 0;
+		
 		for ($i = 0; $i < strlen($string); $i++) {
 			$this->addByte(ord($string[$i]));
 		}
+		
+		if ($profile)
+			Profiler::record('Memory::addString', $profile);
 	}
 	
 	public function addShort($short) {
@@ -156,6 +161,8 @@ class Memory {
 	}
 	
 	public function setMemorySize($size) {
+		$profile = Profiler::$enabled ? Profiler::now() : 0;
+		
 		if ($this->_pos < $size) {
 			if ($size > 0) {
 				$pos = $this->_pos;
@@ -168,6 +175,9 @@ class Memory {
 			$this->_buffer = substr($this->_buffer, 0, $size);
 			$this->_pos = $size;
 		}
+		
+		if ($profile)
+			Profiler::record('Memory::setMemorySize', $profile);
 	}
 	
 	public function resetMemory() {
@@ -0,0 +1,122 @@
+<?php
+
+/**
+ * Hot path profiler
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/**
+ * Call counts and inclusive time of the hot path methods
+ * 
+ * The packet and network methods record themselves while $enabled is set, at the
+ * cost of a static property check when it isn't. The native extension profiles
+ * every function and method instead when it is loaded with prnlnative.profile=1;
+ * dump() then returns its numbers.
+ */
+class Profiler {
+	public static $enabled = false;
+	
+	private static $_calls = array();
+	private static $_ns = array();
+	
+	public static function enable() {
+		//the executor hooks of prnl-native already see every call
+		self::$enabled = !self::isNative();
+	}
+	
+	public static function disable() {
+		self::$enabled = false;
+	}
+	
+	/**
+	 * Whether prnl-native does the profiling
+	 *
+	 * @return bool
+	 */
+	public static function isNative() {
+		return function_exists('prnl_profile_dump') && ini_get('prnlnative.profile');
+	}
+	
+	/**
+	 * Current time in nanoseconds, the start of a measurement
+	 *
+	 * @return int
+	 */
+	public static function now() {
+		if (function_exists('hrtime'))
+			return hrtime(true);
+		
+		return (int)(microtime(true) * 1000000000);
+	}
+	
+	/**
+	 * Record a call to $name that started at $start
+	 *
+	 * @param string $name
+	 * @param int $start
+	 */
+	public static function record($name, $start) {
+		$ns = self::now() - $start;
+		
+		if (isset(self::$_calls[$name])) {
+			self::$_calls[$name]++;
+			self::$_ns[$name] += $ns;
+		}
+		else {
+			self::$_calls[$name] = 1;
+			self::$_ns[$name] = $ns;
+		}
+	}
+	
+	/**
+	 * Calls and nanoseconds per method, most expensive first
+	 *
+	 * @param bool $reset
+	 * @return array name => array('calls' => int, 'ns' => int)
+	 */
+	public static function dump($reset = false) {
+		$result = array();
+		
+		if (self::isNative()) {
+			$result = prnl_profile_dump($reset);
+		}
+		else {
+			foreach (self::$_calls as $name => $calls) {
+				$result[$name] = array('calls' => $calls, 'ns' => self::$_ns[$name]);
+			}
+			
+			if ($reset)
+				self::reset();
+		}
+		
+		uasort($result, array('Profiler', 'compare'));
+		
+		return $result;
+	}
+	
+	public static function reset() {
+		self::$_calls = array();
+		self::$_ns = array();
+	}
+	
+	private static function compare($a, $b) {
+		return $b['ns'] - $a['ns'] > 0 ? 1 : ($b['ns'] == $a['ns'] ? 0 : -1);
+	}
+}
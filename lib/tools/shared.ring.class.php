@@ -0,0 +1,249 @@
+<?php
+
+/**
+ * Shared Ring Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * Single producer / single consumer packet ring in shared memory
+ * 
+ * One process pushes raw packets, another pops them, without a copy through
+ * the kernel or a syscall per packet. The native extension updates head and
+ * tail with acquire/release ordering. The shmop fallback relies on aligned
+ * 32 bit writes being atomic and ordered, which holds on x86.
+ * 
+ * Both implementations use the same segment layout, so a native producer
+ * can feed a pure PHP consumer.
+ */
+class SharedRing {
+	const MAGIC       = 0x524E5250;
+	const HEAD        = 64;
+	const TAIL        = 128;
+	const HEADER_SIZE = 192;
+	const WRAP        = 0xFFFFFFFF;
+	
+	private $_ring;
+	private $_capacity;
+	private $_native;
+	
+	/**
+	 * @param int $key SysV IPC key, see ftok()
+	 * @param int $capacity data size in bytes, a power of two, packets may use at most half of it
+	 * @param bool $create create the segment when it doesn't exist
+	 */
+	public function __construct($key, $capacity = 1048576, $create = true) {
+		if ($capacity < 64 || ($capacity & ($capacity - 1)) != 0)
+			throw new Exception('Ring capacity must be a power of two!');
+		
+		$this->_capacity = $capacity;
+		$this->_native = PRNL_NATIVE;
+		
+		if ($this->_native) {
+			$this->_ring = prnl_ring_open($key, $capacity, $create);
+		}
+		else {
+			if (!function_exists('shmop_open'))
+				throw new Exception('The shared ring requires prnl-native or shmop!');
+			
+			$this->_ring = @shmop_open($key, $create ? 'c' : 'w', 0600, $create ? self::HEADER_SIZE + $capacity : 0);
+			
+			if ($this->_ring) {
+				$this->attach($create);
+			}
+		}
+		
+		if (!$this->_ring)
+			throw new Exception('Unable to open the shared ring!');
+	}
+	
+	/**
+	 * Append a packet
+	 *
+	 * @param mixed $packet RawPacket or raw string
+	 * @return bool false when the ring is full
+	 */
+	public function push($packet) {
+		if ($packet instanceof RawPacket)
+			$packet = $packet->getRawPacket();
+		
+		$length = strlen($packet);
+		$record = 4 + (($length + 3) & ~3);
+		
+		//a record over half the ring may never fit next to the wrap point, even in an empty ring
+		if ($record > $this->_capacity / 2)
+			throw new Exception('Packet is larger than half the ring!');
+		
+		if ($this->_native)
+			return prnl_ring_push($this->_ring, $packet);
+		
+		$head = $this->readCounter(self::HEAD);
+		$tail = $this->readCounter(self::TAIL);
+		
+		$pos = $head & ($this->_capacity - 1);
+		$contig = $this->_capacity - $pos;
+		$need = $record > $contig ? $contig + $record : $record;
+		
+		if ($need > $this->_capacity - (($head - $tail) & 0xFFFFFFFF))
+			return false;
+		
+		if ($record > $contig) {
+			shmop_write($this->_ring, pack('V', self::WRAP), self::HEADER_SIZE + $pos);
+			$head += $contig;
+			$pos = 0;
+		}
+		
+		shmop_write($this->_ring, pack('V', $length) . $packet, self::HEADER_SIZE + $pos);
+		
+		//publish the record only after its bytes are written
+		$this->writeCounter(self::HEAD, $head + $record);
+		
+		return true;
+	}
+	
+	/**
+	 * Append packets until the ring is full
+	 *
+	 * @param array $packets RawPacket objects or raw strings
+	 * @return int number of packets appended
+	 */
+	public function pushBatch(array $packets) {
+		if ($this->_native) {
+			foreach ($packets as $i => $packet) {
+				if ($packet instanceof RawPacket)
+					$packets[$i] = $packet->getRawPacket();
+			}
+			
+			return prnl_ring_push_batch($this->_ring, $packets);
+		}
+		
+		$pushed = 0;
+		foreach ($packets as $packet) {
+			if (!$this->push($packet))
+				break;
+			
+			$pushed++;
+		}
+		
+		return $pushed;
+	}
+	
+	/**
+	 * Take one packet
+	 *
+	 * @return string raw packet, false when the ring is empty
+	 */
+	public function pop() {
+		$packets = $this->popBatch(1);
+		
+		return count($packets) > 0 ? $packets[0] : false;
+	}
+	
+	/**
+	 * Take up to $max packets
+	 *
+	 * @param int $max
+	 * @return array raw packets
+	 */
+	public function popBatch($max = 64) {
+		if ($this->_native)
+			return prnl_ring_pop($this->_ring, $max);
+		
+		$packets = array();
+		$tail = $this->readCounter(self::TAIL);
+		$head = $this->readCounter(self::HEAD);
+		
+		while ($tail != $head && count($packets) < $max) {
+			$pos = $tail & ($this->_capacity - 1);
+			list(, $length) = unpack('V', shmop_read($this->_ring, self::HEADER_SIZE + $pos, 4));
+			
+			if ($length == self::WRAP) {
+				$tail = ($tail + $this->_capacity - $pos) & 0xFFFFFFFF;
+				continue;
+			}
+			
+			$packets[] = $length > 0 ? shmop_read($this->_ring, self::HEADER_SIZE + $pos + 4, $length) : '';
+			$tail = ($tail + 4 + (($length + 3) & ~3)) & 0xFFFFFFFF;
+		}
+		
+		$this->writeCounter(self::TAIL, $tail);
+		
+		return $packets;
+	}
+	
+	/**
+	 * Number of bytes in use, including the record framing
+	 *
+	 * @return int
+	 */
+	public function getUsed() {
+		if ($this->_native) {
+			$stats = prnl_ring_stats($this->_ring);
+			return $stats['used'];
+		}
+		
+		return ($this->readCounter(self::HEAD) - $this->readCounter(self::TAIL)) & 0xFFFFFFFF;
+	}
+	
+	public function getCapacity() {
+		return $this->_capacity;
+	}
+	
+	public function close() {
+		if ($this->_ring) {
+			if ($this->_native)
+				prnl_ring_close($this->_ring);
+			else
+				shmop_close($this->_ring);
+			
+			$this->_ring = null;
+		}
+	}
+	
+	public function __destruct() {
+		$this->close();
+	}
+	
+	private function attach($create) {
+		list(, $magic, $capacity) = unpack('V2', shmop_read($this->_ring, 0, 8));
+		
+		if ($magic != self::MAGIC) {
+			if (!$create)
+				throw new Exception('Shared memory segment is not a ring!');
+			
+			shmop_write($this->_ring, pack('V', 0), self::HEAD);
+			shmop_write($this->_ring, pack('V', 0), self::TAIL);
+			shmop_write($this->_ring, pack('V', $this->_capacity), 4);
+			shmop_write($this->_ring, pack('V', self::MAGIC), 0);
+		}
+		else if ($capacity != $this->_capacity) {
+			throw new Exception('Ring capacity mismatch!');
+		}
+	}
+	
+	private function readCounter($offset) {
+		list(, $value) = unpack('V', shmop_read($this->_ring, $offset, 4));
+		
+		return $value & 0xFFFFFFFF;
+	}
+	
+	private function writeCounter($offset, $value) {
+		shmop_write($this->_ring, pack('V', $value & 0xFFFFFFFF), $offset);
+	}
+}
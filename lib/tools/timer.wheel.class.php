@@ -0,0 +1,304 @@
+<?php
+
+/**
+ * Timer Wheel Class
+ * 
+ * PHP Raw Network Library
+ * (c) 2009 Kenneth van Hooff & Martijn Bogaard
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * Hashed hierarchical timer wheel
+ * 
+ * Level 0 has 256 slots of one tick, levels 1-3 have 64 slots that each cover
+ * 64 times the range of the level below. A timer is put in the lowest level
+ * that can hold its delay and moves down when the level below wraps, so add,
+ * cancel and reschedule are O(1) and advancing costs nothing per live timer.
+ * 
+ * Expired timers are handed out in a batch by advance(). A timer added with a
+ * callback is also passed to callback($data, $id).
+ */
+class TimerWheel implements Countable {
+	const BITS0  = 8;
+	const BITSN  = 6;
+	const SIZE0  = 256;
+	const SIZEN  = 64;
+	const LEVELS = 4;
+	const RANGE  = 67108864; // 1 << (BITS0 + 3 * BITSN)
+	
+	//timer fields in the PHP fallback
+	const T_EXPIRES = 0;
+	const T_SLOT    = 1;
+	const T_DATA    = 2;
+	
+	private $_wheel;
+	private $_native;
+	private $_resolution;
+	
+	private $_slots = array();
+	private $_timers = array();
+	private $_callbacks = array();
+	private $_current;
+	private $_nextId = 1;
+	
+	/**
+	 * @param float $resolution length of a tick in seconds
+	 * @param float $now start time, defaults to the current time
+	 */
+	public function __construct($resolution = 0.01, $now = null) {
+		if ($resolution <= 0)
+			throw new Exception('Resolution must be positive!');
+		
+		if ($now === null)
+			$now = microtime(true);
+		
+		$this->_resolution = $resolution;
+		$this->_native = PRNL_NATIVE;
+		
+		if ($this->_native) {
+			$this->_wheel = prnl_timer_wheel_create($resolution, $now);
+		}
+		else {
+			$this->_slots = array_fill(0, self::SIZE0 + (self::LEVELS - 1) * self::SIZEN, array());
+			$this->_current = $this->toTick($now);
+		}
+	}
+	
+	/**
+	 * Add a timer
+	 *
+	 * @param float $delay seconds from now
+	 * @param mixed $data returned when the timer expires
+	 * @param callback $callback optional, called as callback($data, $id)
+	 * @return int timer id
+	 */
+	public function add($delay, $data = null, $callback = null) {
+		return $this->addAt(microtime(true) + $delay, $data, $callback);
+	}
+	
+	/**
+	 * Add a timer that expires at an absolute time
+	 *
+	 * @param float $expires
+	 * @param mixed $data
+	 * @param callback $callback
+	 * @return int timer id
+	 */
+	public function addAt($expires, $data = null, $callback = null) {
+		if ($this->_native) {
+			$id = prnl_timer_add($this->_wheel, $expires, $data);
+		}
+		else {
+			$id = $this->_nextId++;
+			$tick = $this->toTick($expires);
+			$slot = $this->slotOf($tick, $this->_current + 1);
+			
+			$this->_timers[$id] = array($tick, $slot, $data);
+			$this->_slots[$slot][$id] = true;
+		}
+		
+		if ($callback !== null)
+			$this->_callbacks[$id] = $callback;
+		
+		return $id;
+	}
+	
+	/**
+	 * @param int $id
+	 * @return bool false when the timer already expired or was cancelled
+	 */
+	public function cancel($id) {
+		unset($this->_callbacks[$id]);
+		
+		if ($this->_native)
+			return prnl_timer_cancel($this->_wheel, $id);
+		
+		if (!isset($this->_timers[$id]))
+			return false;
+		
+		unset($this->_slots[$this->_timers[$id][self::T_SLOT]][$id]);
+		unset($this->_timers[$id]);
+		
+		return true;
+	}
+	
+	/**
+	 * Move a timer, e.g. push back the idle timeout of a flow that saw a packet
+	 *
+	 * @param int $id
+	 * @param float $delay seconds from now
+	 * @return bool
+	 */
+	public function reschedule($id, $delay) {
+		return $this->rescheduleAt($id, microtime(true) + $delay);
+	}
+	
+	public function rescheduleAt($id, $expires) {
+		if ($this->_native)
+			return prnl_timer_reschedule($this->_wheel, $id, $expires);
+		
+		if (!isset($this->_timers[$id]))
+			return false;
+		
+		$timer = $this->_timers[$id];
+		unset($this->_slots[$timer[self::T_SLOT]][$id]);
+		
+		$tick = $this->toTick($expires);
+		$slot = $this->slotOf($tick, $this->_current + 1);
+		
+		$this->_timers[$id] = array($tick, $slot, $timer[self::T_DATA]);
+		$this->_slots[$slot][$id] = true;
+		
+		return true;
+	}
+	
+	/**
+	 * Advance the wheel and expire the timers that are due
+	 *
+	 * @param float $now defaults to the current time
+	 * @return array id => data of the expired timers
+	 */
+	public function advance($now = null) {
+		if ($now === null)
+			$now = microtime(true);
+		
+		if ($this->_native) {
+			$expired = prnl_timer_advance($this->_wheel, $now);
+		}
+		else {
+			$expired = array();
+			$target = $this->toTick($now);
+			
+			while ($this->_current < $target) {
+				//nothing to expire, jump ahead
+				if (count($this->_timers) == 0) {
+					$this->_current = $target;
+					break;
+				}
+				
+				$this->_current++;
+				$slot = $this->_current & (self::SIZE0 - 1);
+				
+				//level 0 wrapped, pull the next slot of the levels above down
+				for ($level = 1; $slot == 0 && $level < self::LEVELS; $level++) {
+					$slot = ($this->_current >> (self::BITS0 + ($level - 1) * self::BITSN)) & (self::SIZEN - 1);
+					$this->cascade(self::SIZE0 + ($level - 1) * self::SIZEN + $slot);
+				}
+				
+				$slot = $this->_current & (self::SIZE0 - 1);
+				foreach ($this->_slots[$slot] as $id => $dummy) {
+					$expired[$id] = $this->_timers[$id][self::T_DATA];
+					unset($this->_timers[$id]);
+				}
+				$this->_slots[$slot] = array();
+			}
+		}
+		
+		if (count($this->_callbacks) > 0) {
+			foreach ($expired as $id => $data) {
+				if (isset($this->_callbacks[$id])) {
+					$callback = $this->_callbacks[$id];
+					unset($this->_callbacks[$id]);
+					
+					call_user_func($callback, $data, $id);
+				}
+			}
+		}
+		
+		return $expired;
+	}
+	
+	/**
+	 * Seconds until the next timer may expire, null without timers
+	 *
+	 * @return float
+	 */
+	public function getTimeout($now = null) {
+		if ($now === null)
+			$now = microtime(true);
+		
+		if ($this->_native) {
+			$info = prnl_timer_info($this->_wheel);
+			
+			if ($info['next'] < 0)
+				return null;
+			
+			return max(0, $info['now'] + $info['next'] * $this->_resolution - $now);
+		}
+		
+		if (count($this->_timers) == 0)
+			return null;
+		
+		//scan level 0 up to the next cascade, timers above it can't expire earlier
+		for ($tick = $this->_current + 1; ; $tick++) {
+			$slot = $tick & (self::SIZE0 - 1);
+			
+			if ($slot == 0 || count($this->_slots[$slot]) > 0)
+				break;
+		}
+		
+		return max(0, $tick * $this->_resolution - $now);
+	}
+	
+	public function count() {
+		if ($this->_native) {
+			$info = prnl_timer_info($this->_wheel);
+			return $info['count'];
+		}
+		
+		return count($this->_timers);
+	}
+	
+	private function toTick($time) {
+		return $time <= 0 ? 0 : (int)floor($time / $this->_resolution);
+	}
+	
+	private function slotOf($tick, $earliest) {
+		if ($tick < $earliest)
+			$tick = $earliest;
+		
+		$delta = $tick - $this->_current;
+		
+		if ($delta < self::SIZE0)
+			return $tick & (self::SIZE0 - 1);
+		
+		if ($delta < (1 << (self::BITS0 + self::BITSN)))
+			return self::SIZE0 + (($tick >> self::BITS0) & (self::SIZEN - 1));
+		
+		if ($delta < (1 << (self::BITS0 + 2 * self::BITSN)))
+			return self::SIZE0 + self::SIZEN + (($tick >> (self::BITS0 + self::BITSN)) & (self::SIZEN - 1));
+		
+		//beyond the range of the wheel, park it in the last slot and re-evaluate on cascade
+		if ($delta >= self::RANGE)
+			$tick = $this->_current + self::RANGE - 1;
+		
+		return self::SIZE0 + 2 * self::SIZEN + (($tick >> (self::BITS0 + 2 * self::BITSN)) & (self::SIZEN - 1));
+	}
+	
+	private function cascade($slot) {
+		$ids = $this->_slots[$slot];
+		$this->_slots[$slot] = array();
+		
+		//a cascading timer may still go into the current slot, advance runs it next
+		foreach ($ids as $id => $dummy) {
+			$newSlot = $this->slotOf($this->_timers[$id][self::T_EXPIRES], $this->_current);
+			
+			$this->_timers[$id][self::T_SLOT] = $newSlot;
+			$this->_slots[$newSlot][$id] = true;
+		}
+	}
+}